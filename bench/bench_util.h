@@ -0,0 +1,69 @@
+#ifndef NET_BENCH_UTIL_H_
+#define NET_BENCH_UTIL_H_
+
+#include "net_interface.h"
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+
+// helpers shared by the benches in bench/ and the tools in tools/
+namespace bench {
+
+inline unsigned long long NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// echoes every tcp chunk, udp datagram and rudp message back to its sender
+class EchoServer : public net::NetInterface {
+ public:
+  bool OnTcpDisconnected(net::TcpHandle handle) override { return true; }
+  bool OnTcpAccepted(net::TcpHandle handle, net::TcpHandle accept_handle) override { return true; }
+  bool OnTcpReceived(net::TcpHandle handle, const char* packet, int size) override {
+    std::unique_ptr<char[]> echo(new char[size]);
+    memcpy(echo.get(), packet, size);
+    return TcpSend(handle, std::move(echo), size);
+  }
+  bool OnTcpError(net::TcpHandle handle, int error) override { return true; }
+  bool OnUdpReceived(net::UdpHandle handle, const char* packet, int size, std::string ip, int port) override {
+    return OnUdpReceivedFrom(handle, packet, size, net::NetEndpoint(ip, port));
+  }
+  bool OnUdpReceivedFrom(net::UdpHandle handle, const char* packet, int size, const net::NetEndpoint& from) override {
+    std::unique_ptr<char[]> echo(new char[size]);
+    memcpy(echo.get(), packet, size);
+    return UdpSendTo(handle, std::move(echo), size, from);
+  }
+  bool OnUdpError(net::UdpHandle handle, int error) override { return true; }
+  bool OnRudpReceived(net::RudpHandle handle, const char* packet, int size) override {
+    std::unique_ptr<char[]> echo(new char[size]);
+    memcpy(echo.get(), packet, size);
+    return RudpSend(handle, std::move(echo), size);
+  }
+
+  // a tcp listener or a udp socket on ip:port, for callers that need a single echo endpoint
+  bool Start(const std::string& proto, const std::string& ip, int port) {
+    if (proto == "udp") {
+      return UdpCreate(ip, port, udp_handle_);
+    }
+    return TcpCreate(ip, port, tcp_handle_) && TcpListen(tcp_handle_);
+  }
+
+  void Stop() {
+    if (tcp_handle_ != net::kInvalidTcpHandle) {
+      TcpDestroy(tcp_handle_);
+      tcp_handle_ = net::kInvalidTcpHandle;
+    }
+    if (udp_handle_ != net::kInvalidUdpHandle) {
+      UdpDestroy(udp_handle_);
+      udp_handle_ = net::kInvalidUdpHandle;
+    }
+  }
+
+ private:
+  net::TcpHandle tcp_handle_ = net::kInvalidTcpHandle;
+  net::UdpHandle udp_handle_ = net::kInvalidUdpHandle;
+};
+
+} // namespace bench
+
+#endif	// NET_BENCH_UTIL_H_
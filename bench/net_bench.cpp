@@ -0,0 +1,414 @@
+/************************************************************************/
+/*  Loopback benchmark suite                                            */
+/*  tcp echo at several message sizes, many connection fan-in, tcp      */
+/*  connection churn, udp packets per second and the memory footprint  */
+/*  of idle connections. echo senders are open loop: every message is  */
+/*  stamped with the time it was due, so a stalled sender still counts */
+/*  the wait (coordinated omission correction); results are printed    */
+/*  and written as json for tracking regressions between releases;     */
+/*  inproc runs the tcp cases on the in-process transport, measuring   */
+/*  the library cost alone                                             */
+/*  USAGE: net_bench [seconds] [json file] [port] [idle connections]   */
+/*         [inproc]                                                    */
+/************************************************************************/
+
+#include "bench_util.h"
+#include "latency_histogram.h"
+#include "net_interface.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <Windows.h>
+#include <Psapi.h>
+#pragma comment(lib, "Psapi.lib")
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const int kEchoStampSize = 16;
+const int kEchoDrainMs = 2000;
+const int kUdpDatagramSize = 64;
+const int kUdpBurst = 64;
+const int kUdpMaxPendingSends = 4096;
+const int kChurnThreads = 4;
+const int kConnectionsPerPort = 30000;
+
+using bench::EchoServer;
+using bench::NowNs;
+
+unsigned long long PrivateBytes() {
+  PROCESS_MEMORY_COUNTERS_EX counters;
+  memset(&counters, 0, sizeof(counters));
+  counters.cb = sizeof(counters);
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters))) {
+    return 0;
+  }
+  return counters.PrivateUsage;
+}
+
+// one benchmark case: its parameters, its metrics and optionally the echo latencies
+struct CaseResult {
+  std::string name;
+  std::vector<std::pair<std::string, double>> params;
+  std::vector<std::pair<std::string, double>> metrics;
+  bool has_latency = false;
+  net::LatencySummary latency;
+  net::LatencySummary uncorrected_latency;
+};
+
+class BenchNet : public net::NetInterface {
+ public:
+  bool OnTcpDisconnected(net::TcpHandle handle) override { ++disconnected_; return true; }
+  bool OnTcpAccepted(net::TcpHandle handle, net::TcpHandle accept_handle) override { ++accepted_; return true; }
+  bool OnTcpReceived(net::TcpHandle handle, const char* packet, int size) override { return true; }
+  bool OnTcpError(net::TcpHandle handle, int error) override { ++errors_; return true; }
+  bool OnUdpReceived(net::UdpHandle handle, const char* packet, int size, std::string ip, int port) override {
+    return OnUdpReceivedFrom(handle, packet, size, net::NetEndpoint(ip, port));
+  }
+  bool OnUdpReceivedFrom(net::UdpHandle handle, const char* packet, int size, const net::NetEndpoint& from) override {
+    ++datagrams_;
+    return true;
+  }
+  bool OnUdpError(net::UdpHandle handle, int error) override { ++errors_; return true; }
+
+  std::atomic<unsigned long long> accepted_{0};
+  std::atomic<unsigned long long> disconnected_{0};
+  std::atomic<unsigned long long> datagrams_{0};
+  std::atomic<unsigned long long> errors_{0};
+};
+
+// a message carries the time it was due and the time it was sent, the echo of the first
+// gives the corrected latency and of the second the latency a closed loop would report
+class EchoClient : public BenchNet {
+ public:
+  bool OnTcpReceived(net::TcpHandle handle, const char* packet, int size) override {
+    unsigned long long stamps[2] = {0};
+    if (size < kEchoStampSize) {
+      return true;
+    }
+    memcpy(stamps, packet, sizeof(stamps));
+    auto now = NowNs();
+    latency_.Record(now - stamps[0]);
+    uncorrected_latency_.Record(now - stamps[1]);
+    ++echoed_;
+    echoed_bytes_ += size;
+    return true;
+  }
+
+  static std::unique_ptr<char[]> NewMessage(int size, unsigned long long due_ns) {
+    std::unique_ptr<char[]> message(new char[size]);
+    memset(message.get(), 0, size);
+    unsigned long long stamps[2] = {due_ns, NowNs()};
+    memcpy(message.get(), stamps, sizeof(stamps));
+    return message;
+  }
+
+  net::LatencyHistogram latency_;
+  net::LatencyHistogram uncorrected_latency_;
+  std::atomic<unsigned long long> echoed_{0};
+  std::atomic<unsigned long long> echoed_bytes_{0};
+};
+
+// messages are due every 1/rate seconds over all connections in turn; after a late wake up
+// every message already due is sent at once, each with its own due time
+bool RunTcpEcho(const char* name, int seconds, int port, int message_size, int connections, int rate, CaseResult& result) {
+  auto server = std::make_shared<EchoServer>();
+  auto client = std::make_shared<EchoClient>();
+  auto listen_handle = net::kInvalidTcpHandle;
+  if (!server->TcpCreate("127.0.0.1", port, listen_handle) || !server->TcpListen(listen_handle)) {
+    printf("%s: listen failed.\n", name);
+    return false;
+  }
+  std::vector<net::TcpHandle> handles;
+  for (auto i = 0; i < connections; ++i) {
+    auto handle = net::kInvalidTcpHandle;
+    if (!client->TcpCreate("127.0.0.1", 0, handle) || !client->TcpConnect(handle, "127.0.0.1", port)) {
+      printf("%s: connect failed.\n", name);
+      break;
+    }
+    handles.push_back(handle);
+  }
+  unsigned long long sent = 0;
+  unsigned long long failures = 0;
+  if (handles.size() == static_cast<size_t>(connections)) {
+    auto interval_ns = 1000000000ULL / rate;
+    auto begin_ns = NowNs();
+    auto end_ns = begin_ns + seconds * 1000000000ULL;
+    for (auto due_ns = begin_ns; due_ns < end_ns; due_ns += interval_ns) {
+      auto now = NowNs();
+      if (due_ns > now) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(due_ns - now));
+      }
+      if (client->TcpSend(handles[sent % handles.size()], EchoClient::NewMessage(message_size, due_ns), message_size)) {
+        ++sent;
+      } else {
+        ++failures;
+      }
+    }
+    auto drain_end = Clock::now() + std::chrono::milliseconds(kEchoDrainMs);
+    while (client->echoed_ < sent && Clock::now() < drain_end) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  for (auto i : handles) {
+    client->TcpDestroy(i);
+  }
+  server->TcpDestroy(listen_handle);
+  result.name = name;
+  result.params = {{"message_size", message_size}, {"connections", connections}, {"rate", rate}, {"seconds", seconds}};
+  result.metrics = {{"sent", static_cast<double>(sent)}, {"echoed", static_cast<double>(client->echoed_)},
+    {"failures", static_cast<double>(failures + client->errors_)},
+    {"msgs_per_sec", static_cast<double>(client->echoed_) / seconds},
+    {"mib_per_sec", static_cast<double>(client->echoed_bytes_) / seconds / net::kOneMebibyte}};
+  result.has_latency = true;
+  client->latency_.GetSummary(result.latency);
+  client->uncorrected_latency_.GetSummary(result.uncorrected_latency);
+  return handles.size() == static_cast<size_t>(connections);
+}
+
+bool RunTcpChurn(int seconds, int port, CaseResult& result) {
+  auto server = std::make_shared<BenchNet>();
+  auto listen_handle = net::kInvalidTcpHandle;
+  net::TcpListenConfig listen_config;
+  listen_config.recycle_sockets = true;
+  if (!server->TcpCreate("127.0.0.1", port, listen_handle) || !server->TcpListen(listen_handle, listen_config)) {
+    printf("tcp_churn: listen failed.\n");
+    return false;
+  }
+  std::atomic<bool> stop(false);
+  std::atomic<unsigned long long> cycles(0);
+  std::atomic<unsigned long long> failures(0);
+  auto client_proc = [&]() {
+    auto client = std::make_shared<BenchNet>();
+    while (!stop) {
+      auto handle = net::kInvalidTcpHandle;
+      if (client->TcpCreate("127.0.0.1", 0, handle) && client->TcpConnect(handle, "127.0.0.1", port)) {
+        ++cycles;
+      } else {
+        ++failures;
+      }
+      client->TcpDestroy(handle);
+    }
+  };
+  auto begin_time = Clock::now();
+  std::vector<std::thread> clients;
+  for (auto i = 0; i < kChurnThreads; ++i) {
+    clients.emplace_back(client_proc);
+  }
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  stop = true;
+  for (auto& i : clients) {
+    i.join();
+  }
+  auto elapsed = std::chrono::duration<double>(Clock::now() - begin_time).count();
+  server->TcpDestroy(listen_handle);
+  result.name = "tcp_churn";
+  result.params = {{"threads", kChurnThreads}, {"seconds", seconds}};
+  result.metrics = {{"cycles_per_sec", cycles / elapsed}, {"accepted_per_sec", server->accepted_ / elapsed},
+    {"failures", static_cast<double>(failures)}};
+  return true;
+}
+
+// sends are held back while too many are in flight, so the sender measures the stack and not
+// how many buffers it can queue
+bool RunUdpPps(int seconds, int port, CaseResult& result) {
+  auto receiver = std::make_shared<BenchNet>();
+  auto sender = std::make_shared<BenchNet>();
+  auto recv_handle = net::kInvalidUdpHandle;
+  auto send_handle = net::kInvalidUdpHandle;
+  if (!receiver->UdpCreate("127.0.0.1", port, recv_handle) || !sender->UdpCreate("127.0.0.1", 0, send_handle)) {
+    printf("udp_pps: create failed.\n");
+    return false;
+  }
+  net::NetEndpoint to("127.0.0.1", port);
+  unsigned long long sent = 0;
+  unsigned long long failures = 0;
+  net::NetStats stats;
+  auto begin_time = Clock::now();
+  auto end_time = begin_time + std::chrono::seconds(seconds);
+  while (Clock::now() < end_time) {
+    if (net::NetInterface::GetNetStats(stats) && stats.buffers_in_use.udp_send > kUdpMaxPendingSends) {
+      std::this_thread::yield();
+      continue;
+    }
+    for (auto i = 0; i < kUdpBurst; ++i) {
+      std::unique_ptr<char[]> packet(new char[kUdpDatagramSize]);
+      memset(packet.get(), 0, kUdpDatagramSize);
+      if (sender->UdpSendTo(send_handle, std::move(packet), kUdpDatagramSize, to)) {
+        ++sent;
+      } else {
+        ++failures;
+      }
+    }
+  }
+  auto elapsed = std::chrono::duration<double>(Clock::now() - begin_time).count();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  sender->UdpDestroy(send_handle);
+  receiver->UdpDestroy(recv_handle);
+  auto received = receiver->datagrams_.load();
+  result.name = "udp_pps";
+  result.params = {{"datagram_size", kUdpDatagramSize}, {"seconds", seconds}};
+  result.metrics = {{"sent_per_sec", sent / elapsed}, {"received_per_sec", received / elapsed},
+    {"loss_percent", sent == 0 ? 0.0 : 100.0 * (sent - (received < sent ? received : sent)) / sent},
+    {"failures", static_cast<double>(failures)}};
+  return true;
+}
+
+// both ends of every connection live in this process, the footprint per connection is the
+// growth of the private bytes divided by the connections established
+bool RunIdleMemory(int port, int connections, CaseResult& result) {
+  auto server = std::make_shared<BenchNet>();
+  auto client = std::make_shared<BenchNet>();
+  auto port_num = (connections + kConnectionsPerPort - 1) / kConnectionsPerPort;
+  auto begin_bytes = PrivateBytes();
+  std::vector<net::TcpHandle> listen_handles;
+  for (auto i = 0; i < port_num; ++i) {
+    auto handle = net::kInvalidTcpHandle;
+    if (!server->TcpCreate("127.0.0.1", port + i, handle) || !server->TcpListen(handle)) {
+      printf("idle_memory: listen failed.\n");
+      break;
+    }
+    listen_handles.push_back(handle);
+  }
+  std::vector<net::TcpHandle> handles;
+  unsigned long long failures = 0;
+  auto begin_time = Clock::now();
+  for (auto i = 0; i < connections && listen_handles.size() == static_cast<size_t>(port_num); ++i) {
+    auto handle = net::kInvalidTcpHandle;
+    if (client->TcpCreate("127.0.0.1", 0, handle) && client->TcpConnect(handle, "127.0.0.1", port + i / kConnectionsPerPort)) {
+      handles.push_back(handle);
+    } else {
+      client->TcpDestroy(handle);
+      ++failures;
+    }
+  }
+  auto connect_seconds = std::chrono::duration<double>(Clock::now() - begin_time).count();
+  auto settle_end = Clock::now() + std::chrono::seconds(10);
+  while (server->accepted_ < handles.size() && Clock::now() < settle_end) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  auto end_bytes = PrivateBytes();
+  auto established = static_cast<double>(handles.size());
+  for (auto i : handles) {
+    client->TcpDestroy(i);
+  }
+  for (auto i : listen_handles) {
+    server->TcpDestroy(i);
+  }
+  result.name = "idle_memory";
+  result.params = {{"connections", connections}};
+  result.metrics = {{"established", established}, {"accepted", static_cast<double>(server->accepted_)},
+    {"failures", static_cast<double>(failures)}, {"connects_per_sec", connect_seconds > 0 ? established / connect_seconds : 0},
+    {"private_bytes", static_cast<double>(end_bytes)},
+    {"bytes_per_connection", established > 0 && end_bytes > begin_bytes ? (end_bytes - begin_bytes) / established : 0}};
+  return true;
+}
+
+void PrintResult(const CaseResult& result) {
+  printf("%-12s", result.name.c_str());
+  for (auto& i : result.params) {
+    printf(" %s=%g", i.first.c_str(), i.second);
+  }
+  printf("\n ");
+  for (auto& i : result.metrics) {
+    printf(" %s=%.1f", i.first.c_str(), i.second);
+  }
+  if (result.has_latency) {
+    printf("\n  latency us p50 %.1f p99 %.1f p99.9 %.1f max %.1f (uncorrected p99 %.1f p99.9 %.1f)",
+      result.latency.p50_ns / 1e3, result.latency.p99_ns / 1e3, result.latency.p999_ns / 1e3, result.latency.max_ns / 1e3,
+      result.uncorrected_latency.p99_ns / 1e3, result.uncorrected_latency.p999_ns / 1e3);
+  }
+  printf("\n");
+}
+
+void WriteLatency(FILE* file, const char* name, const net::LatencySummary& summary) {
+  fprintf(file, ", \"%s\": {\"count\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+    name, summary.count, summary.p50_ns, summary.p90_ns, summary.p99_ns, summary.p999_ns, summary.max_ns);
+}
+
+bool WriteJson(const char* path, const std::vector<CaseResult>& results) {
+  auto file = fopen(path, "w");
+  if (file == nullptr) {
+    printf("open %s failed.\n", path);
+    return false;
+  }
+  auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  fprintf(file, "{\"suite\": \"net_bench\", \"version\": 1, \"timestamp\": %lld, \"results\": [", static_cast<long long>(timestamp));
+  for (size_t i = 0; i < results.size(); ++i) {
+    auto& result = results[i];
+    fprintf(file, "%s\n  {\"name\": \"%s\", \"params\": {", i == 0 ? "" : ",", result.name.c_str());
+    for (size_t j = 0; j < result.params.size(); ++j) {
+      fprintf(file, "%s\"%s\": %.17g", j == 0 ? "" : ", ", result.params[j].first.c_str(), result.params[j].second);
+    }
+    fprintf(file, "}, \"metrics\": {");
+    for (size_t j = 0; j < result.metrics.size(); ++j) {
+      fprintf(file, "%s\"%s\": %.17g", j == 0 ? "" : ", ", result.metrics[j].first.c_str(), result.metrics[j].second);
+    }
+    fprintf(file, "}");
+    if (result.has_latency) {
+      WriteLatency(file, "latency_ns", result.latency);
+      WriteLatency(file, "uncorrected_latency_ns", result.uncorrected_latency);
+    }
+    fprintf(file, "}");
+  }
+  fprintf(file, "\n]}\n");
+  fclose(file);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  auto seconds = argc > 1 ? atoi(argv[1]) : 5;
+  auto json_path = argc > 2 ? argv[2] : "net_bench.json";
+  auto port = argc > 3 ? atoi(argv[3]) : 27050;
+  auto idle_connections = argc > 4 ? atoi(argv[4]) : 100000;
+  net::NetConfig config;
+  config.inproc_transport = argc > 5 && strcmp(argv[5], "inproc") == 0;
+  if (seconds <= 0 || idle_connections < 0) {
+    printf("invalid arguments.\n");
+    return 1;
+  }
+  if (!net::NetInterface::StartupNet(config)) {
+    printf("startup net failed.\n");
+    return 1;
+  }
+  struct EchoCase {
+    int message_size;
+    int rate;
+  };
+  const EchoCase echo_cases[] = {{kEchoStampSize * 4, 50000}, {1024, 50000}, {16 * net::kOneKibibyte, 10000}, {net::kOneMebibyte / 4, 1000}};
+  std::vector<CaseResult> results;
+  CaseResult result;
+  for (auto& i : echo_cases) {
+    if (RunTcpEcho("tcp_echo", seconds, port++, i.message_size, 1, i.rate, result)) {
+      results.push_back(result);
+      PrintResult(result);
+    }
+  }
+  if (RunTcpEcho("tcp_fan_in", seconds, port++, 256, 1000, 100000, result)) {
+    results.push_back(result);
+    PrintResult(result);
+  }
+  if (RunTcpChurn(seconds, port++, result)) {
+    results.push_back(result);
+    PrintResult(result);
+  }
+  if (RunUdpPps(seconds, port++, result)) {
+    results.push_back(result);
+    PrintResult(result);
+  }
+  if (idle_connections > 0 && RunIdleMemory(port, idle_connections, result)) {
+    results.push_back(result);
+    PrintResult(result);
+  }
+  net::NetInterface::CleanupNet();
+  return WriteJson(json_path, results) ? 0 : 1;
+}
@@ -0,0 +1,59 @@
+/************************************************************************/
+/*  NET_LOG text argument check                                         */
+/*  writes records whose string arguments overflow the record text     */
+/*  through a capturing sink and checks every argument is cut at the   */
+/*  text size, the ones past it print empty and later numbers survive  */
+/*  USAGE: net_log_bench                                                */
+/************************************************************************/
+
+#include "net_log.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+// the text keeps kNetLogTextSize bytes including one terminator per argument
+std::string Cut(const std::vector<std::string>& texts, const char* separator) {
+  std::string line;
+  auto left = net::kNetLogTextSize;
+  for (size_t i = 0; i < texts.size(); ++i) {
+    auto size = std::max(std::min(static_cast<int>(texts[i].size()), left - 1), 0);
+    line += (i > 0 ? separator : "") + texts[i].substr(0, size);
+    left = std::max(left - size - 1, 0);
+  }
+  return line;
+}
+
+bool Check(const char* name, const std::string& line, const std::string& expected) {
+  printf("%-8s %s\n", name, line.c_str());
+  if (line != expected) {
+    printf("%-8s failed: expected %s.\n", name, expected.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  std::string line;
+  net::NetLogger logger;
+  logger.SetSink([&line](int level, const char* text) { line = text; });
+  std::vector<std::string> texts;
+  for (auto i = 0; i < net::kNetLogArgs - 1; ++i) {
+    texts.push_back(std::string(60 + i * 7, static_cast<char>('a' + i)));
+  }
+  // the logger is not started, so every record is formatted by the writer
+  net::NetLogSite long_site;
+  logger.Write(long_site, kError, "%s|%s|%s|%s|%s|%s|%s|%d", texts[0], texts[1].c_str(), texts[2], texts[3].c_str(),
+    texts[4], texts[5].c_str(), texts[6], 42);
+  auto ok = Check("long", line, Cut(texts, "|") + "|42");
+  // the first argument ends one byte before the end, the second gets the last byte
+  std::vector<std::string> edge = {std::string(net::kNetLogTextSize - 2, 'x'), "yyyy", "zz"};
+  net::NetLogSite edge_site;
+  logger.Write(edge_site, kError, "%s/%s/%s/%u", edge[0], edge[1], edge[2], 7u);
+  ok = Check("edge", line, Cut(edge, "/") + "/7") && ok;
+  return ok ? 0 : 1;
+}
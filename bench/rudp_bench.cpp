@@ -0,0 +1,320 @@
+/************************************************************************/
+/*  Reliable UDP versus TCP latency benchmark                           */
+/*  echo fixed size messages through a local impairment proxy that      */
+/*  delays and drops traffic, and report the echo latency percentiles.  */
+/*  the udp proxy drops datagrams; the tcp proxy cannot drop stream     */
+/*  bytes, so a loss holds the chunk and everything behind it for one   */
+/*  retransmission timeout, the head of line blocking tcp would see     */
+/*  USAGE: rudp_bench [seconds] [loss %] [delay ms] [msgs/s] [port]     */
+/************************************************************************/
+
+#include "bench_util.h"
+#include "net_interface.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const int kMessageSize = 256;
+const int kTcpLossStallMs = 200;
+
+using bench::EchoServer;
+using bench::NowNs;
+
+// runs delayed deliveries on one thread, drop decisions are taken by the caller
+class Impairment {
+ public:
+  Impairment(double loss, int delay_ms) : loss_(loss), delay_ms_(delay_ms), stop_(false), random_(12345) {
+    thread_ = std::thread([this]() { Run(); });
+  }
+  ~Impairment() {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      stop_ = true;
+    }
+    cond_.notify_one();
+    thread_.join();
+  }
+  bool Drop() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return std::uniform_real_distribution<double>(0, 1)(random_) < loss_;
+  }
+  void Deliver(int extra_ms, std::function<void ()>&& task) {
+    Schedule(Clock::now() + std::chrono::milliseconds(delay_ms_ + extra_ms), std::move(task));
+  }
+  // a stream keeps its order: nothing is delivered before what was scheduled earlier
+  void DeliverInOrder(unsigned long stream, int extra_ms, std::function<void ()>&& task) {
+    auto deliver_time = Clock::now() + std::chrono::milliseconds(delay_ms_ + extra_ms);
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      auto& last_time = stream_times_[stream];
+      deliver_time = std::max(deliver_time, last_time);
+      last_time = deliver_time;
+    }
+    Schedule(deliver_time, std::move(task));
+  }
+
+ private:
+  void Schedule(Clock::time_point deliver_time, std::function<void ()>&& task) {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      tasks_.emplace(deliver_time, std::move(task));
+    }
+    cond_.notify_one();
+  }
+  void Run() {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (!stop_) {
+      if (tasks_.empty()) {
+        cond_.wait(lock);
+        continue;
+      }
+      auto first = tasks_.begin();
+      if (first->first > Clock::now()) {
+        cond_.wait_until(lock, first->first);
+        continue;
+      }
+      auto task = std::move(first->second);
+      tasks_.erase(first);
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+  }
+
+ private:
+  double loss_;
+  int delay_ms_;
+  bool stop_;
+  std::mt19937 random_;
+  std::multimap<Clock::time_point, std::function<void ()>> tasks_;
+  std::unordered_map<unsigned long, Clock::time_point> stream_times_;
+  std::mutex lock_;
+  std::condition_variable cond_;
+  std::thread thread_;
+};
+
+class BenchNet : public net::NetInterface {
+ public:
+  bool OnTcpDisconnected(net::TcpHandle handle) override { return true; }
+  bool OnTcpAccepted(net::TcpHandle handle, net::TcpHandle accept_handle) override { return true; }
+  bool OnTcpReceived(net::TcpHandle handle, const char* packet, int size) override { return true; }
+  bool OnTcpError(net::TcpHandle handle, int error) override { return true; }
+  bool OnUdpReceived(net::UdpHandle handle, const char* packet, int size, std::string ip, int port) override { return true; }
+  bool OnUdpError(net::UdpHandle handle, int error) override { return true; }
+};
+
+// forwards between the first client and the server on both transports through the impairment
+class ImpairedProxy : public BenchNet {
+ public:
+  ImpairedProxy(Impairment& impairment, const net::NetEndpoint& udp_server, int tcp_server_port)
+    : impairment_(impairment), udp_server_(udp_server), tcp_server_port_(tcp_server_port) {}
+
+  bool OnUdpReceivedFrom(net::UdpHandle handle, const char* packet, int size, const net::NetEndpoint& from) override {
+    if (impairment_.Drop()) {
+      return true;
+    }
+    net::NetEndpoint to;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      if (from != udp_server_) {
+        udp_client_ = from;
+      }
+      to = from == udp_server_ ? udp_client_ : udp_server_;
+    }
+    auto copy = std::make_shared<std::vector<char>>(packet, packet + size);
+    auto self = std::static_pointer_cast<ImpairedProxy>(shared_from_this());
+    impairment_.Deliver(0, [self, handle, copy, to]() {
+      std::unique_ptr<char[]> forward(new char[copy->size()]);
+      memcpy(forward.get(), copy->data(), copy->size());
+      self->UdpSendTo(handle, std::move(forward), static_cast<int>(copy->size()), to);
+    });
+    return true;
+  }
+  bool OnTcpAccepted(net::TcpHandle handle, net::TcpHandle accept_handle) override {
+    auto upstream = net::kInvalidTcpHandle;
+    if (!TcpCreate("127.0.0.1", 0, upstream) || !TcpConnect(upstream, "127.0.0.1", tcp_server_port_)) {
+      TcpDestroy(accept_handle);
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(lock_);
+    tcp_peers_[accept_handle] = upstream;
+    tcp_peers_[upstream] = accept_handle;
+    return true;
+  }
+  bool OnTcpReceived(net::TcpHandle handle, const char* packet, int size) override {
+    net::TcpHandle to = net::kInvalidTcpHandle;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      auto peer = tcp_peers_.find(handle);
+      if (peer == tcp_peers_.end()) {
+        return false;
+      }
+      to = peer->second;
+    }
+    auto copy = std::make_shared<std::vector<char>>(packet, packet + size);
+    auto self = std::static_pointer_cast<ImpairedProxy>(shared_from_this());
+    impairment_.DeliverInOrder(handle, impairment_.Drop() ? kTcpLossStallMs : 0, [self, to, copy]() {
+      std::unique_ptr<char[]> forward(new char[copy->size()]);
+      memcpy(forward.get(), copy->data(), copy->size());
+      self->TcpSend(to, std::move(forward), static_cast<int>(copy->size()));
+    });
+    return true;
+  }
+
+ private:
+  Impairment& impairment_;
+  net::NetEndpoint udp_server_;
+  net::NetEndpoint udp_client_;
+  int tcp_server_port_;
+  std::unordered_map<net::TcpHandle, net::TcpHandle> tcp_peers_;
+  std::mutex lock_;
+};
+
+// every message starts with its send time, the echo gives the round trip latency
+class LatencyClient : public BenchNet {
+ public:
+  bool OnRudpReceived(net::RudpHandle handle, const char* packet, int size) override {
+    Record(packet);
+    return true;
+  }
+  bool OnTcpReceived(net::TcpHandle handle, const char* packet, int size) override {
+    std::lock_guard<std::mutex> lock(lock_);
+    stream_.insert(stream_.end(), packet, packet + size);
+    size_t offset = 0;
+    for (; stream_.size() - offset >= kMessageSize; offset += kMessageSize) {
+      RecordLocked(stream_.data() + offset);
+    }
+    stream_.erase(stream_.begin(), stream_.begin() + offset);
+    return true;
+  }
+  bool OnRudpError(net::RudpHandle handle, int error) override { ++errors_; return true; }
+  static std::unique_ptr<char[]> NewMessage() {
+    std::unique_ptr<char[]> message(new char[kMessageSize]);
+    memset(message.get(), 0, kMessageSize);
+    auto send_ns = NowNs();
+    memcpy(message.get(), &send_ns, sizeof(send_ns));
+    return message;
+  }
+  void Report(const char* transport, unsigned long long sent) {
+    std::lock_guard<std::mutex> lock(lock_);
+    std::sort(latencies_.begin(), latencies_.end());
+    auto percentile = [this](double p) {
+      return latencies_.empty() ? 0.0 : latencies_[std::min(latencies_.size() - 1, static_cast<size_t>(p * latencies_.size()))] / 1e6;
+    };
+    printf("%s: sent %llu, echoed %zu, errors %llu, latency ms p50 %.2f p99 %.2f p99.9 %.2f max %.2f\n",
+      transport, sent, latencies_.size(), errors_.load(), percentile(0.5), percentile(0.99), percentile(0.999),
+      latencies_.empty() ? 0.0 : latencies_.back() / 1e6);
+  }
+
+ private:
+  void Record(const char* packet) {
+    std::lock_guard<std::mutex> lock(lock_);
+    RecordLocked(packet);
+  }
+  void RecordLocked(const char* packet) {
+    long long send_ns = 0;
+    memcpy(&send_ns, packet, sizeof(send_ns));
+    latencies_.push_back(NowNs() - send_ns);
+  }
+
+ private:
+  std::vector<long long> latencies_;
+  std::vector<char> stream_;
+  std::atomic<unsigned long long> errors_{0};
+  std::mutex lock_;
+};
+
+template <typename SendProc>
+unsigned long long Pump(int seconds, int rate, SendProc send) {
+  unsigned long long sent = 0;
+  auto begin_time = Clock::now();
+  auto end_time = begin_time + std::chrono::seconds(seconds);
+  auto interval = std::chrono::nanoseconds(1000000000LL / rate);
+  for (auto next = begin_time; next < end_time; next += interval) {
+    std::this_thread::sleep_until(next);
+    if (send()) {
+      ++sent;
+    }
+  }
+  return sent;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  auto seconds = argc > 1 ? atoi(argv[1]) : 10;
+  auto loss = argc > 2 ? atof(argv[2]) / 100 : 0.02;
+  auto delay_ms = argc > 3 ? atoi(argv[3]) : 20;
+  auto rate = argc > 4 ? atoi(argv[4]) : 500;
+  auto port = argc > 5 ? atoi(argv[5]) : 27040;
+  if (seconds <= 0 || rate <= 0) {
+    printf("invalid arguments.\n");
+    return 1;
+  }
+  if (!net::NetInterface::StartupNet()) {
+    printf("startup net failed.\n");
+    return 1;
+  }
+  {
+    Impairment impairment(loss, delay_ms);
+    auto server = std::make_shared<EchoServer>();
+    auto proxy = std::make_shared<ImpairedProxy>(impairment, net::NetEndpoint("127.0.0.1", port), port + 2);
+    auto rudp_client = std::make_shared<LatencyClient>();
+    auto tcp_client = std::make_shared<LatencyClient>();
+    auto server_udp = net::kInvalidUdpHandle;
+    auto proxy_udp = net::kInvalidUdpHandle;
+    auto client_udp = net::kInvalidUdpHandle;
+    auto server_tcp = net::kInvalidTcpHandle;
+    auto proxy_tcp = net::kInvalidTcpHandle;
+    auto client_tcp = net::kInvalidTcpHandle;
+    auto rudp = net::kInvalidRudpHandle;
+    net::RudpConfig rudp_config;
+    if (!server->UdpCreate("127.0.0.1", port, server_udp) || !server->RudpListen(server_udp, rudp_config) ||
+      !proxy->UdpCreate("127.0.0.1", port + 1, proxy_udp) || !rudp_client->UdpCreate("127.0.0.1", 0, client_udp) ||
+      !rudp_client->RudpCreate(client_udp, net::NetEndpoint("127.0.0.1", port + 1), 1, rudp_config, rudp)) {
+      printf("setup rudp failed.\n");
+      return 1;
+    }
+    if (!server->TcpCreate("127.0.0.1", port + 2, server_tcp) || !server->TcpListen(server_tcp) ||
+      !proxy->TcpCreate("127.0.0.1", port + 3, proxy_tcp) || !proxy->TcpListen(proxy_tcp) ||
+      !tcp_client->TcpCreate("127.0.0.1", 0, client_tcp) || !tcp_client->TcpConnect(client_tcp, "127.0.0.1", port + 3)) {
+      printf("setup tcp failed.\n");
+      return 1;
+    }
+    printf("loss %.1f%%, one way delay %d ms, %d msgs/s of %d bytes for %d s\n", loss * 100, delay_ms, rate, kMessageSize, seconds);
+    auto rudp_sent = Pump(seconds, rate, [&]() { return rudp_client->RudpSend(rudp, LatencyClient::NewMessage(), kMessageSize); });
+    auto tcp_sent = Pump(seconds, rate, [&]() { return tcp_client->TcpSend(client_tcp, LatencyClient::NewMessage(), kMessageSize); });
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    rudp_client->Report("rudp", rudp_sent);
+    tcp_client->Report("tcp", tcp_sent);
+    net::RudpStats stats;
+    if (rudp_client->RudpGetStats(rudp, stats)) {
+      printf("rudp: srtt %d ms, rto %d ms, cwnd %d, retransmits %llu, fast retransmits %llu\n",
+        stats.srtt_ms, stats.rto_ms, stats.congestion_window, stats.retransmits, stats.fast_retransmits);
+    }
+    rudp_client->RudpDestroy(rudp);
+    tcp_client->TcpDestroy(client_tcp);
+    proxy->TcpDestroy(proxy_tcp);
+    server->TcpDestroy(server_tcp);
+    rudp_client->UdpDestroy(client_udp);
+    proxy->UdpDestroy(proxy_udp);
+    server->UdpDestroy(server_udp);
+  }
+  net::NetInterface::CleanupNet();
+  return 0;
+}
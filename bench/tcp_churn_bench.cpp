@@ -0,0 +1,107 @@
+/************************************************************************/
+/*  TCP connection churn benchmark                                      */
+/*  connect, send one packet and close as fast as possible over         */
+/*  loopback, once without and once with accept socket recycling        */
+/*  USAGE: tcp_churn_bench [seconds] [client threads] [port]           */
+/************************************************************************/
+
+#include "net_interface.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int kChurnPacketSize = 64;
+
+class ChurnNet : public net::NetInterface {
+ public:
+  bool OnTcpDisconnected(net::TcpHandle handle) override { ++disconnected_; return true; }
+  bool OnTcpAccepted(net::TcpHandle handle, net::TcpHandle accept_handle) override { ++accepted_; return true; }
+  bool OnTcpReceived(net::TcpHandle handle, const char* packet, int size) override { ++received_; return true; }
+  bool OnTcpError(net::TcpHandle handle, int error) override { ++errors_; return true; }
+  bool OnUdpReceived(net::UdpHandle handle, const char* packet, int size, std::string ip, int port) override { return true; }
+  bool OnUdpError(net::UdpHandle handle, int error) override { return true; }
+
+  std::atomic<unsigned long long> accepted_{0};
+  std::atomic<unsigned long long> received_{0};
+  std::atomic<unsigned long long> disconnected_{0};
+  std::atomic<unsigned long long> errors_{0};
+};
+
+bool RunChurn(bool recycle_sockets, int seconds, int thread_num, int port) {
+  auto server = std::make_shared<ChurnNet>();
+  auto listen_handle = net::kInvalidTcpHandle;
+  if (!server->TcpCreate("127.0.0.1", port, listen_handle)) {
+    printf("create listen handle failed.\n");
+    return false;
+  }
+  net::TcpListenConfig listen_config;
+  listen_config.recycle_sockets = recycle_sockets;
+  if (!server->TcpListen(listen_handle, listen_config)) {
+    printf("listen failed.\n");
+    return false;
+  }
+  net::TcpSocketPoolStats begin_stats;
+  net::NetInterface::TcpGetSocketPoolStats(begin_stats);
+  std::atomic<bool> stop(false);
+  std::atomic<unsigned long long> cycles(0);
+  std::atomic<unsigned long long> failures(0);
+  auto client_proc = [&]() {
+    auto client = std::make_shared<ChurnNet>();
+    while (!stop) {
+      auto handle = net::kInvalidTcpHandle;
+      if (!client->TcpCreate("127.0.0.1", 0, handle)) {
+        ++failures;
+        continue;
+      }
+      std::unique_ptr<char[]> packet(new char[kChurnPacketSize]);
+      memset(packet.get(), 0, kChurnPacketSize);
+      if (client->TcpConnect(handle, "127.0.0.1", port) && client->TcpSend(handle, std::move(packet), kChurnPacketSize)) {
+        ++cycles;
+      } else {
+        ++failures;
+      }
+      client->TcpDestroy(handle);
+    }
+  };
+  auto begin_time = std::chrono::steady_clock::now();
+  std::vector<std::thread> clients;
+  for (auto i = 0; i < thread_num; ++i) {
+    clients.emplace_back(client_proc);
+  }
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  stop = true;
+  for (auto& i : clients) {
+    i.join();
+  }
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_time).count();
+  server->TcpDestroy(listen_handle);
+  net::TcpSocketPoolStats end_stats;
+  net::NetInterface::TcpGetSocketPoolStats(end_stats);
+  printf("recycle: %s, cycles/s: %.0f, accepted: %llu, received: %llu, failures: %llu, "
+    "sockets created: %llu, sockets reused: %llu, idle: %d\n",
+    recycle_sockets ? "on" : "off", cycles / elapsed, server->accepted_.load(), server->received_.load(), failures.load(),
+    end_stats.created - begin_stats.created, end_stats.reused - begin_stats.reused, end_stats.idle);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  auto seconds = argc > 1 ? atoi(argv[1]) : 10;
+  auto thread_num = argc > 2 ? atoi(argv[2]) : 4;
+  auto port = argc > 3 ? atoi(argv[3]) : 27015;
+  if (!net::NetInterface::StartupNet()) {
+    printf("startup net failed.\n");
+    return 1;
+  }
+  RunChurn(false, seconds, thread_num, port);
+  RunChurn(true, seconds, thread_num, port + 1);
+  net::NetInterface::CleanupNet();
+  return 0;
+}
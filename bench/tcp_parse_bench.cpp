@@ -0,0 +1,93 @@
+/************************************************************************/
+/*  TCP framing parser microbenchmark                                   */
+/*  feeds synthetic streams through TcpSocket::OnRecv without any      */
+/*  socket: many tiny frames per read, frames split at every byte      */
+/*  boundary, and 16 MiB frames arriving in 64 KiB reads               */
+/*  USAGE: tcp_parse_bench [seconds per case]                          */
+/************************************************************************/
+
+#include "tcp_head.h"
+#include "tcp_socket.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const int kReadSize = 64 * 1024;
+
+void AppendFrame(std::vector<char>& stream, int size) {
+  net::TcpHead head;
+  head.Init(size);
+  auto offset = stream.size();
+  stream.resize(offset + net::kTcpHeadSize + size);
+  memcpy(&stream[offset], &head, net::kTcpHeadSize);
+  for (auto i = 0; i < size; ++i) {
+    stream[offset + net::kTcpHeadSize + i] = static_cast<char>(i);
+  }
+}
+
+// replays the stream in read_size pieces until seconds passed, the packets are taken out
+// after every read the way NetResMgr::OnTcpRecv does
+bool RunCase(const char* name, const std::vector<char>& stream, int frames, int read_size, int seconds) {
+  net::TcpSocket socket;
+  unsigned long long packets = 0;
+  unsigned long long bytes = 0;
+  unsigned long long checksum = 0;
+  auto begin_time = Clock::now();
+  auto end_time = begin_time + std::chrono::seconds(seconds);
+  while (Clock::now() < end_time) {
+    for (size_t offset = 0; offset < stream.size(); offset += read_size) {
+      auto size = stream.size() - offset < static_cast<size_t>(read_size) ? static_cast<int>(stream.size() - offset) : read_size;
+      if (!socket.OnRecv(&stream[offset], size)) {
+        printf("%s: parse failed.\n", name);
+        return false;
+      }
+      for (const auto& i : socket.all_packets()) {
+        checksum += static_cast<unsigned char>(i->packet()[i->size() - 1]);
+        ++packets;
+      }
+    }
+    bytes += stream.size();
+  }
+  auto elapsed = std::chrono::duration<double>(Clock::now() - begin_time).count();
+  if (packets % frames != 0) {
+    printf("%s: parsed %llu packets, not a multiple of %d.\n", name, packets, frames);
+    return false;
+  }
+  printf("%-14s read %6d B, MiB/s: %9.1f, frames/s: %12.0f, ns/frame: %10.1f, checksum: %llu\n",
+    name, read_size, bytes / elapsed / (1024 * 1024), packets / elapsed, elapsed * 1e9 / packets, checksum);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  auto seconds = argc > 1 ? atoi(argv[1]) : 3;
+  if (seconds <= 0) {
+    printf("invalid arguments.\n");
+    return 1;
+  }
+  std::vector<char> tiny_stream;
+  auto tiny_frames = 0;
+  while (tiny_stream.size() + net::kTcpHeadSize + 16 <= static_cast<size_t>(kReadSize) * 16) {
+    AppendFrame(tiny_stream, 16);
+    ++tiny_frames;
+  }
+  std::vector<char> split_stream;
+  auto split_frames = 0;
+  for (; split_frames < 1024; ++split_frames) {
+    AppendFrame(split_stream, 1 + split_frames % 200);
+  }
+  std::vector<char> large_stream;
+  AppendFrame(large_stream, static_cast<int>(net::kMaxTcpSendPacketSize));
+  auto ok = RunCase("tiny_frames", tiny_stream, tiny_frames, kReadSize, seconds);
+  ok = RunCase("byte_split", split_stream, split_frames, 1, seconds) && ok;
+  ok = RunCase("odd_split", split_stream, split_frames, 7, seconds) && ok;
+  ok = RunCase("large_frames", large_stream, 1, kReadSize, seconds) && ok;
+  return ok ? 0 : 1;
+}
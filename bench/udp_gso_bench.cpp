@@ -0,0 +1,120 @@
+/************************************************************************/
+/*  UDP segmentation offload benchmark                                  */
+/*  blast fixed size datagrams over loopback, once one UdpSendTo per    */
+/*  datagram and once one UdpSendSegments per burst, with the receiver  */
+/*  coalescing when the stack supports it                               */
+/*  USAGE: udp_gso_bench [seconds] [datagram size] [burst] [port]       */
+/************************************************************************/
+
+#include "net_interface.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+class BlastNet : public net::NetInterface {
+ public:
+  bool OnTcpDisconnected(net::TcpHandle handle) override { return true; }
+  bool OnTcpAccepted(net::TcpHandle handle, net::TcpHandle accept_handle) override { return true; }
+  bool OnTcpReceived(net::TcpHandle handle, const char* packet, int size) override { return true; }
+  bool OnTcpError(net::TcpHandle handle, int error) override { return true; }
+  bool OnUdpReceived(net::UdpHandle handle, const char* packet, int size, std::string ip, int port) override {
+    return OnUdpReceivedFrom(handle, packet, size, net::NetEndpoint(ip, port));
+  }
+  bool OnUdpReceivedFrom(net::UdpHandle handle, const char* packet, int size, const net::NetEndpoint& from) override {
+    ++datagrams_;
+    bytes_ += size;
+    return true;
+  }
+  bool OnUdpError(net::UdpHandle handle, int error) override { ++errors_; return true; }
+
+  std::atomic<unsigned long long> datagrams_{0};
+  std::atomic<unsigned long long> bytes_{0};
+  std::atomic<unsigned long long> errors_{0};
+};
+
+bool RunBlast(bool segmented, int seconds, int datagram_size, int burst, int port) {
+  auto receiver = std::make_shared<BlastNet>();
+  auto recv_handle = net::kInvalidUdpHandle;
+  net::UdpConfig recv_config;
+  recv_config.recv_coalescing = segmented;
+  if (!receiver->UdpCreate("127.0.0.1", port, recv_config, recv_handle)) {
+    printf("create receiver failed.\n");
+    return false;
+  }
+  auto sender = std::make_shared<BlastNet>();
+  auto send_handle = net::kInvalidUdpHandle;
+  if (!sender->UdpCreate("127.0.0.1", 0, send_handle)) {
+    printf("create sender failed.\n");
+    receiver->UdpDestroy(recv_handle);
+    return false;
+  }
+  net::UdpOffloadInfo send_info;
+  net::UdpOffloadInfo recv_info;
+  sender->UdpGetOffloadInfo(send_handle, send_info);
+  receiver->UdpGetOffloadInfo(recv_handle, recv_info);
+  net::NetEndpoint to("127.0.0.1", port);
+  unsigned long long sent = 0;
+  unsigned long long failures = 0;
+  auto begin_time = std::chrono::steady_clock::now();
+  auto end_time = begin_time + std::chrono::seconds(seconds);
+  while (std::chrono::steady_clock::now() < end_time) {
+    if (segmented) {
+      auto size = datagram_size * burst;
+      std::unique_ptr<char[]> packet(new char[size]);
+      memset(packet.get(), 0, size);
+      if (sender->UdpSendSegments(send_handle, std::move(packet), size, datagram_size, to)) {
+        sent += burst;
+      } else {
+        ++failures;
+      }
+      continue;
+    }
+    for (auto i = 0; i < burst; ++i) {
+      std::unique_ptr<char[]> packet(new char[datagram_size]);
+      memset(packet.get(), 0, datagram_size);
+      if (sender->UdpSendTo(send_handle, std::move(packet), datagram_size, to)) {
+        ++sent;
+      } else {
+        ++failures;
+      }
+    }
+  }
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_time).count();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  sender->UdpDestroy(send_handle);
+  receiver->UdpDestroy(recv_handle);
+  auto received = receiver->datagrams_.load();
+  printf("mode: %s, send offload: %s, recv coalescing: %s, sent/s: %.0f, received/s: %.0f, "
+    "received MB/s: %.1f, loss: %.2f%%, failures: %llu\n",
+    segmented ? "segments" : "sendto", send_info.send_segmentation ? "on" : "off", recv_info.recv_coalescing ? "on" : "off",
+    sent / elapsed, received / elapsed, receiver->bytes_.load() / elapsed / (1024 * 1024),
+    sent == 0 ? 0.0 : 100.0 * (sent - (received < sent ? received : sent)) / sent, failures);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  auto seconds = argc > 1 ? atoi(argv[1]) : 10;
+  auto datagram_size = argc > 2 ? atoi(argv[2]) : 1200;
+  auto burst = argc > 3 ? atoi(argv[3]) : 32;
+  auto port = argc > 4 ? atoi(argv[4]) : 27030;
+  if (datagram_size <= 0 || datagram_size > net::kMaxUdpPacketSize || burst <= 0 ||
+    datagram_size * burst > net::kMaxUdpSegmentedSize) {
+    printf("datagram size * burst must not exceed %d.\n", net::kMaxUdpSegmentedSize);
+    return 1;
+  }
+  if (!net::NetInterface::StartupNet()) {
+    printf("startup net failed.\n");
+    return 1;
+  }
+  RunBlast(false, seconds, datagram_size, burst, port);
+  RunBlast(true, seconds, datagram_size, burst, port + 1);
+  net::NetInterface::CleanupNet();
+  return 0;
+}
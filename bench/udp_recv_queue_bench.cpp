@@ -0,0 +1,96 @@
+/************************************************************************/
+/*  UDP receive queue adaptation check                                  */
+/*  drives UdpRecvQueue the way NetResMgr::OnUdpRecvs does, one call    */
+/*  per handle and dequeued batch, and checks the outstanding receive   */
+/*  target grows under bursts, stays put under a trickle and shrinks    */
+/*  after the bursts stop                                               */
+/*  USAGE: udp_recv_queue_bench [min recvs] [max recvs] [rounds]        */
+/************************************************************************/
+
+#include "udp_recv_queue.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// longer than the burst window of UdpRecvQueue
+const int kIdleMs = 1100;
+
+// every round completes burst_percent of the outstanding receives in one dequeued batch
+bool RunCase(const char* name, const net::UdpConfig& config, int burst_percent, int rounds, bool expect_growth) {
+  net::UdpRecvQueue queue(config);
+  auto pending = queue.Start();
+  auto begin = Clock::now();
+  for (auto i = 0; i < rounds; ++i) {
+    auto completed = pending * burst_percent / 100;
+    if (completed <= 0) {
+      completed = 1;
+    }
+    pending += queue.OnRecvCompleted(completed) - completed;
+  }
+  auto elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+  net::UdpRecvStats stats;
+  queue.GetStats(stats);
+  auto grew = stats.target_recvs > config.min_recvs;
+  printf("%-8s burst %3d%%: target %d of %d..%d, starvations %llu, %.1f ns per batch\n", name, burst_percent,
+    stats.target_recvs, stats.min_recvs, stats.max_recvs, stats.recv_starvations, static_cast<double>(elapsed_ns) / rounds);
+  if (grew != expect_growth || stats.pending_recvs != pending) {
+    printf("%-8s failed: target %s.\n", name, grew ? "grew" : "did not grow");
+    return false;
+  }
+  return true;
+}
+
+// bursts grow the target to max, then two idle windows with one receive each halve it and the
+// completions that follow post nothing until the outstanding receives drained down to it
+bool RunShrink(const net::UdpConfig& config, int rounds) {
+  net::UdpRecvQueue queue(config);
+  auto pending = queue.Start();
+  for (auto i = 0; i < rounds; ++i) {
+    pending += queue.OnRecvCompleted(pending) - pending;
+  }
+  auto grown = pending;
+  for (auto i = 0; i < 2; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kIdleMs));
+    pending += queue.OnRecvCompleted(1) - 1;
+  }
+  net::UdpRecvStats stats;
+  queue.GetStats(stats);
+  auto drained = true;
+  while (pending > stats.target_recvs) {
+    auto posted = queue.OnRecvCompleted(1);
+    drained = drained && posted == 0;
+    pending += posted - 1;
+  }
+  queue.GetStats(stats);
+  printf("%-8s idle: target %d of %d..%d, pending %d after %d.\n", "shrink", stats.target_recvs, stats.min_recvs,
+    stats.max_recvs, stats.pending_recvs, grown);
+  if (stats.target_recvs != std::max(config.max_recvs / 2, config.min_recvs) || !drained ||
+    stats.pending_recvs != stats.target_recvs || stats.pending_recvs >= grown) {
+    printf("%-8s failed: posted depth did not shrink.\n", "shrink");
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  net::UdpConfig config;
+  config.min_recvs = argc > 1 ? atoi(argv[1]) : 4;
+  config.max_recvs = argc > 2 ? atoi(argv[2]) : 64;
+  auto rounds = argc > 3 ? atoi(argv[3]) : 1000;
+  if (config.min_recvs <= 0 || config.max_recvs <= config.min_recvs || rounds <= 0) {
+    printf("invalid arguments.\n");
+    return 1;
+  }
+  auto ok = RunCase("burst", config, 100, rounds, true);
+  ok = RunCase("trickle", config, 0, rounds, false) && ok;
+  ok = RunShrink(config, rounds) && ok;
+  return ok ? 0 : 1;
+}
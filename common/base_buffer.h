@@ -11,21 +11,27 @@ const int kAsyncTypeTcpSend = 2;
 const int kAsyncTypeTcpRecv = 3;
 const int kAsyncTypeUdpSend = 4;
 const int kAsyncTypeUdpRecv = 5;
+const int kAsyncTypeTcpConnect = 6;
+const int kAsyncTypeTask = 7;
+const int kAsyncTypeTcpDisconnect = 8;
 
 class BaseBuffer : public utility::Uncopyable {
  public:
-   BaseBuffer() : async_type_(0), buffer_size_(0), handle_(0) {
+   BaseBuffer() : async_type_(0), buffer_size_(0), handle_(0), post_time_(0) {
     memset(&ovlp_, 0, sizeof(ovlp_));
   }
   void ResetBuffer(){
     memset(&ovlp_, 0, sizeof(ovlp_));
     handle_ = 0;
+    post_time_ = 0;
   }
   LPOVERLAPPED ovlp() { return &ovlp_; }
   int async_type() const { return async_type_; }
   int buffer_size() const { return buffer_size_; }
   unsigned long handle() const { return handle_; }
   void set_handle(unsigned long handle) { handle_ = handle; }
+  unsigned long long post_time() const { return post_time_; }
+  void set_post_time(unsigned long long post_time) { post_time_ = post_time; }
   
  protected:
   void set_async_type(int async_type) { async_type_ = async_type; }
@@ -36,6 +42,7 @@ class BaseBuffer : public utility::Uncopyable {
   int async_type_;
   int buffer_size_;
   unsigned long handle_;
+  unsigned long long post_time_;
 };
 
 } // namespace net
@@ -1,43 +1,102 @@
 #include "iocp.h"
-#include "log.h"
+#include "net_log.h"
 #include "utility.h"
+#include <algorithm>
 
 namespace net {
 
+const int kMaxAffinityProcessors = sizeof(KAFFINITY) * 8;
+
+namespace {
+
+bool ProcessorGroupNumber(int processor, WORD& group, int& number) {
+  auto group_count = GetActiveProcessorGroupCount();
+  for (WORD i = 0; i < group_count; ++i) {
+    auto group_size = static_cast<int>(GetActiveProcessorCount(i));
+    if (processor < group_size) {
+      group = i;
+      number = processor;
+      return true;
+    }
+    processor -= group_size;
+  }
+  return false;
+}
+
+} // namespace
+
 IOCP::IOCP() {
   init_ = false;
-  iocp_ = NULL;
+  next_shard_ = 0;
 }
 
 IOCP::~IOCP() {
   Uninit();
 }
 
-bool IOCP::Init(std::function<bool (LPOVERLAPPED, DWORD)>&& callback) {
+bool IOCP::Init(std::function<bool (LPOVERLAPPED_ENTRY, ULONG)>&& callback, int shard_num, const std::vector<int>& processors) {
   if (init_) {
     return true;
   }
-  if (callback == nullptr) {
-    LOG(kStartup, "initialize IOCP failed: invalid callback parameter.");
+  if (callback == nullptr || shard_num <= 0) {
+    NET_LOG(kStartup, "initialize IOCP failed: invalid parameter.");
     return false;
   }
   WSAData wsa_data = {0};
   if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
-    LOG(kStartup, "WSAStartup failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kStartup, "WSAStartup failed, error code: %d.", WSAGetLastError());
     return false;
   }
   callback_ = std::move(callback);
   init_ = true;
-  iocp_ = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, NULL, 0);
-  if (iocp_ == NULL) {
-    LOG(kStartup, "CreateIoCompletionPort failed, error code: %d.", WSAGetLastError());
-    Uninit();
-    return false;
+  for (auto i = 0; i < shard_num; ++i) {
+    auto iocp = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, NULL, 0);
+    if (iocp == NULL) {
+      NET_LOG(kStartup, "CreateIoCompletionPort failed, error code: %d.", WSAGetLastError());
+      Uninit();
+      return false;
+    }
+    iocp_.push_back(iocp);
+  }
+  auto cores = processors;
+  if (cores.empty()) {
+    for (auto i = 0; i < utility::GetProcessorNum(); ++i) {
+      cores.push_back(i);
+    }
+  }
+  auto core_num = static_cast<int>(cores.size());
+  processor_shards_.assign(*std::max_element(cores.begin(), cores.end()) + 1, -1);
+  for (auto i = 0; i < core_num; ++i) {
+    processor_shards_[cores[i]] = i % shard_num;
   }
-  auto thread_num = utility::GetProcessorNum() * 2;
-  auto thread_proc = std::bind(&IOCP::ThreadWorker, this);
+  auto thread_num = std::max(core_num * 2, shard_num);
   for (auto i = 0; i < thread_num; ++i) {
-    iocp_thread_.push_back(std::make_unique<std::thread>(thread_proc));
+    auto shard = i % shard_num;
+    iocp_thread_.push_back(std::make_unique<std::thread>(std::bind(&IOCP::ThreadWorker, this, iocp_[shard])));
+    if (shard_num == 1 && processors.empty()) {
+      continue;
+    }
+    GROUP_AFFINITY affinity = {0};
+    auto group_set = false;
+    for (auto j = shard; j < core_num; j += shard_num) {
+      WORD group = 0;
+      auto number = 0;
+      if (!ProcessorGroupNumber(cores[j], group, number) || number >= kMaxAffinityProcessors) {
+        continue;
+      }
+      if (!group_set) {
+        affinity.Group = group;
+        group_set = true;
+      }
+      if (group != affinity.Group) {
+        NET_LOG(kStartup, "processor %d is not pinned to shard %d: another processor group.", cores[j], shard);
+        continue;
+      }
+      affinity.Mask |= (KAFFINITY)1 << number;
+    }
+    if (affinity.Mask != 0 && !SetThreadGroupAffinity((HANDLE)iocp_thread_.back()->native_handle(), &affinity, NULL)) {
+      NET_LOG(kStartup, "SetThreadGroupAffinity failed, error code: %d.", GetLastError());
+    }
   }
   return true;
 }
@@ -46,52 +105,105 @@ void IOCP::Uninit() {
   if (!init_) {
     return;
   }
-  for (const auto& i : iocp_thread_) {
-    PostQueuedCompletionStatus(iocp_, 0, NULL, NULL);
+  for (size_t i = 0; i < iocp_thread_.size(); ++i) {
+    PostQueuedCompletionStatus(iocp_[i % iocp_.size()], 0, NULL, NULL);
   }
   for (const auto& i : iocp_thread_) {
     i->join();
   }
   iocp_thread_.clear();
-  if (iocp_ != NULL) {
-    CloseHandle(iocp_);
-    iocp_ = NULL;
+  for (auto i : iocp_) {
+    CloseHandle(i);
   }
+  iocp_.clear();
   WSACleanup();
   callback_ = nullptr;
   init_ = false;
 }
 
+bool IOCP::IsWorkerThread() const {
+  auto current = std::this_thread::get_id();
+  return std::any_of(iocp_thread_.begin(), iocp_thread_.end(), [current](const std::unique_ptr<std::thread>& i) { return i->get_id() == current; });
+}
+
 bool IOCP::BindToIOCP(SOCKET socket) {
-  if (socket == INVALID_SOCKET) {
-    LOG(kError, "BindToIOCP failed: invalid socket parameter.");
+  return BindToIOCP(socket, NextShard());
+}
+
+int IOCP::ShardOfProcessor(int processor) const {
+  if (processor < 0 || processor >= static_cast<int>(processor_shards_.size())) {
+    return -1;
+  }
+  return processor_shards_[processor];
+}
+
+int IOCP::ProcessorIndex(int group, int number) {
+  auto processor = number;
+  for (WORD i = 0; i < group; ++i) {
+    processor += static_cast<int>(GetActiveProcessorCount(i));
+  }
+  return processor;
+}
+
+int IOCP::NextShard() {
+  return next_shard_++ % iocp_.size();
+}
+
+bool IOCP::BindToIOCP(SOCKET socket, int shard) {
+  if (socket == INVALID_SOCKET || shard < 0 || shard >= shard_num()) {
+    NET_LOG(kError, "BindToIOCP failed: invalid parameter.");
+    return false;
+  }
+  auto existing_iocp = CreateIoCompletionPort((HANDLE)socket, iocp_[shard], NULL, 0);
+  if (existing_iocp != iocp_[shard]) {
+    NET_LOG(kError, "BindToIOCP failed, error code: %d.", WSAGetLastError());
+    return false;
+  }
+  return true;
+}
+
+bool IOCP::PostCompletion(LPOVERLAPPED ovlp, DWORD transfer_size) {
+  return PostCompletion(ovlp, transfer_size, NextShard());
+}
+
+bool IOCP::PostCompletion(LPOVERLAPPED ovlp, DWORD transfer_size, int shard) {
+  if (ovlp == NULL || shard < 0 || shard >= shard_num()) {
+    NET_LOG(kError, "PostCompletion failed: invalid parameter.");
     return false;
   }
-  auto existing_iocp = CreateIoCompletionPort((HANDLE)socket, iocp_, NULL, 0);
-  if (existing_iocp != iocp_) {
-    LOG(kError, "BindToIOCP failed, error code: %d.", WSAGetLastError());
+  if (!PostQueuedCompletionStatus(iocp_[shard], transfer_size, NULL, ovlp)) {
+    NET_LOG(kError, "PostQueuedCompletionStatus failed, error code: %d.", GetLastError());
     return false;
   }
   return true;
 }
 
-bool IOCP::ThreadWorker() {
+// exit packets carry no overlapped, the ones dequeued for other workers are posted back
+bool IOCP::ThreadWorker(HANDLE iocp) {
+  OVERLAPPED_ENTRY entries[kMaxDequeueEntries];
   while (true) {
-    DWORD transfer_size = 0;
-    ULONG completion_key = NULL;
-    LPOVERLAPPED ovlp = NULL;
-    if (!GetQueuedCompletionStatus(iocp_, &transfer_size, &completion_key, &ovlp, INFINITE)) {
-      auto error_code = WSAGetLastError();
-      if (error_code != ERROR_NETNAME_DELETED && error_code != ERROR_CONNECTION_ABORTED &&
-        error_code != ERROR_OPERATION_ABORTED) {
-        LOG(kError, "GetQueuedCompletionStatus failed, error code: %d.", error_code);
+    ULONG entry_count = 0;
+    if (!GetQueuedCompletionStatusEx(iocp, entries, kMaxDequeueEntries, &entry_count, INFINITE, FALSE)) {
+      NET_LOG(kError, "GetQueuedCompletionStatusEx failed, error code: %d.", GetLastError());
+      break;
+    }
+    ULONG completion_count = 0;
+    auto exit_count = 0;
+    for (ULONG i = 0; i < entry_count; ++i) {
+      if (entries[i].lpOverlapped == NULL) {
+        ++exit_count;
+      } else {
+        entries[completion_count++] = entries[i];
       }
     }
-    if (transfer_size == 0 && ovlp == NULL) {
-      break;
+    if (completion_count > 0 && callback_ != nullptr) {
+      callback_(entries, completion_count);
     }
-    if (callback_ != nullptr) {
-      callback_(ovlp, transfer_size);
+    if (exit_count > 0) {
+      for (auto i = 1; i < exit_count; ++i) {
+        PostQueuedCompletionStatus(iocp, 0, NULL, NULL);
+      }
+      break;
     }
   }
   return true;
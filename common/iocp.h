@@ -2,6 +2,7 @@
 #define NET_IOCP_H_
 
 #include "uncopyable.h"
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <thread>
@@ -10,24 +11,39 @@
 
 namespace net {
 
+const int kMaxDequeueEntries = 64;
+
+// shard_num completion ports, shard i runs on processors with index % shard_num == i
+// a shard is pinned to the processor group of its first processor
 class IOCP : public utility::Uncopyable {
  public:
   IOCP();
   ~IOCP();
-  bool Init(std::function<bool (LPOVERLAPPED, DWORD)>&& callback);
+  bool Init(std::function<bool (LPOVERLAPPED_ENTRY, ULONG)>&& callback, int shard_num, const std::vector<int>& processors);
   void Uninit();
+  bool IsWorkerThread() const;
   bool BindToIOCP(SOCKET socket);
+  bool BindToIOCP(SOCKET socket, int shard);
+  bool PostCompletion(LPOVERLAPPED ovlp, DWORD transfer_size);
+  bool PostCompletion(LPOVERLAPPED ovlp, DWORD transfer_size, int shard);
+  int NextShard();
+  int shard_num() const { return static_cast<int>(iocp_.size()); }
+  // return -1 for a processor no shard is pinned to
+  int ShardOfProcessor(int processor) const;
+  static int ProcessorIndex(int group, int number);
 
  private:
-  bool ThreadWorker();
+  bool ThreadWorker(HANDLE iocp);
 
  private:
   bool init_;
-  HANDLE iocp_;
-  std::function<bool (LPOVERLAPPED, DWORD)> callback_;
+  std::vector<HANDLE> iocp_;
+  std::atomic<unsigned int> next_shard_;
+  std::function<bool (LPOVERLAPPED_ENTRY, ULONG)> callback_;
   std::vector<std::unique_ptr<std::thread>> iocp_thread_;
+  std::vector<int> processor_shards_;
 };
 
 } // namespace net
 
-#endif	// NET_IOCP_H_
\ No newline at end of file
+#endif	// NET_IOCP_H_
@@ -0,0 +1,75 @@
+#include "latency_histogram.h"
+
+namespace net {
+
+LatencyHistogram::LatencyHistogram() {
+  Reset();
+}
+
+void LatencyHistogram::Record(unsigned long long value) {
+  buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  auto max = max_.load(std::memory_order_relaxed);
+  while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+  }
+}
+
+void LatencyHistogram::Reset() {
+  for (auto& i : buckets_) {
+    i.store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+// percentiles are the upper bound of the bucket they fall in, capped by the max
+void LatencyHistogram::GetSummary(LatencySummary& summary) {
+  unsigned long long counts[kLatencyBuckets];
+  unsigned long long total = 0;
+  for (auto i = 0; i < kLatencyBuckets; ++i) {
+    counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  summary = LatencySummary();
+  summary.count = total;
+  summary.max_ns = max_.load(std::memory_order_relaxed);
+  if (total == 0) {
+    return;
+  }
+  const double kPercentiles[] = {0.5, 0.9, 0.99, 0.999};
+  unsigned long long* results[] = {&summary.p50_ns, &summary.p90_ns, &summary.p99_ns, &summary.p999_ns};
+  unsigned long long seen = 0;
+  auto next = 0;
+  for (auto i = 0; i < kLatencyBuckets && next < 4; ++i) {
+    seen += counts[i];
+    while (next < 4 && seen >= kPercentiles[next] * total) {
+      auto value = BucketValue(i);
+      *results[next++] = value < summary.max_ns ? value : summary.max_ns;
+    }
+  }
+}
+
+int LatencyHistogram::BucketIndex(unsigned long long value) {
+  if (value < kLatencySubBuckets) {
+    return static_cast<int>(value);
+  }
+  auto bits = 0;
+  while ((value >> bits) >= kLatencySubBuckets * 2) {
+    ++bits;
+  }
+  if (bits > kLatencyMaxBits - kLatencySubBucketBits - 1) {
+    return kLatencyBuckets - 1;
+  }
+  return (bits + 1) * kLatencySubBuckets + static_cast<int>((value >> bits) - kLatencySubBuckets);
+}
+
+unsigned long long LatencyHistogram::BucketValue(int index) {
+  if (index < kLatencySubBuckets) {
+    return index;
+  }
+  auto bits = index / kLatencySubBuckets - 1;
+  auto sub = index % kLatencySubBuckets;
+  return ((static_cast<unsigned long long>(kLatencySubBuckets + sub) + 1) << bits) - 1;
+}
+
+} // namespace net
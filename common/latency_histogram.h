@@ -0,0 +1,37 @@
+#ifndef NET_LATENCY_HISTOGRAM_H_
+#define NET_LATENCY_HISTOGRAM_H_
+
+#include "net_interface.h"
+#include "uncopyable.h"
+#include <atomic>
+
+namespace net {
+
+const int kLatencySubBucketBits = 4;
+const int kLatencySubBuckets = 1 << kLatencySubBucketBits;
+const int kLatencyMaxBits = 44;
+const int kLatencyBuckets = (kLatencyMaxBits - kLatencySubBucketBits + 1) * kLatencySubBuckets;
+
+// hdr style histogram of nanoseconds: every power of two is split into 16 linear
+// sub buckets, so a reported percentile is within 1/16 of the recorded value
+class LatencyHistogram : public utility::Uncopyable {
+ public:
+  LatencyHistogram();
+
+  void Record(unsigned long long value);
+  void Reset();
+  void GetSummary(LatencySummary& summary);
+
+ private:
+  static int BucketIndex(unsigned long long value);
+  static unsigned long long BucketValue(int index);
+
+ private:
+  std::atomic<unsigned long long> buckets_[kLatencyBuckets];
+  std::atomic<unsigned long long> count_;
+  std::atomic<unsigned long long> max_;
+};
+
+} // namespace net
+
+#endif	// NET_LATENCY_HISTOGRAM_H_
@@ -0,0 +1,254 @@
+#include "net_capture.h"
+#include "net_latency.h"
+#include "net_log.h"
+#include <chrono>
+#include <thread>
+
+namespace net {
+
+namespace {
+
+unsigned long long AlignRecord(unsigned long long size) {
+  return (size + 7) & ~7ULL;
+}
+
+} // namespace
+
+NetCapture::NetCapture()
+  : enabled_(false), writers_(0), file_(INVALID_HANDLE_VALUE), mapping_(nullptr), view_(nullptr),
+    capacity_(0), start_ns_(0), offset_(0), committed_end_(0), records_(0), bytes_(0), dropped_(0) {
+}
+
+NetCapture::~NetCapture() {
+  Stop();
+}
+
+// the whole file is mapped up front so a writer never grows or remaps it
+bool NetCapture::Start(const CaptureConfig& config) {
+  std::lock_guard<std::mutex> lock(capture_lock_);
+  if (enabled_) {
+    NET_LOG(kError, "start capture failed: already started.");
+    return false;
+  }
+  if (config.path.empty() || config.capacity == 0) {
+    NET_LOG(kError, "start capture failed: invalid config parameter.");
+    return false;
+  }
+  file_ = CreateFileA(config.path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    NET_LOG(kError, "create capture file: %s failed, error code: %d.", config.path, GetLastError());
+    return false;
+  }
+  capacity_ = AlignRecord(config.capacity);
+  auto file_size = sizeof(NetCaptureHeader) + capacity_;
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READWRITE, static_cast<DWORD>(file_size >> 32), static_cast<DWORD>(file_size), nullptr);
+  if (mapping_ == nullptr) {
+    NET_LOG(kError, "map capture file: %s failed, error code: %d.", config.path, GetLastError());
+    Close();
+    return false;
+  }
+  view_ = static_cast<char*>(MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, 0));
+  if (view_ == nullptr) {
+    NET_LOG(kError, "map capture file: %s failed, error code: %d.", config.path, GetLastError());
+    Close();
+    return false;
+  }
+  auto header = reinterpret_cast<NetCaptureHeader*>(view_);
+  header->magic = kCaptureMagic;
+  header->version = kCaptureVersion;
+  header->start_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  header->data_size = 0;
+  header->records = 0;
+  start_ns_ = NetLatency::Now();
+  offset_ = 0;
+  committed_end_ = 0;
+  records_ = 0;
+  bytes_ = 0;
+  dropped_ = 0;
+  enabled_ = true;
+  return true;
+}
+
+// waits for the writers in flight, then cuts the file after the last record
+bool NetCapture::Stop() {
+  std::lock_guard<std::mutex> lock(capture_lock_);
+  if (!enabled_) {
+    return true;
+  }
+  enabled_ = false;
+  while (writers_ > 0) {
+    std::this_thread::yield();
+  }
+  auto header = reinterpret_cast<NetCaptureHeader*>(view_);
+  header->data_size = committed_end_;
+  header->records = records_;
+  FlushViewOfFile(view_, 0);
+  UnmapViewOfFile(view_);
+  view_ = nullptr;
+  CloseHandle(mapping_);
+  mapping_ = nullptr;
+  LARGE_INTEGER file_size;
+  file_size.QuadPart = sizeof(NetCaptureHeader) + committed_end_;
+  if (!SetFilePointerEx(file_, file_size, nullptr, FILE_BEGIN) || !SetEndOfFile(file_)) {
+    NET_LOG(kError, "truncate capture file failed, error code: %d.", GetLastError());
+  }
+  Close();
+  return true;
+}
+
+void NetCapture::Close() {
+  if (view_ != nullptr) {
+    UnmapViewOfFile(view_);
+    view_ = nullptr;
+  }
+  if (mapping_ != nullptr) {
+    CloseHandle(mapping_);
+    mapping_ = nullptr;
+  }
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+    file_ = INVALID_HANDLE_VALUE;
+  }
+}
+
+void NetCapture::Write(int type, unsigned long long handle, const NetEndpoint* peer, const char* data, int size) {
+  Write(type, handle, peer, nullptr, 0, data, size);
+}
+
+void NetCapture::Write(int type, unsigned long long handle, const NetEndpoint* peer, const char* head, int head_size, const char* data, int size) {
+  WriteAt(NetLatency::Now(), type, handle, peer, head, head_size, data, size);
+}
+
+// records below committed_end_ are complete once Stop has waited for the writers, because
+// the offset only grows and a reservation ending past the capacity is never written
+void NetCapture::WriteAt(unsigned long long event_ns, int type, unsigned long long handle, const NetEndpoint* peer, const char* head, int head_size, const char* data, int size) {
+  writers_.fetch_add(1);
+  if (!enabled_ || event_ns < start_ns_) {
+    writers_.fetch_sub(1);
+    return;
+  }
+  auto time_ns = event_ns - start_ns_;
+  auto payload_size = head_size + size;
+  auto length = AlignRecord(sizeof(NetCaptureRecord) + payload_size);
+  auto offset = offset_.fetch_add(length, std::memory_order_relaxed);
+  if (offset + length > capacity_) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    writers_.fetch_sub(1);
+    return;
+  }
+  auto record = reinterpret_cast<NetCaptureRecord*>(view_ + sizeof(NetCaptureHeader) + offset);
+  record->time_ns = time_ns;
+  record->handle = handle;
+  record->size = payload_size;
+  record->type = static_cast<unsigned short>(type);
+  record->addr_size = 0;
+  if (peer != nullptr && peer->valid()) {
+    record->addr_size = static_cast<unsigned short>(peer->addr_size());
+    memcpy(record->addr, peer->addr(), peer->addr_size());
+  }
+  auto payload = reinterpret_cast<char*>(record + 1);
+  if (head_size > 0) {
+    memcpy(payload, head, head_size);
+  }
+  if (size > 0) {
+    memcpy(payload + head_size, data, size);
+  }
+  auto end = offset + length;
+  auto committed_end = committed_end_.load(std::memory_order_relaxed);
+  while (end > committed_end && !committed_end_.compare_exchange_weak(committed_end, end, std::memory_order_relaxed)) {
+  }
+  records_.fetch_add(1, std::memory_order_relaxed);
+  bytes_.fetch_add(payload_size, std::memory_order_relaxed);
+  writers_.fetch_sub(1);
+}
+
+void NetCapture::GetStats(CaptureStats& stats) {
+  stats.enabled = enabled_;
+  stats.capacity = capacity_;
+  stats.used = committed_end_;
+  stats.records = records_;
+  stats.bytes = bytes_;
+  stats.dropped = dropped_;
+}
+
+NetCaptureReader::NetCaptureReader()
+  : file_(INVALID_HANDLE_VALUE), mapping_(nullptr), view_(nullptr), end_(0), offset_(0) {
+}
+
+NetCaptureReader::~NetCaptureReader() {
+  Close();
+}
+
+bool NetCaptureReader::Open(const std::string& path) {
+  Close();
+  file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    NET_LOG(kError, "open capture file: %s failed, error code: %d.", path, GetLastError());
+    return false;
+  }
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file_, &file_size) || file_size.QuadPart < static_cast<LONGLONG>(sizeof(NetCaptureHeader))) {
+    NET_LOG(kError, "open capture file: %s failed: not a capture file.", path);
+    Close();
+    return false;
+  }
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  view_ = mapping_ != nullptr ? static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+  if (view_ == nullptr) {
+    NET_LOG(kError, "map capture file: %s failed, error code: %d.", path, GetLastError());
+    Close();
+    return false;
+  }
+  auto capture_header = header();
+  if (capture_header->magic != kCaptureMagic || capture_header->version != kCaptureVersion) {
+    NET_LOG(kError, "open capture file: %s failed: not a capture file.", path);
+    Close();
+    return false;
+  }
+  auto data_size = static_cast<unsigned long long>(file_size.QuadPart) - sizeof(NetCaptureHeader);
+  end_ = capture_header->data_size < data_size ? capture_header->data_size : data_size;
+  offset_ = 0;
+  return true;
+}
+
+void NetCaptureReader::Close() {
+  if (view_ != nullptr) {
+    UnmapViewOfFile(const_cast<char*>(view_));
+    view_ = nullptr;
+  }
+  if (mapping_ != nullptr) {
+    CloseHandle(mapping_);
+    mapping_ = nullptr;
+  }
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+    file_ = INVALID_HANDLE_VALUE;
+  }
+  end_ = 0;
+  offset_ = 0;
+}
+
+bool NetCaptureReader::Next(NetCaptureEntry& entry) {
+  if (view_ == nullptr || offset_ + sizeof(NetCaptureRecord) > end_) {
+    return false;
+  }
+  auto record = reinterpret_cast<const NetCaptureRecord*>(view_ + sizeof(NetCaptureHeader) + offset_);
+  auto length = AlignRecord(sizeof(NetCaptureRecord) + record->size);
+  if (offset_ + length > end_ || record->addr_size > kNetEndpointStorageSize) {
+    NET_LOG(kError, "read capture record failed: corrupted at offset %llu.", offset_);
+    return false;
+  }
+  entry.type = record->type;
+  entry.handle = record->handle;
+  entry.time_ns = record->time_ns;
+  entry.peer.Reset();
+  if (record->addr_size > 0) {
+    entry.peer.Assign(record->addr, record->addr_size);
+  }
+  entry.data = reinterpret_cast<const char*>(record + 1);
+  entry.size = record->size;
+  offset_ += length;
+  return true;
+}
+
+} // namespace net
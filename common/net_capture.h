@@ -0,0 +1,107 @@
+#ifndef NET_NET_CAPTURE_H_
+#define NET_NET_CAPTURE_H_
+
+#include "net_interface.h"
+#include "uncopyable.h"
+#include <atomic>
+#include <mutex>
+#include <Windows.h>
+
+namespace net {
+
+const unsigned int kCaptureMagic = 0x5043454e;
+const unsigned int kCaptureVersion = 1;
+const int kCaptureTcpRecv = 1;
+const int kCaptureTcpSend = 2;
+// one per accepted or connected stream when its handle is removed, whichever side closed it
+const int kCaptureTcpDisconnect = 3;
+const int kCaptureUdpRecv = 4;
+const int kCaptureUdpSend = 5;
+
+// data_size and records are written when the capture stops
+struct NetCaptureHeader {
+  unsigned int magic;
+  unsigned int version;
+  unsigned long long start_time_ms;
+  unsigned long long data_size;
+  unsigned long long records;
+};
+
+// followed by size bytes of payload, the next record starts 8 byte aligned; time_ns is
+// relative to the start of the capture, addr is the peer of udp records
+struct NetCaptureRecord {
+  unsigned long long time_ns;
+  unsigned long long handle;
+  unsigned int size;
+  unsigned short type;
+  unsigned short addr_size;
+  unsigned char addr[kNetEndpointStorageSize];
+  unsigned char reserved[4];
+};
+
+struct NetCaptureEntry {
+  int type = 0;
+  unsigned long long handle = 0;
+  unsigned long long time_ns = 0;
+  NetEndpoint peer;
+  const char* data = nullptr;
+  int size = 0;
+};
+
+// writers reserve their record with one atomic add on the mapped file and copy the payload
+// without a lock; a record that does not fit any more is dropped and counted
+class NetCapture : public utility::Uncopyable {
+ public:
+  NetCapture();
+  ~NetCapture();
+
+  bool Start(const CaptureConfig& config);
+  bool Stop();
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+  void Write(int type, unsigned long long handle, const NetEndpoint* peer, const char* data, int size);
+  void Write(int type, unsigned long long handle, const NetEndpoint* peer, const char* head, int head_size, const char* data, int size);
+  // event_ns is a NetLatency::Now() time, events from before the capture started are skipped
+  void WriteAt(unsigned long long event_ns, int type, unsigned long long handle, const NetEndpoint* peer, const char* head, int head_size, const char* data, int size);
+  void GetStats(CaptureStats& stats);
+
+ private:
+  void Close();
+
+ private:
+  std::mutex capture_lock_;
+  std::atomic<bool> enabled_;
+  std::atomic<int> writers_;
+  HANDLE file_;
+  HANDLE mapping_;
+  char* view_;
+  unsigned long long capacity_;
+  unsigned long long start_ns_;
+  std::atomic<unsigned long long> offset_;
+  std::atomic<unsigned long long> committed_end_;
+  std::atomic<unsigned long long> records_;
+  std::atomic<unsigned long long> bytes_;
+  std::atomic<unsigned long long> dropped_;
+};
+
+// walks the records of a stopped capture file in the order they were reserved
+class NetCaptureReader : public utility::Uncopyable {
+ public:
+  NetCaptureReader();
+  ~NetCaptureReader();
+
+  bool Open(const std::string& path);
+  void Close();
+  bool Next(NetCaptureEntry& entry);
+  const NetCaptureHeader* header() const { return reinterpret_cast<const NetCaptureHeader*>(view_); }
+
+ private:
+  HANDLE file_;
+  HANDLE mapping_;
+  const char* view_;
+  unsigned long long end_;
+  unsigned long long offset_;
+};
+
+} // namespace net
+
+#endif	// NET_NET_CAPTURE_H_
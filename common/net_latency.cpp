@@ -0,0 +1,68 @@
+#include "net_latency.h"
+#include "base_buffer.h"
+#include <cstdio>
+
+namespace net {
+
+NetLatency::NetLatency() : enabled_(false) {
+}
+
+// enabling starts from empty histograms
+void NetLatency::SetEnabled(bool enabled) {
+  if (enabled && !enabled_) {
+    for (auto& stage : histograms_) {
+      for (auto& i : stage) {
+        i.Reset();
+      }
+    }
+  }
+  enabled_ = enabled;
+}
+
+// a begin of 0 means the operation was posted before tracking was enabled
+void NetLatency::Record(int stage, int async_type, unsigned long long begin, unsigned long long end) {
+  if (begin == 0 || end < begin || async_type <= 0 || async_type >= kNetOpTypes) {
+    return;
+  }
+  histograms_[stage][async_type].Record(end - begin);
+}
+
+void NetLatency::GetOpStats(int async_type, NetLatencyOpStats& stats) {
+  histograms_[kLatencyPostToCompletion][async_type].GetSummary(stats.post_to_completion);
+  histograms_[kLatencyCompletionToCallback][async_type].GetSummary(stats.completion_to_callback);
+  histograms_[kLatencyCallback][async_type].GetSummary(stats.callback);
+}
+
+void NetLatency::GetStats(NetLatencyStats& stats) {
+  GetOpStats(kAsyncTypeTcpAccept, stats.tcp_accept);
+  GetOpStats(kAsyncTypeTcpConnect, stats.tcp_connect);
+  GetOpStats(kAsyncTypeTcpDisconnect, stats.tcp_disconnect);
+  GetOpStats(kAsyncTypeTcpSend, stats.tcp_send);
+  GetOpStats(kAsyncTypeTcpRecv, stats.tcp_recv);
+  GetOpStats(kAsyncTypeUdpSend, stats.udp_send);
+  GetOpStats(kAsyncTypeUdpRecv, stats.udp_recv);
+  GetOpStats(kAsyncTypeTask, stats.task);
+}
+
+// one line per operation and stage that has samples, times in microseconds
+void NetLatency::Dump(std::string& report) {
+  const char* kOpNames[kNetOpTypes] = {"", "tcp_accept", "tcp_send", "tcp_recv", "udp_send", "udp_recv", "tcp_connect", "task", "tcp_disconnect"};
+  const char* kStageNames[kLatencyStages] = {"post", "queue", "callback"};
+  char line[256] = {0};
+  snprintf(line, sizeof(line), "%-16s%-10s%12s%10s%10s%10s%10s%10s\n", "op", "stage", "count", "p50", "p90", "p99", "p99.9", "max");
+  report = line;
+  for (auto type = 1; type < kNetOpTypes; ++type) {
+    for (auto stage = 0; stage < kLatencyStages; ++stage) {
+      LatencySummary summary;
+      histograms_[stage][type].GetSummary(summary);
+      if (summary.count == 0) {
+        continue;
+      }
+      snprintf(line, sizeof(line), "%-16s%-10s%12llu%10.1f%10.1f%10.1f%10.1f%10.1f\n", kOpNames[type], kStageNames[stage], summary.count,
+        summary.p50_ns / 1000.0, summary.p90_ns / 1000.0, summary.p99_ns / 1000.0, summary.p999_ns / 1000.0, summary.max_ns / 1000.0);
+      report += line;
+    }
+  }
+}
+
+} // namespace net
@@ -0,0 +1,41 @@
+#ifndef NET_NET_LATENCY_H_
+#define NET_NET_LATENCY_H_
+
+#include "latency_histogram.h"
+#include "net_stats.h"
+#include <chrono>
+#include <string>
+
+namespace net {
+
+const int kLatencyPostToCompletion = 0;
+const int kLatencyCompletionToCallback = 1;
+const int kLatencyCallback = 2;
+const int kLatencyStages = 3;
+
+// per async type histograms of the three stages of an overlapped operation: posted until
+// dequeued, dequeued until handled, and the handling itself including the user callbacks
+class NetLatency : public utility::Uncopyable {
+ public:
+  NetLatency();
+
+  static unsigned long long Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+  void SetEnabled(bool enabled);
+  void Record(int stage, int async_type, unsigned long long begin, unsigned long long end);
+  void GetStats(NetLatencyStats& stats);
+  void Dump(std::string& report);
+
+ private:
+  void GetOpStats(int async_type, NetLatencyOpStats& stats);
+
+ private:
+  std::atomic<bool> enabled_;
+  LatencyHistogram histograms_[kLatencyStages][kNetOpTypes];
+};
+
+} // namespace net
+
+#endif	// NET_NET_LATENCY_H_
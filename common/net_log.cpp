@@ -0,0 +1,256 @@
+#include "net_log.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <WinSock2.h>
+
+namespace net {
+
+const int kNetLogDrainMs = 10;
+
+NetLogger::NetLogger() : running_(false), users_(0), dropped_(0), reported_dropped_(0) {
+  sink_ = [](int level, const char* text) { LOG(level, "%s", text); };
+}
+
+// engines never cleaned up still count as users here, the thread is stopped regardless
+NetLogger::~NetLogger() {
+  std::lock_guard<std::mutex> lock(start_lock_);
+  StopThread();
+}
+
+// every started engine uses the logger, the last one to stop it stops the thread
+bool NetLogger::Start() {
+  std::lock_guard<std::mutex> lock(start_lock_);
+  if (users_++ > 0) {
+    return true;
+  }
+  running_ = true;
+  log_thread_.reset(new std::thread(&NetLogger::ThreadWorker, this));
+  return true;
+}
+
+// records written after the last drain are formatted by the caller from now on
+void NetLogger::Stop() {
+  std::lock_guard<std::mutex> lock(start_lock_);
+  if (users_ == 0) {
+    NET_LOG(kError, "net log stopped more often than started.");
+    return;
+  }
+  if (--users_ == 0) {
+    StopThread();
+  }
+}
+
+// new records are formatted by their writer once running_ is clear, the last drain waits for
+// the writes that started before
+void NetLogger::StopThread() {
+  running_ = false;
+  if (log_thread_ != nullptr && log_thread_->joinable()) {
+    log_thread_->join();
+  }
+  log_thread_.reset();
+  WaitWriters();
+  Drain();
+}
+
+void NetLogger::WaitWriters() {
+  std::vector<std::shared_ptr<NetLogRing>> rings;
+  {
+    std::lock_guard<std::mutex> lock(rings_lock_);
+    rings = rings_;
+  }
+  for (auto& ring : rings) {
+    while (ring->writing()) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void NetLogger::SetSink(Sink&& sink) {
+  std::lock_guard<std::mutex> lock(sink_lock_);
+  sink_ = std::move(sink);
+}
+
+void NetLogger::PackText(NetLogRecord& record, NetLogRecord::Arg& arg, const char* value) {
+  arg.type = NetLogRecord::kText;
+  arg.text_offset = record.text_size;
+  if (value == nullptr) {
+    value = "(null)";
+  }
+  // text is full, the argument gets the terminator in the last byte
+  if (record.text_size >= kNetLogTextSize - 1) {
+    arg.text_offset = kNetLogTextSize - 1;
+    record.text[kNetLogTextSize - 1] = '\0';
+    return;
+  }
+  auto size = static_cast<int>(strnlen(value, kNetLogTextSize - record.text_size - 1));
+  memcpy(record.text + record.text_size, value, size);
+  record.text_size += size;
+  record.text[record.text_size++] = '\0';
+}
+
+// every conversion is reformatted from the type the argument was captured with, length
+// modifiers of the format are replaced, '*' width and precision are not supported
+void NetLogger::Format(const NetLogRecord& record, std::string& line) {
+  line.clear();
+  char spec[32] = {0};
+  char value[128] = {0};
+  auto next_arg = 0;
+  for (auto p = record.format; *p != '\0';) {
+    if (*p != '%') {
+      line += *p++;
+      continue;
+    }
+    if (p[1] == '%') {
+      line += '%';
+      p += 2;
+      continue;
+    }
+    auto begin = p++;
+    while (*p != '\0' && strchr("-+ #0", *p) != nullptr) {
+      ++p;
+    }
+    while ((*p >= '0' && *p <= '9') || *p == '.') {
+      ++p;
+    }
+    auto prefix_size = static_cast<int>(p - begin);
+    while (*p != '\0' && strchr("hlLqjzt", *p) != nullptr) {
+      ++p;
+    }
+    if (*p == 'I') {
+      ++p;
+      while (*p >= '0' && *p <= '9') {
+        ++p;
+      }
+    }
+    if (*p == '\0' || prefix_size > 16) {
+      break;
+    }
+    auto conversion = *p++;
+    if (next_arg >= record.arg_count) {
+      line += "<?>";
+      continue;
+    }
+    auto& arg = record.args[next_arg++];
+    memcpy(spec, begin, prefix_size);
+    auto spec_end = spec + prefix_size;
+    switch (arg.type) {
+    case NetLogRecord::kText:
+      strcpy(spec_end, "s");
+      snprintf(value, sizeof(value), spec, record.text + arg.text_offset);
+      break;
+    case NetLogRecord::kDouble:
+      spec_end[0] = strchr("fFeEgGaA", conversion) != nullptr ? conversion : 'f';
+      spec_end[1] = '\0';
+      snprintf(value, sizeof(value), spec, arg.d);
+      break;
+    case NetLogRecord::kPointer:
+      strcpy(spec_end, "p");
+      snprintf(value, sizeof(value), spec, arg.p);
+      break;
+    default:
+      if (conversion == 'c') {
+        strcpy(spec_end, "c");
+        snprintf(value, sizeof(value), spec, static_cast<int>(arg.i));
+      } else if (strchr("uxXo", conversion) != nullptr) {
+        spec_end[0] = 'l';
+        spec_end[1] = 'l';
+        spec_end[2] = conversion;
+        spec_end[3] = '\0';
+        snprintf(value, sizeof(value), spec, arg.u);
+      } else if (arg.type == NetLogRecord::kUnsigned) {
+        strcpy(spec_end, "llu");
+        snprintf(value, sizeof(value), spec, arg.u);
+      } else {
+        strcpy(spec_end, "lld");
+        snprintf(value, sizeof(value), spec, arg.i);
+      }
+      break;
+    }
+    line += value;
+  }
+  if (record.suppressed > 0) {
+    snprintf(value, sizeof(value), " (%llu similar suppressed)", record.suppressed);
+    line += value;
+  }
+}
+
+// a site gets kNetLogSiteBurst records per window, the rest is only counted
+bool NetLogger::Admit(NetLogSite& site, unsigned long long& suppressed) {
+  auto now = GetTickCount64();
+  auto window_begin = site.window_begin.load(std::memory_order_relaxed);
+  if (now - window_begin >= kNetLogSiteWindowMs &&
+    site.window_begin.compare_exchange_strong(window_begin, now, std::memory_order_relaxed)) {
+    site.window_count.store(0, std::memory_order_relaxed);
+  }
+  if (site.window_count.fetch_add(1, std::memory_order_relaxed) >= kNetLogSiteBurst) {
+    site.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+  return true;
+}
+
+// the registry keeps the ring of an exited thread until it is drained
+NetLogRing* NetLogger::ThreadRing() {
+  thread_local std::shared_ptr<NetLogRing> ring;
+  if (ring == nullptr) {
+    ring = std::make_shared<NetLogRing>();
+    std::lock_guard<std::mutex> lock(rings_lock_);
+    rings_.push_back(ring);
+  }
+  return ring.get();
+}
+
+void NetLogger::Emit(const NetLogRecord& record) {
+  std::string line;
+  Format(record, line);
+  std::lock_guard<std::mutex> lock(sink_lock_);
+  if (sink_ != nullptr) {
+    sink_(record.level, line.c_str());
+  }
+}
+
+void NetLogger::Drain() {
+  std::vector<std::shared_ptr<NetLogRing>> rings;
+  {
+    std::lock_guard<std::mutex> lock(rings_lock_);
+    rings = rings_;
+  }
+  for (auto& ring : rings) {
+    for (auto record = ring->BeginRead(); record != nullptr; record = ring->BeginRead()) {
+      Emit(*record);
+      ring->EndRead();
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(rings_lock_);
+    for (auto i = rings_.begin(); i != rings_.end();) {
+      // the registry and the copy above are the last owners once the thread exited
+      if (i->use_count() <= 2 && (*i)->BeginRead() == nullptr) {
+        i = rings_.erase(i);
+      } else {
+        ++i;
+      }
+    }
+  }
+  auto dropped = dropped_.load();
+  if (dropped != reported_dropped_) {
+    char line[64] = {0};
+    snprintf(line, sizeof(line), "net log dropped %llu records.", dropped - reported_dropped_);
+    reported_dropped_ = dropped;
+    std::lock_guard<std::mutex> lock(sink_lock_);
+    if (sink_ != nullptr) {
+      sink_(kError, line);
+    }
+  }
+}
+
+void NetLogger::ThreadWorker() {
+  while (running_) {
+    Drain();
+    std::this_thread::sleep_for(std::chrono::milliseconds(kNetLogDrainMs));
+  }
+}
+
+} // namespace net
@@ -0,0 +1,190 @@
+#ifndef NET_NET_LOG_H_
+#define NET_NET_LOG_H_
+
+#include "log.h"
+#include "singleton.h"
+#include "uncopyable.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace net {
+
+const int kNetLogArgs = 8;
+const int kNetLogTextSize = 96;
+const int kNetLogRingSize = 256;
+const int kNetLogSiteBurst = 16;
+const unsigned long long kNetLogSiteWindowMs = 1000;
+
+// rate limit state of one NET_LOG call site
+struct NetLogSite {
+  std::atomic<unsigned long long> window_begin{0};
+  std::atomic<int> window_count{0};
+  std::atomic<unsigned long long> suppressed{0};
+};
+
+// levels are the ones of log.h, the format is kept by pointer and must be a literal,
+// string arguments are copied into text and cut at kNetLogTextSize bytes in total
+struct NetLogRecord {
+  enum ArgType { kSigned, kUnsigned, kDouble, kPointer, kText };
+  struct Arg {
+    ArgType type;
+    union {
+      long long i;
+      unsigned long long u;
+      double d;
+      const void* p;
+      int text_offset;
+    };
+  };
+
+  int level;
+  const char* format;
+  unsigned long long suppressed;
+  int arg_count;
+  Arg args[kNetLogArgs];
+  int text_size;
+  char text[kNetLogTextSize];
+};
+
+// single producer single consumer ring of one writing thread
+class NetLogRing : public utility::Uncopyable {
+ public:
+  NetLogRing() : head_(0), tail_(0), writing_(false) {}
+
+  NetLogRecord* BeginWrite() {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    return tail - head_.load(std::memory_order_acquire) < kNetLogRingSize ? &records_[tail % kNetLogRingSize] : nullptr;
+  }
+  void EndWrite() { tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+  NetLogRecord* BeginRead() {
+    auto head = head_.load(std::memory_order_relaxed);
+    return head != tail_.load(std::memory_order_acquire) ? &records_[head % kNetLogRingSize] : nullptr;
+  }
+  void EndRead() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+  // set by the writer around a write, seq_cst against running_ so Stop can wait for it
+  void set_writing(bool writing) { writing_.store(writing); }
+  bool writing() const { return writing_.load(); }
+
+ private:
+  alignas(64) std::atomic<unsigned int> head_;
+  alignas(64) std::atomic<unsigned int> tail_;
+  std::atomic<bool> writing_;
+  NetLogRecord records_[kNetLogRingSize];
+};
+
+// writers copy binary records into their own ring, a background thread formats them;
+// a full ring drops, a call site logs at most kNetLogSiteBurst records per window
+class NetLogger : public utility::Uncopyable {
+ public:
+  typedef std::function<void (int, const char*)> Sink;
+
+  NetLogger();
+  ~NetLogger();
+
+  bool Start();
+  void Stop();
+  void SetSink(Sink&& sink);
+  unsigned long long dropped() const { return dropped_; }
+
+  template <typename... Args>
+  void Write(NetLogSite& site, int level, const char* format, const Args&... args) {
+    unsigned long long suppressed = 0;
+    if (!Admit(site, suppressed)) {
+      return;
+    }
+    NetLogRecord local_record;
+    auto ring = running_ ? ThreadRing() : nullptr;
+    if (ring != nullptr) {
+      ring->set_writing(true);
+      if (!running_) {
+        ring->set_writing(false);
+        ring = nullptr;
+      }
+    }
+    auto record = ring != nullptr ? ring->BeginWrite() : &local_record;
+    if (record == nullptr) {
+      ring->set_writing(false);
+      ++dropped_;
+      site.suppressed += suppressed;
+      return;
+    }
+    record->level = level;
+    record->format = format;
+    record->suppressed = suppressed;
+    record->arg_count = 0;
+    record->text_size = 0;
+    (PackArg(*record, args), ...);
+    if (ring != nullptr) {
+      ring->EndWrite();
+      ring->set_writing(false);
+    } else {
+      Emit(*record);
+    }
+  }
+
+ private:
+  template <typename T>
+  static void PackArg(NetLogRecord& record, const T& value) {
+    if (record.arg_count >= kNetLogArgs) {
+      return;
+    }
+    auto& arg = record.args[record.arg_count++];
+    typedef typename std::decay<T>::type Type;
+    if constexpr (std::is_same<Type, char*>::value || std::is_same<Type, const char*>::value) {
+      PackText(record, arg, value);
+    } else if constexpr (std::is_same<Type, std::string>::value) {
+      PackText(record, arg, value.c_str());
+    } else if constexpr (std::is_floating_point<Type>::value) {
+      arg.type = NetLogRecord::kDouble;
+      arg.d = value;
+    } else if constexpr (std::is_enum<Type>::value || std::is_signed<Type>::value) {
+      arg.type = NetLogRecord::kSigned;
+      arg.i = static_cast<long long>(value);
+    } else if constexpr (std::is_integral<Type>::value) {
+      arg.type = NetLogRecord::kUnsigned;
+      arg.u = static_cast<unsigned long long>(value);
+    } else {
+      arg.type = NetLogRecord::kPointer;
+      arg.p = static_cast<const void*>(value);
+    }
+  }
+  static void PackText(NetLogRecord& record, NetLogRecord::Arg& arg, const char* value);
+  static void Format(const NetLogRecord& record, std::string& line);
+  bool Admit(NetLogSite& site, unsigned long long& suppressed);
+  NetLogRing* ThreadRing();
+  void Emit(const NetLogRecord& record);
+  void StopThread();
+  void WaitWriters();
+  void Drain();
+  void ThreadWorker();
+
+ private:
+  std::atomic<bool> running_;
+  int users_;
+  std::mutex start_lock_;
+  std::atomic<unsigned long long> dropped_;
+  unsigned long long reported_dropped_;
+  std::vector<std::shared_ptr<NetLogRing>> rings_;
+  std::mutex rings_lock_;
+  Sink sink_;
+  std::mutex sink_lock_;
+  std::unique_ptr<std::thread> log_thread_;
+};
+
+typedef utility::Singleton<NetLogger> SingleNetLogger;
+
+} // namespace net
+
+#define NET_LOG(level, ...) \
+  do { \
+    static net::NetLogSite net_log_site; \
+    net::SingleNetLogger::GetInstance()->Write(net_log_site, level, __VA_ARGS__); \
+  } while (0)
+
+#endif	// NET_NET_LOG_H_
@@ -1,26 +1,55 @@
 #include "net_res_mgr.h"
-#include "log.h"
+#include "inproc_stream.h"
+#include "net_log.h"
 #include "utility.h"
 #include "utility_net.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <IPHlpApi.h>
+#pragma comment(lib, "Iphlpapi.lib")
 #pragma comment(lib, "Ws2_32.lib")
 
 namespace net {
 
+const int kInprocFirstPort = 49152;
+const int kInprocLastPort = 65535;
+
 NetResMgr::NetResMgr() {
   net_started_ = false;
+  logger_started_ = false;
+  inproc_transport_ = false;
+  callback_strands_ = false;
+  inproc_next_port_ = 0;
 }
 
 NetResMgr::~NetResMgr() {
   CleanupNet();
 }
 
-bool NetResMgr::StartupNet() {
+bool NetResMgr::StartupNet(const NetConfig& config) {
   if (net_started_) {
     return true;
   }
+  auto processor_num = utility::GetProcessorNum();
+  auto valid_processor = [processor_num](int processor) { return processor >= 0 && processor < processor_num; };
+  if (config.worker_shards <= 0 || !std::all_of(config.processors.begin(), config.processors.end(), valid_processor)) {
+    NET_LOG(kStartup, "startup net failed: invalid config parameter.");
+    return false;
+  }
   net_started_ = true;
-  auto iocp_callback = std::bind(&NetResMgr::TransferAsyncType, this, std::placeholders::_1, std::placeholders::_2);
-  if (!iocp_.Init(std::move(iocp_callback))) {
+  logger_started_ = SingleNetLogger::GetInstance()->Start();
+  latency_.SetEnabled(config.latency_tracking);
+  inproc_transport_ = config.inproc_transport;
+  callback_strands_ = config.callback_strands;
+  tcp_socket_pool_.Open();
+  auto iocp_callback = std::bind(&NetResMgr::TransferAsyncTypes, this, std::placeholders::_1, std::placeholders::_2);
+  if (!iocp_.Init(std::move(iocp_callback), config.worker_shards, config.processors)) {
+    CleanupNet();
+    return false;
+  }
+  auto timer_dispatcher = [this](TimerQueue::Task&& task) { PostTask(std::move(task)); };
+  if (!timer_queue_.Init(std::move(timer_dispatcher))) {
     CleanupNet();
     return false;
   }
@@ -31,6 +60,16 @@ bool NetResMgr::CleanupNet() {
   if (!net_started_) {
     return true;
   }
+  timer_queue_.Uninit();
+  rudp_sessions_lock_.lock();
+  rudp_sessions_.clear();
+  rudp_sessions_lock_.unlock();
+  rudp_indexer_.Clear();
+  tcp_socket_pool_.Close();
+  tcp_pools_lock_.lock();
+  tcp_pools_.clear();
+  tcp_pools_lock_.unlock();
+  tcp_pool_indexer_.Clear();
   tcp_sockets_lock_.lock();
   tcp_sockets_.clear();
   tcp_sockets_lock_.unlock();
@@ -39,34 +78,57 @@ bool NetResMgr::CleanupNet() {
   udp_sockets_.clear();
   udp_sockets_lock_.unlock();
   udp_indexer_.Clear();
+  inproc_listeners_lock_.lock();
+  inproc_listeners_.clear();
+  inproc_listeners_lock_.unlock();
   iocp_.Uninit();
+  capture_.Stop();
+  // every engine releases exactly the logger start it acquired
+  if (logger_started_) {
+    SingleNetLogger::GetInstance()->Stop();
+    logger_started_ = false;
+  }
   net_started_ = false;
   return true;
 }
 
 bool NetResMgr::TcpCreate(const std::weak_ptr<NetInterface>& callback, const std::string& ip, int port, TcpHandle& new_handle) {
   if (!net_started_) {
-    LOG(kError, "net not started.");
+    NET_LOG(kError, "net not started.");
     return false;
   }
   if (callback.expired()) {
-    LOG(kError, "create tcp handle failed: invalid callback parameter.");
+    NET_LOG(kError, "create tcp handle failed: invalid callback parameter.");
     return false;
   }
   auto new_socket = std::make_shared<TcpSocket>();
   if (!new_socket)
   {
-    LOG(kError, "create tcp handle failed: not enough memory.");
-    return false;
-  }
-  if (!new_socket->Create(callback)) {
-    return false;
-  }
-  if (!new_socket->Bind(ip, port)) {
+    NET_LOG(kError, "create tcp handle failed: not enough memory.");
     return false;
   }
-  if (!iocp_.BindToIOCP(new_socket->socket())) {
-    return false;
+  if (inproc_transport_) {
+    if (!CreateInprocTcpSocket(new_socket, callback)) {
+      return false;
+    }
+    if (port == 0) {
+      port = kInprocFirstPort + inproc_next_port_++ % (kInprocLastPort - kInprocFirstPort + 1);
+    }
+    if (!new_socket->Bind(ip, port)) {
+      return false;
+    }
+  } else {
+    if (!new_socket->Create(callback)) {
+      return false;
+    }
+    if (!new_socket->Bind(ip, port)) {
+      return false;
+    }
+    auto shard = iocp_.NextShard();
+    if (!iocp_.BindToIOCP(new_socket->socket(), shard)) {
+      return false;
+    }
+    new_socket->set_iocp_bound(shard);
   }
   if (!AddTcpSocket(new_socket, new_handle)) {
     return false;
@@ -76,48 +138,80 @@ bool NetResMgr::TcpCreate(const std::weak_ptr<NetInterface>& callback, const std
 
 bool NetResMgr::TcpDestroy(TcpHandle handle) {
   if (!net_started_) {
-    LOG(kError, "net not started.");
+    NET_LOG(kError, "net not started.");
     return false;
   }
   RemoveTcpSocket(handle);
   return true;
 }
 
-bool NetResMgr::TcpListen(TcpHandle handle) {
+bool NetResMgr::TcpListen(TcpHandle handle, const TcpListenConfig& config) {
   if (!net_started_) {
-    LOG(kError, "net not started.");
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  if (config.max_accepts > 0 && config.max_accepts < config.min_accepts) {
+    NET_LOG(kError, "listen tcp handle: %u failed: invalid config parameter.", handle);
     return false;
   }
   auto socket = GetTcpSocket(handle);
   if (socket == nullptr) {
     return false;
   }
-  auto backlog = utility::GetProcessorNum() * 2;
-  if (!socket->Listen(backlog)) {
+  auto listener = std::make_shared<TcpListener>(config, iocp_.shard_num());
+  if (!socket->Listen(listener->backlog())) {
     return false;
   }
-  for (auto i = 0; i < backlog; ++i) {
-    auto accept_buffer = GetTcpAcceptBuffer();
-    if (accept_buffer == nullptr) {
-      return false;
-    }
-    if (!AsyncTcpAccept(handle, socket, accept_buffer)) {
+  socket->set_listener(listener);
+  if (socket->inproc()) {
+    std::string ip;
+    auto port = 0;
+    socket->GetLocalAddr(ip, port);
+    std::lock_guard<std::mutex> lock(inproc_listeners_lock_);
+    auto existing = inproc_listeners_.find(port);
+    if (existing != inproc_listeners_.end() && existing->second != handle && GetInprocListener(existing->second, port) != nullptr) {
+      NET_LOG(kError, "listen tcp handle: %u failed: inproc port %d in use.", handle, port);
       return false;
     }
+    inproc_listeners_[port] = handle;
+    listener->Start();
+    return true;
   }
+  return PostTcpAccepts(handle, socket, nullptr, listener->Start());
+}
+
+bool NetResMgr::TcpGetListenStats(TcpHandle handle, TcpListenStats& stats) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  auto socket = GetTcpSocket(handle);
+  if (socket == nullptr) {
+    return false;
+  }
+  auto listener = socket->listener();
+  if (listener == nullptr) {
+    NET_LOG(kError, "get tcp handle: %u listen stats failed: not listening.", handle);
+    return false;
+  }
+  listener->GetStats(stats);
   return true;
 }
 
 bool NetResMgr::TcpConnect(TcpHandle handle, const std::string& ip, int port) {
   if (!net_started_) {
-    LOG(kError, "net not started.");
+    NET_LOG(kError, "net not started.");
     return false;
   }
   auto socket = GetTcpSocket(handle);
   if (socket == nullptr) {
     return false;
   }
-  if (!socket->Connect(ip, port)) {
+  if (socket->inproc()) {
+    if (!ConnectInproc(handle, socket, port)) {
+      return false;
+    }
+  } else if (!socket->Connect(ip, port)) {
     return false;
   }
   auto recv_buffer = GetTcpRecvBuffer();
@@ -130,13 +224,13 @@ bool NetResMgr::TcpConnect(TcpHandle handle, const std::string& ip, int port) {
   return true;
 }
 
-bool NetResMgr::TcpSend(TcpHandle handle, std::unique_ptr<char[]>&& packet, int size) {
+bool NetResMgr::TcpSend(TcpHandle handle, SendPayload&& packet, int size) {
   if (!net_started_) {
-    LOG(kError, "net not started.");
+    NET_LOG(kError, "net not started.");
     return false;
   }
   if (packet == nullptr || size <= 0 || size > kMaxTcpPacketSize) {
-    LOG(kError, "send tcp handle: %u packet failed: invalid parameter.", handle);
+    NET_LOG(kError, "send tcp handle: %u packet failed: invalid parameter.", handle);
     return false;
   }
   auto socket = GetTcpSocket(handle);
@@ -148,21 +242,16 @@ bool NetResMgr::TcpSend(TcpHandle handle, std::unique_ptr<char[]>&& packet, int
     return false;
   }
   send_buffer->set_buffer(std::move(packet), size);
-  send_buffer->set_handle(handle);
-  if (!socket->AsyncSend(send_buffer->head(), send_buffer->buffer(), send_buffer->buffer_size(), send_buffer->ovlp())) {
-    ReturnTcpSendBuffer(send_buffer);
-    return false;
-  }
-  return true;
+  return AsyncTcpSend(handle, socket, send_buffer);
 }
 
 bool NetResMgr::TcpGetLocalAddr(TcpHandle handle, char ip[16], int& port) {
   if (!net_started_) {
-    LOG(kError, "net not started.");
+    NET_LOG(kError, "net not started.");
     return false;
   }
   if (ip == nullptr) {
-    LOG(kError, "get tcp handle : %u local address failed: invalid ip parameter.", handle);
+    NET_LOG(kError, "get tcp handle : %u local address failed: invalid ip parameter.", handle);
     return false;
   }
   auto socket = GetTcpSocket(handle);
@@ -179,11 +268,11 @@ bool NetResMgr::TcpGetLocalAddr(TcpHandle handle, char ip[16], int& port) {
 
 bool NetResMgr::TcpGetRemoteAddr(TcpHandle handle, char ip[16], int& port) {
   if (!net_started_) {
-    LOG(kError, "net not started.");
+    NET_LOG(kError, "net not started.");
     return false;
   }
   if (ip == nullptr) {
-    LOG(kError, "get tcp handle : %u remote address failed: invalid ip parameter.", handle);
+    NET_LOG(kError, "get tcp handle : %u remote address failed: invalid ip parameter.", handle);
     return false;
   }
   auto socket = GetTcpSocket(handle);
@@ -198,49 +287,110 @@ bool NetResMgr::TcpGetRemoteAddr(TcpHandle handle, char ip[16], int& port) {
   return true;
 }
 
-bool NetResMgr::UdpCreate(const std::weak_ptr<NetInterface>& callback, const std::string& ip, int port, UdpHandle& new_handle) {
+bool NetResMgr::TcpGetStats(TcpHandle handle, TcpStats& stats) {
   if (!net_started_) {
-    LOG(kError, "net not started.");
+    NET_LOG(kError, "net not started.");
     return false;
   }
-  if (callback.expired()) {
-    LOG(kError, "create udp handle failed: invalid callback parameter.");
+  auto socket = GetTcpSocket(handle);
+  if (socket == nullptr) {
+    return false;
+  }
+  stats.bytes_in = socket->bytes_in();
+  stats.bytes_out = socket->bytes_out();
+  stats.packets_in = socket->packets_in();
+  stats.packets_out = socket->packets_out();
+  stats.pending_sends = socket->pending_sends();
+  return true;
+}
+
+bool NetResMgr::SetTcpContext(TcpHandle handle, void* context) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  auto socket = GetTcpSocket(handle);
+  if (socket == nullptr) {
+    return false;
+  }
+  socket->set_context(context);
+  return true;
+}
+
+bool NetResMgr::GetTcpContext(TcpHandle handle, void*& context) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  auto socket = GetTcpSocket(handle);
+  if (socket == nullptr) {
+    return false;
+  }
+  context = socket->context();
+  return true;
+}
+
+bool NetResMgr::UdpCreate(const std::weak_ptr<NetInterface>& callback, const std::string& ip, int port, const UdpConfig& config, UdpHandle& new_handle) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  if (callback.expired() || config.recv_batch > kMaxUdpRecvBatch || config.min_recvs < 0 || config.max_recvs < 0 ||
+    config.recv_buffer_size < 0 || config.send_buffer_size < 0 || config.pacing_rate < 0 || config.pacing_burst < 0 ||
+    config.pacing_queue_limit < 0) {
+    NET_LOG(kError, "create udp handle failed: invalid parameter.");
     return false;
   }
   auto new_socket = std::make_shared<UdpSocket>();
   if (!new_socket)
   {
-    LOG(kError, "create udp handle failed: not enough memory.");
+    NET_LOG(kError, "create udp handle failed: not enough memory.");
     return false;
   }
   if (!new_socket->Create(callback)) {
     return false;
   }
+  if (config.reuse_address && !new_socket->ReuseAddress()) {
+    return false;
+  }
+  if (!new_socket->SetBufferSizes(config.recv_buffer_size, config.send_buffer_size)) {
+    return false;
+  }
   if (!new_socket->Bind(ip, port)) {
     return false;
   }
   if (!iocp_.BindToIOCP(new_socket->socket())) {
     return false;
   }
+  new_socket->set_pacer(std::make_shared<UdpPacer>(config));
   if (!AddUdpSocket(new_socket, new_handle)) {
     return false;
   }
-  auto recv_count = utility::GetProcessorNum();
-  for (auto i = 0; i < recv_count; ++i) {
-    auto recv_buffer = GetUdpRecvBuffer();
-    if (recv_buffer == nullptr) {
-      return false;
-    }
-    if (!AsyncUdpRecv(new_handle, new_socket, recv_buffer)) {
-      return false;
+  auto coalesced = false;
+  if (config.recv_coalescing) {
+    coalesced = new_socket->EnableRecvCoalescing(kUdpCoalescedBufferSize);
+    if (!coalesced) {
+      NET_LOG(kStartup, "udp handle: %u recv coalescing unavailable, receiving single datagrams.", new_handle);
     }
   }
+  auto recv_queue = std::make_shared<UdpRecvQueue>(config);
+  new_socket->set_recv_queue(recv_queue);
+  auto recv_buffer = GetUdpRecvBuffer(coalesced);
+  if (recv_buffer == nullptr) {
+    RemoveUdpSocket(new_handle);
+    return false;
+  }
+  recv_buffer->set_batch(config.recv_batch > 0);
+  if (!PostUdpRecvs(new_handle, new_socket, recv_buffer, recv_queue->Start())) {
+    RemoveUdpSocket(new_handle);
+    return false;
+  }
   return true;
 }
 
 bool NetResMgr::UdpDestroy(UdpHandle handle) {
   if (!net_started_) {
-    LOG(kError, "net not started.");
+    NET_LOG(kError, "net not started.");
     return false;
   }
   RemoveUdpSocket(handle);
@@ -248,192 +398,1426 @@ bool NetResMgr::UdpDestroy(UdpHandle handle) {
 }
 
 bool NetResMgr::UdpSendTo(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, const std::string& ip, int port) {
+  return UdpSendTo(handle, std::move(packet), size, NetEndpoint(ip, port));
+}
+
+bool NetResMgr::UdpSendTo(UdpHandle handle, SendPayload&& packet, int size, const NetEndpoint& to) {
   if (!net_started_) {
-    LOG(kError, "net not started.");
+    NET_LOG(kError, "net not started.");
     return false;
   }
-  if (packet == nullptr || size <= 0 || size > kMaxUdpPacketSize || port <= 0) {
-    LOG(kError, "send udp handle: %u packet failed: invalid parameter.", handle);
+  if (packet == nullptr || size <= 0 || size > kMaxUdpPacketSize || !to.valid() || to.port() <= 0) {
+    NET_LOG(kError, "send udp handle: %u packet failed: invalid parameter.", handle);
     return false;
   }
   auto socket = GetUdpSocket(handle);
   if (socket == nullptr) {
     return false;
   }
-  auto send_buffer = GetUdpSendBuffer();
-  if (send_buffer == nullptr) {
+  UdpPacer::Datagram datagram;
+  datagram.packet = std::move(packet);
+  datagram.size = size;
+  datagram.to = to;
+  return PaceUdpSend(handle, socket, std::move(datagram));
+}
+
+// one handle lookup for the whole batch, a failed item does not stop the following ones
+bool NetResMgr::UdpSendToBatch(UdpHandle handle, std::vector<UdpSendItem>&& items) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
     return false;
   }
-  send_buffer->set_buffer(std::move(packet), size);
-  send_buffer->set_handle(handle);
-  if (!socket->AsyncSendTo(send_buffer->buffer(), send_buffer->buffer_size(), ip, port, send_buffer->ovlp())) {
-    ReturnUdpSendBuffer(send_buffer);
+  for (auto& item : items) {
+    if (item.packet == nullptr || item.size <= 0 || item.size > kMaxUdpPacketSize || !item.to.valid() || item.to.port() <= 0) {
+      NET_LOG(kError, "send udp handle: %u batch failed: invalid parameter.", handle);
+      return false;
+    }
+  }
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
     return false;
   }
-  return true;
+  auto all_sent = true;
+  for (auto& item : items) {
+    UdpPacer::Datagram datagram;
+    datagram.packet = std::move(item.packet);
+    datagram.size = item.size;
+    datagram.to = item.to;
+    if (!PaceUdpSend(handle, socket, std::move(datagram))) {
+      all_sent = false;
+    }
+  }
+  return all_sent;
 }
 
-bool NetResMgr::AddTcpSocket(const std::shared_ptr<TcpSocket>& new_socket, TcpHandle& new_handle) {
-  auto new_index = tcp_indexer_.CreateIndex();
-  if (new_index == utility::kInvalidIndex) {
-    LOG(kError, "fail to new tcp handle: no useful index.");
-    return false;
-  }
-  new_handle = new_index;
-  std::lock_guard<std::mutex> lock(tcp_sockets_lock_);
-  tcp_sockets_.insert(std::make_pair(new_handle, new_socket));
-  return true;
+bool NetResMgr::UdpSendSegments(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, int segment_size, const std::string& ip, int port) {
+  return UdpSendSegments(handle, std::move(packet), size, segment_size, NetEndpoint(ip, port));
 }
 
-bool NetResMgr::AddUdpSocket(const std::shared_ptr<UdpSocket>& new_socket, TcpHandle& new_handle) {
-  auto new_index = udp_indexer_.CreateIndex();
-  if (new_index == utility::kInvalidIndex) {
-    LOG(kError, "fail to new udp handle: no useful index.");
+bool NetResMgr::UdpSendSegments(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, int segment_size, const NetEndpoint& to) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
     return false;
   }
-  new_handle = new_index;
-  std::lock_guard<std::mutex> lock(udp_sockets_lock_);
-  udp_sockets_.insert(std::make_pair(new_handle, new_socket));
-  return true;
-}
-
-void NetResMgr::RemoveTcpSocket(TcpHandle handle) {
-  tcp_sockets_lock_.lock();
-  auto socket = tcp_sockets_.find(handle);
-  if (socket != tcp_sockets_.end()) {
-    tcp_sockets_.erase(socket);
-    tcp_sockets_lock_.unlock();
-    tcp_indexer_.DestroyIndex(handle);
-  } else {
-    tcp_sockets_lock_.unlock();
+  if (packet == nullptr || size <= 0 || size > kMaxUdpSegmentedSize || segment_size <= 0 ||
+    segment_size > kMaxUdpPacketSize || !to.valid() || to.port() <= 0) {
+    NET_LOG(kError, "send udp handle: %u segments failed: invalid parameter.", handle);
+    return false;
   }
-}
-
-void NetResMgr::RemoveUdpSocket(UdpHandle handle) {
-  udp_sockets_lock_.lock();
-  auto socket = udp_sockets_.find(handle);
-  if (socket != udp_sockets_.end()) {
-    udp_sockets_.erase(socket);
-    udp_sockets_lock_.unlock();
-    udp_indexer_.DestroyIndex(handle);
-  } else {
-    udp_sockets_lock_.unlock();
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
+    return false;
   }
+  UdpPacer::Datagram datagram;
+  datagram.packet = std::move(packet);
+  datagram.size = size;
+  datagram.segment_size = size > segment_size ? segment_size : 0;
+  datagram.to = to;
+  return PaceUdpSend(handle, socket, std::move(datagram));
 }
 
-std::shared_ptr<TcpSocket> NetResMgr::GetTcpSocket(TcpHandle handle) {
-  std::lock_guard<std::mutex> lock(tcp_sockets_lock_);
-  auto socket = tcp_sockets_.find(handle);
-  if (socket == tcp_sockets_.end()) {
-    LOG(kError, "can not find tcp handle: %u.", handle);
-    return nullptr;
+// a connected handle sends without a destination and only receives from its peer
+bool NetResMgr::UdpConnect(UdpHandle handle, const NetEndpoint& peer) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
   }
-  return socket->second;
-}
-
-std::shared_ptr<UdpSocket> NetResMgr::GetUdpSocket(UdpHandle handle) {
-  std::lock_guard<std::mutex> lock(udp_sockets_lock_);
-  auto socket = udp_sockets_.find(handle);
-  if (socket == udp_sockets_.end()) {
-    LOG(kError, "can not find udp handle: %u.", handle);
-    return nullptr;
+  if (!peer.valid() || peer.port() <= 0) {
+    NET_LOG(kError, "connect udp handle: %u failed: invalid parameter.", handle);
+    return false;
   }
-  return socket->second;
-}
-
-TcpAcceptBuffer* NetResMgr::GetTcpAcceptBuffer() {
-  auto buffer = new TcpAcceptBuffer;
-  return buffer;
-}
-
-TcpSendBuffer* NetResMgr::GetTcpSendBuffer() {
-  auto buffer = new TcpSendBuffer;
-  return buffer;
-}
-
-TcpRecvBuffer* NetResMgr::GetTcpRecvBuffer() {
-  auto buffer = new TcpRecvBuffer;
-  return buffer;
-}
-
-UdpSendBuffer* NetResMgr::GetUdpSendBuffer() {
-  auto buffer = new UdpSendBuffer;
-  return buffer;
-}
-
-UdpRecvBuffer* NetResMgr::GetUdpRecvBuffer() {
-  auto buffer = new UdpRecvBuffer;
-  return buffer;
-}
-
-void NetResMgr::ReturnTcpAcceptBuffer(TcpAcceptBuffer* buffer) {
-  if (buffer != nullptr) {
-    delete buffer;
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
+    return false;
   }
+  return socket->Connect(peer);
 }
 
-void NetResMgr::ReturnTcpSendBuffer(TcpSendBuffer* buffer) {
-  if (buffer != nullptr) {
-    delete buffer;
+bool NetResMgr::UdpSend(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
   }
-}
-
-void NetResMgr::ReturnTcpRecvBuffer(TcpRecvBuffer* buffer) {
-  if (buffer != nullptr) {
-    delete buffer;
+  if (packet == nullptr || size <= 0 || size > kMaxUdpPacketSize) {
+    NET_LOG(kError, "send udp handle: %u packet failed: invalid parameter.", handle);
+    return false;
   }
-}
-
-void NetResMgr::ReturnUdpSendBuffer(UdpSendBuffer* buffer) {
-  if (buffer != nullptr) {
-    delete buffer;
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
+    return false;
   }
-}
-
-void NetResMgr::ReturnUdpRecvBuffer(UdpRecvBuffer* buffer) {
-  if (buffer != nullptr) {
-    delete buffer;
+  if (!socket->connected()) {
+    NET_LOG(kError, "send udp handle: %u packet failed: not connected.", handle);
+    return false;
   }
+  UdpPacer::Datagram datagram;
+  datagram.packet = std::move(packet);
+  datagram.size = size;
+  return PaceUdpSend(handle, socket, std::move(datagram));
 }
 
-bool NetResMgr::AsyncTcpAccept(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpAcceptBuffer* buffer) {
-  std::unique_ptr<TcpSocket> accept_socket(new TcpSocket);
-  if (!accept_socket->Create(socket->callback())) {
-    ReturnTcpAcceptBuffer(buffer);
+bool NetResMgr::UdpGetOffloadInfo(UdpHandle handle, UdpOffloadInfo& info) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
     return false;
   }
-  auto async_sock = accept_socket->socket();
-  buffer->set_handle(handle);
-  buffer->set_accept_socket(std::move(accept_socket));
-  if (!socket->AsyncAccept(async_sock, buffer->buffer(), buffer->buffer_size(), buffer->ovlp())) {
-    ReturnTcpAcceptBuffer(buffer);
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
     return false;
   }
+  info.send_segmentation = socket->send_segmentation();
+  info.recv_coalescing = socket->recv_coalescing();
   return true;
 }
 
-bool NetResMgr::AsyncTcpRecv(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpRecvBuffer* buffer) {
-  buffer->set_handle(handle);
-  if (!socket->AsyncRecv(buffer->buffer(), buffer->buffer_size(), buffer->ovlp())) {
-    ReturnTcpRecvBuffer(buffer);
+bool NetResMgr::UdpGetRecvStats(UdpHandle handle, UdpRecvStats& stats) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
     return false;
   }
+  socket->recv_queue()->GetStats(stats);
+  socket->GetBufferSizes(stats.recv_buffer_size, stats.send_buffer_size);
+  MIB_UDPSTATS system_stats = {0};
+  if (GetUdpStatisticsEx(&system_stats, AF_INET) == NO_ERROR) {
+    stats.system_in_errors = system_stats.dwInErrors;
+    stats.system_no_ports = system_stats.dwNoPorts;
+  }
   return true;
 }
 
-bool NetResMgr::AsyncUdpRecv(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpRecvBuffer* buffer) {
-  buffer->set_handle(handle);
-  if (!socket->AsyncRecvFrom(buffer->buffer(), buffer->buffer_size(), buffer->from_addr(), buffer->addr_size(), buffer->ovlp())) {
-    ReturnUdpRecvBuffer(buffer);
+bool NetResMgr::SetUdpContext(UdpHandle handle, void* context) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
     return false;
   }
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
+    return false;
+  }
+  socket->set_context(context);
   return true;
 }
 
-bool NetResMgr::TransferAsyncType(LPOVERLAPPED ovlp, DWORD transfer_size) {
-  auto async_buffer = (BaseBuffer*)ovlp;
-  switch (async_buffer->async_type()) {
-  case kAsyncTypeTcpAccept:
+bool NetResMgr::GetUdpContext(UdpHandle handle, void*& context) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
+    return false;
+  }
+  context = socket->context();
+  return true;
+}
+
+bool NetResMgr::UdpSetPacing(UdpHandle handle, int rate, int burst) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
+    return false;
+  }
+  socket->pacer()->SetRate(rate, burst);
+  return true;
+}
+
+bool NetResMgr::UdpGetPacingStats(UdpHandle handle, UdpPacingStats& stats) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
+    return false;
+  }
+  socket->pacer()->GetStats(stats);
+  return true;
+}
+
+bool NetResMgr::UdpJoinGroup(UdpHandle handle, const std::string& group, const std::string& interface_ip, const std::string& source) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
+    return false;
+  }
+  return socket->JoinGroup(group, interface_ip, source);
+}
+
+bool NetResMgr::UdpLeaveGroup(UdpHandle handle, const std::string& group, const std::string& interface_ip, const std::string& source) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
+    return false;
+  }
+  return socket->LeaveGroup(group, interface_ip, source);
+}
+
+bool NetResMgr::UdpSubscribe(const std::weak_ptr<NetInterface>& subscriber, UdpHandle handle) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
+    return false;
+  }
+  if (socket->callback() == subscriber.lock()) {
+    NET_LOG(kError, "subscribe udp handle: %u failed: owner can not subscribe.", handle);
+    return false;
+  }
+  return socket->Subscribe(subscriber);
+}
+
+bool NetResMgr::UdpUnsubscribe(const std::shared_ptr<NetInterface>& subscriber, UdpHandle handle) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  auto socket = GetUdpSocket(handle);
+  if (socket == nullptr) {
+    return false;
+  }
+  return socket->Unsubscribe(subscriber);
+}
+
+bool NetResMgr::RudpCreate(const std::weak_ptr<NetInterface>& callback, UdpHandle udp_handle, const NetEndpoint& peer, unsigned int conv, const RudpConfig& config, RudpHandle& new_handle) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  if (callback.expired() || !peer.valid() || peer.port() <= 0 || !ValidRudpConfig(config)) {
+    NET_LOG(kError, "create rudp handle failed: invalid parameter.");
+    return false;
+  }
+  auto udp_socket = GetUdpSocket(udp_handle);
+  if (udp_socket == nullptr) {
+    return false;
+  }
+  return CreateRudpSession(callback, udp_handle, udp_socket, peer, conv, config, new_handle);
+}
+
+bool NetResMgr::RudpListen(const std::weak_ptr<NetInterface>& callback, UdpHandle udp_handle, const RudpConfig& config) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  if (callback.expired() || !ValidRudpConfig(config)) {
+    NET_LOG(kError, "listen rudp on udp handle: %u failed: invalid parameter.", udp_handle);
+    return false;
+  }
+  auto udp_socket = GetUdpSocket(udp_handle);
+  if (udp_socket == nullptr) {
+    return false;
+  }
+  udp_socket->rudp_mux().Listen(config, callback);
+  return true;
+}
+
+bool NetResMgr::RudpDestroy(RudpHandle handle) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  CloseRudpSession(handle);
+  return true;
+}
+
+// the message is flushed at once instead of waiting for the next interval
+bool NetResMgr::RudpSend(RudpHandle handle, std::unique_ptr<char[]>&& packet, int size) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  if (packet == nullptr || size <= 0) {
+    NET_LOG(kError, "send rudp handle: %u packet failed: invalid parameter.", handle);
+    return false;
+  }
+  auto session = GetRudpSession(handle);
+  if (session == nullptr) {
+    return false;
+  }
+  if (!session->Send(packet.get(), size)) {
+    NET_LOG(kError, "send rudp handle: %u packet failed: message too large.", handle);
+    return false;
+  }
+  FlushRudpSession(handle, session, GetUdpSocket(session->udp_handle()));
+  return true;
+}
+
+bool NetResMgr::RudpGetStats(RudpHandle handle, RudpStats& stats) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  auto session = GetRudpSession(handle);
+  if (session == nullptr) {
+    return false;
+  }
+  session->GetStats(stats);
+  return true;
+}
+
+bool NetResMgr::GetNetStats(NetStats& stats) {
+  stats_.GetStats(stats);
+  return true;
+}
+
+bool NetResMgr::SetLatencyTracking(bool enabled) {
+  latency_.SetEnabled(enabled);
+  return true;
+}
+
+bool NetResMgr::SetLogSink(LogSink&& sink) {
+  SingleNetLogger::GetInstance()->SetSink(std::move(sink));
+  return true;
+}
+
+bool NetResMgr::StartCapture(const CaptureConfig& config) {
+  return capture_.Start(config);
+}
+
+bool NetResMgr::StopCapture() {
+  return capture_.Stop();
+}
+
+bool NetResMgr::GetCaptureStats(CaptureStats& stats) {
+  capture_.GetStats(stats);
+  return true;
+}
+
+// tcp records hold the raw stream, each handle gets its own parser
+bool NetResMgr::ReplayCapture(const std::shared_ptr<NetInterface>& callback, const std::string& path, bool original_speed, CaptureReplayStats& stats) {
+  NetCaptureReader reader;
+  if (!reader.Open(path)) {
+    return false;
+  }
+  stats = CaptureReplayStats();
+  std::unordered_map<unsigned long long, std::unique_ptr<TcpSocket>> streams;
+  NetCaptureEntry entry;
+  auto begin_time = std::chrono::steady_clock::now();
+  while (reader.Next(entry)) {
+    ++stats.records;
+    if (original_speed) {
+      std::this_thread::sleep_until(begin_time + std::chrono::nanoseconds(entry.time_ns));
+    }
+    auto handle = static_cast<unsigned long>(entry.handle);
+    switch (entry.type) {
+    case kCaptureTcpRecv: {
+      auto& stream = streams[entry.handle];
+      if (stream == nullptr) {
+        stream.reset(new TcpSocket());
+      }
+      stats.tcp_bytes += entry.size;
+      if (!stream->OnRecv(entry.data, entry.size)) {
+        ++stats.errors;
+        streams.erase(entry.handle);
+        callback->OnTcpError(handle, nullptr, 3);
+        break;
+      }
+      for (const auto& i : stream->all_packets()) {
+        ++stats.tcp_packets;
+        callback->OnTcpReceived(handle, nullptr, i->packet(), i->size());
+      }
+      break;
+    }
+    case kCaptureTcpDisconnect:
+      ++stats.tcp_disconnects;
+      streams.erase(entry.handle);
+      callback->OnTcpDisconnected(handle, nullptr);
+      break;
+    case kCaptureUdpRecv:
+      ++stats.udp_datagrams;
+      callback->OnUdpReceivedFrom(handle, nullptr, entry.data, entry.size, entry.peer);
+      break;
+    default:
+      ++stats.skipped;
+      break;
+    }
+  }
+  stats.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin_time).count();
+  return true;
+}
+
+bool NetResMgr::GetLatencyStats(NetLatencyStats& stats) {
+  latency_.GetStats(stats);
+  return true;
+}
+
+bool NetResMgr::DumpLatencyStats(std::string& report) {
+  latency_.Dump(report);
+  return true;
+}
+
+bool NetResMgr::TcpGetSocketPoolStats(TcpSocketPoolStats& stats) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  tcp_socket_pool_.GetStats(stats);
+  return true;
+}
+
+bool NetResMgr::TcpPoolCreate(const std::weak_ptr<NetInterface>& callback, const std::string& ip, int port, const TcpPoolConfig& config, TcpPoolHandle& new_handle) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  if (callback.expired()) {
+    NET_LOG(kError, "create tcp pool handle failed: invalid callback parameter.");
+    return false;
+  }
+  if (port <= 0 || config.connections <= 0 || config.min_backoff_ms <= 0 || config.max_backoff_ms < config.min_backoff_ms ||
+    (config.select_policy != kTcpPoolSelectRoundRobin && config.select_policy != kTcpPoolSelectLeastOutstanding)) {
+    NET_LOG(kError, "create tcp pool handle failed: invalid config parameter.");
+    return false;
+  }
+  auto new_pool = std::make_shared<TcpConnPool>(callback, ip, port, config);
+  if (!AddTcpPool(new_pool, new_handle)) {
+    return false;
+  }
+  for (auto i = 0; i < config.connections; ++i) {
+    ConnectTcpPoolSlot(new_handle, new_pool, i);
+  }
+  return true;
+}
+
+bool NetResMgr::TcpPoolDestroy(TcpPoolHandle handle) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  // members close while the pool is still found, a closed pool reschedules none
+  auto pool = GetTcpPool(handle);
+  if (pool == nullptr) {
+    return false;
+  }
+  for (auto i : pool->Close()) {
+    RemoveTcpSocket(i);
+  }
+  RemoveTcpPool(handle);
+  return true;
+}
+
+bool NetResMgr::TcpPoolSend(TcpPoolHandle handle, std::unique_ptr<char[]>&& packet, int size) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  if (packet == nullptr || size <= 0 || size > kMaxTcpPacketSize) {
+    NET_LOG(kError, "send tcp pool handle: %u packet failed: invalid parameter.", handle);
+    return false;
+  }
+  auto pool = GetTcpPool(handle);
+  if (pool == nullptr) {
+    return false;
+  }
+  auto send_handle = kInvalidTcpHandle;
+  std::shared_ptr<TcpSocket> send_socket;
+  if (!pool->SelectSocket(send_handle, send_socket)) {
+    NET_LOG(kError, "send tcp pool handle: %u packet failed: no connected member.", handle);
+    pool->OnSend(false);
+    return false;
+  }
+  auto send_buffer = GetTcpSendBuffer();
+  if (send_buffer == nullptr) {
+    pool->OnSend(false);
+    return false;
+  }
+  send_buffer->set_buffer(std::move(packet), size);
+  auto sent = AsyncTcpSend(send_handle, send_socket, send_buffer);
+  pool->OnSend(sent);
+  return sent;
+}
+
+bool NetResMgr::TcpPoolGetStats(TcpPoolHandle handle, TcpPoolStats& stats) {
+  if (!net_started_) {
+    NET_LOG(kError, "net not started.");
+    return false;
+  }
+  auto pool = GetTcpPool(handle);
+  if (pool == nullptr) {
+    return false;
+  }
+  pool->GetStats(stats);
+  return true;
+}
+
+bool NetResMgr::AddTcpSocket(const std::shared_ptr<TcpSocket>& new_socket, TcpHandle& new_handle) {
+  auto new_index = tcp_indexer_.CreateIndex();
+  if (new_index == utility::kInvalidIndex) {
+    NET_LOG(kError, "fail to new tcp handle: no useful index.");
+    return false;
+  }
+  new_handle = new_index;
+  std::lock_guard<std::mutex> lock(tcp_sockets_lock_);
+  tcp_sockets_.insert(std::make_pair(new_handle, new_socket));
+  return true;
+}
+
+bool NetResMgr::AddUdpSocket(const std::shared_ptr<UdpSocket>& new_socket, TcpHandle& new_handle) {
+  auto new_index = udp_indexer_.CreateIndex();
+  if (new_index == utility::kInvalidIndex) {
+    NET_LOG(kError, "fail to new udp handle: no useful index.");
+    return false;
+  }
+  new_handle = new_index;
+  std::lock_guard<std::mutex> lock(udp_sockets_lock_);
+  udp_sockets_.insert(std::make_pair(new_handle, new_socket));
+  return true;
+}
+
+void NetResMgr::RemoveTcpSocket(TcpHandle handle) {
+  tcp_sockets_lock_.lock();
+  auto socket = tcp_sockets_.find(handle);
+  if (socket != tcp_sockets_.end()) {
+    auto removed_socket = std::move(socket->second);
+    tcp_sockets_.erase(socket);
+    tcp_sockets_lock_.unlock();
+    // accepted and connected streams alike, local and remote closes are not told apart
+    if (capture_.enabled() && removed_socket->connected()) {
+      capture_.Write(kCaptureTcpDisconnect, handle, nullptr, nullptr, 0);
+    }
+    // a recycled socket is disconnected once its pending operations completed
+    if (removed_socket->recyclable()) {
+      removed_socket->CancelIo();
+    }
+    tcp_indexer_.DestroyIndex(handle);
+    if (removed_socket->pool_handle() != kInvalidTcpPoolHandle) {
+      OnTcpPoolClosed(removed_socket->pool_handle(), removed_socket->pool_slot(), handle);
+    }
+  } else {
+    tcp_sockets_lock_.unlock();
+  }
+}
+
+void NetResMgr::RemoveUdpSocket(UdpHandle handle) {
+  udp_sockets_lock_.lock();
+  auto socket = udp_sockets_.find(handle);
+  if (socket != udp_sockets_.end()) {
+    udp_sockets_.erase(socket);
+    udp_sockets_lock_.unlock();
+    udp_indexer_.DestroyIndex(handle);
+  } else {
+    udp_sockets_lock_.unlock();
+  }
+}
+
+std::shared_ptr<TcpSocket> NetResMgr::GetTcpSocket(TcpHandle handle) {
+  std::lock_guard<std::mutex> lock(tcp_sockets_lock_);
+  auto socket = tcp_sockets_.find(handle);
+  if (socket == tcp_sockets_.end()) {
+    NET_LOG(kError, "can not find tcp handle: %u.", handle);
+    return nullptr;
+  }
+  return socket->second;
+}
+
+std::shared_ptr<UdpSocket> NetResMgr::GetUdpSocket(UdpHandle handle) {
+  std::lock_guard<std::mutex> lock(udp_sockets_lock_);
+  auto socket = udp_sockets_.find(handle);
+  if (socket == udp_sockets_.end()) {
+    NET_LOG(kError, "can not find udp handle: %u.", handle);
+    return nullptr;
+  }
+  return socket->second;
+}
+
+// deleter of accepted sockets, runs after the last completion
+void NetResMgr::RecycleTcpSocket(TcpSocket* socket) {
+  std::unique_ptr<TcpSocket> recycle_socket(socket);
+  if (recycle_socket == nullptr) {
+    return;
+  }
+  auto admitted_by = recycle_socket->admitted_by();
+  if (admitted_by != nullptr) {
+    admitted_by->OnConnectionClosed(recycle_socket->admitted_ip());
+  }
+  if (!recycle_socket->recyclable() || !tcp_socket_pool_.opened()) {
+    return;
+  }
+  auto disconnect_buffer = GetTcpDisconnectBuffer();
+  if (disconnect_buffer == nullptr) {
+    tcp_socket_pool_.OnDiscarded();
+    return;
+  }
+  disconnect_buffer->set_socket(std::move(recycle_socket));
+  StampPost(disconnect_buffer);
+  if (!socket->AsyncDisconnect(disconnect_buffer->ovlp())) {
+    tcp_socket_pool_.OnDiscarded();
+    ReturnTcpDisconnectBuffer(disconnect_buffer);
+  }
+}
+
+// admission runs on the address AcceptEx left, rejected or non IPv4 sources are reset
+bool NetResMgr::AdmitTcpSocket(const std::shared_ptr<TcpSocket>& listen_socket, const std::shared_ptr<TcpSocket>& accept_socket, TcpAcceptBuffer* buffer) {
+  SOCKADDR_IN remote_addr = {0};
+  auto listener = listen_socket->listener();
+  if (!listen_socket->GetAcceptRemoteAddr(buffer->buffer(), buffer->buffer_size(), remote_addr)) {
+    NET_LOG(kError, "admit tcp socket failed: no remote address in the accept buffer.");
+    listener->OnAdmitFailed();
+    accept_socket->Abort();
+    return false;
+  }
+  auto remote_ip = remote_addr.sin_addr.s_addr;
+  if (!listener->Admit(remote_ip)) {
+    accept_socket->Abort();
+    return false;
+  }
+  accept_socket->set_admitted(listener, remote_ip);
+  return true;
+}
+
+// shard of the RSS processor, else round-robin; recycled sockets are bound already
+bool NetResMgr::BindAcceptedTcpSocket(const std::shared_ptr<TcpSocket>& listen_socket, const std::shared_ptr<TcpSocket>& accept_socket) {
+  if (accept_socket->inproc()) {
+    return true;
+  }
+  auto listener = listen_socket->listener();
+  auto shard = accept_socket->shard();
+  if (listener->sharded()) {
+    auto group = 0;
+    auto number = 0;
+    auto rss_shard = accept_socket->GetRssProcessor(group, number) ? iocp_.ShardOfProcessor(IOCP::ProcessorIndex(group, number)) : -1;
+    if (rss_shard < 0) {
+      rss_shard = listener->NextShard();
+    }
+    if (!accept_socket->iocp_bound()) {
+      shard = rss_shard;
+    }
+    listener->OnShardAccepted(shard, shard != rss_shard);
+  }
+  if (!accept_socket->iocp_bound()) {
+    if (!listener->sharded()) {
+      shard = iocp_.NextShard();
+    }
+    if (!iocp_.BindToIOCP(accept_socket->socket(), shard)) {
+      return false;
+    }
+    accept_socket->set_iocp_bound(shard);
+  }
+  return true;
+}
+
+// inproc completions go to the socket's own shard like kernel ones
+bool NetResMgr::CreateInprocTcpSocket(const std::shared_ptr<TcpSocket>& socket, const std::weak_ptr<NetInterface>& callback) {
+  auto shard = iocp_.NextShard();
+  auto stream = std::make_shared<InprocStream>([this, shard](LPOVERLAPPED ovlp, DWORD transfer_size) {
+    return iocp_.PostCompletion(ovlp, transfer_size, shard);
+  });
+  if (!socket->CreateInproc(callback, stream)) {
+    return false;
+  }
+  socket->set_iocp_bound(shard);
+  return true;
+}
+
+// a handle registered for a port may have been destroyed and its index reused since
+std::shared_ptr<TcpSocket> NetResMgr::GetInprocListener(TcpHandle handle, int port) {
+  std::lock_guard<std::mutex> lock(tcp_sockets_lock_);
+  auto socket = tcp_sockets_.find(handle);
+  if (socket == tcp_sockets_.end() || !socket->second->inproc() || socket->second->listener() == nullptr) {
+    return nullptr;
+  }
+  std::string ip;
+  auto local_port = 0;
+  socket->second->GetLocalAddr(ip, local_port);
+  return local_port == port ? socket->second : nullptr;
+}
+
+// listeners are found by port, the accept runs on a worker as for AcceptEx
+bool NetResMgr::ConnectInproc(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, int port) {
+  inproc_listeners_lock_.lock();
+  auto listen_handle = kInvalidTcpHandle;
+  auto listener = inproc_listeners_.find(port);
+  if (listener != inproc_listeners_.end()) {
+    listen_handle = listener->second;
+  }
+  inproc_listeners_lock_.unlock();
+  auto listen_socket = GetInprocListener(listen_handle, port);
+  if (listen_socket == nullptr) {
+    NET_LOG(kError, "connect inproc tcp handle: %u failed: no listener on port %d.", handle, port);
+    return false;
+  }
+  auto listen_callback = listen_socket->callback();
+  if (listen_callback == nullptr) {
+    NET_LOG(kError, "connect inproc tcp handle: %u failed: listener callback released.", handle);
+    return false;
+  }
+  std::shared_ptr<TcpSocket> accept_socket(new TcpSocket(), [this](TcpSocket* socket) { RecycleTcpSocket(socket); });
+  if (accept_socket == nullptr || !CreateInprocTcpSocket(accept_socket, listen_callback)) {
+    return false;
+  }
+  std::string ip;
+  auto local_port = 0;
+  listen_socket->GetLocalAddr(ip, local_port);
+  accept_socket->Bind(ip, local_port);
+  InprocStream::Pair(socket->inproc_stream(), accept_socket->inproc_stream());
+  if (!socket->SetConnected()) {
+    return false;
+  }
+  return PostTask([this, listen_handle, listen_socket, accept_socket]() {
+    OnTcpAccept(listen_handle, listen_socket, accept_socket);
+  });
+}
+
+bool NetResMgr::AddTcpPool(const std::shared_ptr<TcpConnPool>& new_pool, TcpPoolHandle& new_handle) {
+  auto new_index = tcp_pool_indexer_.CreateIndex();
+  if (new_index == utility::kInvalidIndex) {
+    NET_LOG(kError, "fail to new tcp pool handle: no useful index.");
+    return false;
+  }
+  new_handle = new_index;
+  std::lock_guard<std::mutex> lock(tcp_pools_lock_);
+  tcp_pools_.insert(std::make_pair(new_handle, new_pool));
+  return true;
+}
+
+std::shared_ptr<TcpConnPool> NetResMgr::RemoveTcpPool(TcpPoolHandle handle) {
+  tcp_pools_lock_.lock();
+  auto pool = tcp_pools_.find(handle);
+  if (pool == tcp_pools_.end()) {
+    tcp_pools_lock_.unlock();
+    return nullptr;
+  }
+  auto removed_pool = std::move(pool->second);
+  tcp_pools_.erase(pool);
+  tcp_pools_lock_.unlock();
+  tcp_pool_indexer_.DestroyIndex(handle);
+  return removed_pool;
+}
+
+std::shared_ptr<TcpConnPool> NetResMgr::GetTcpPool(TcpPoolHandle handle) {
+  std::lock_guard<std::mutex> lock(tcp_pools_lock_);
+  auto pool = tcp_pools_.find(handle);
+  if (pool == tcp_pools_.end()) {
+    NET_LOG(kError, "can not find tcp pool handle: %u.", handle);
+    return nullptr;
+  }
+  return pool->second;
+}
+
+// a failed slot is rescheduled by OnTcpPoolClosed
+void NetResMgr::ConnectTcpPoolSlot(TcpPoolHandle pool_handle, const std::shared_ptr<TcpConnPool>& pool, int slot) {
+  if (pool->closed()) {
+    return;
+  }
+  auto callback = pool->callback();
+  if (callback == nullptr) {
+    NET_LOG(kError, "connect tcp pool handle: %u failed: callback released.", pool_handle);
+    return;
+  }
+  auto connect_handle = kInvalidTcpHandle;
+  if (!TcpCreate(callback, "0.0.0.0", 0, connect_handle)) {
+    RescheduleTcpPoolSlot(pool_handle, pool, slot, kInvalidTcpHandle);
+    return;
+  }
+  auto connect_socket = GetTcpSocket(connect_handle);
+  if (connect_socket == nullptr) {
+    RescheduleTcpPoolSlot(pool_handle, pool, slot, kInvalidTcpHandle);
+    return;
+  }
+  connect_socket->set_pool_slot(pool_handle, slot);
+  if (!pool->OnConnecting(slot, connect_handle)) {
+    RemoveTcpSocket(connect_handle);
+    return;
+  }
+  auto connect_buffer = GetTcpConnectBuffer();
+  if (connect_buffer == nullptr) {
+    RemoveTcpSocket(connect_handle);
+    return;
+  }
+  connect_buffer->set_handle(connect_handle);
+  StampPost(connect_buffer);
+  if (connect_socket->inproc()) {
+    if (!ConnectInproc(connect_handle, connect_socket, pool->port()) || !iocp_.PostCompletion(connect_buffer->ovlp(), 0, connect_socket->shard())) {
+      ReturnTcpConnectBuffer(connect_buffer);
+      RemoveTcpSocket(connect_handle);
+    }
+    return;
+  }
+  if (!connect_socket->AsyncConnect(pool->ip(), pool->port(), connect_buffer->ovlp())) {
+    ReturnTcpConnectBuffer(connect_buffer);
+    RemoveTcpSocket(connect_handle);
+  }
+}
+
+void NetResMgr::OnTcpPoolClosed(TcpPoolHandle pool_handle, int slot, TcpHandle handle) {
+  auto pool = GetTcpPool(pool_handle);
+  if (pool == nullptr) {
+    return;
+  }
+  RescheduleTcpPoolSlot(pool_handle, pool, slot, handle);
+}
+
+// the timer holds the pool weakly, a destroyed pool is not reconnected
+void NetResMgr::RescheduleTcpPoolSlot(TcpPoolHandle pool_handle, const std::shared_ptr<TcpConnPool>& pool, int slot, TcpHandle handle) {
+  auto reconnect_delay = pool->OnClosed(slot, handle);
+  if (reconnect_delay < 0) {
+    return;
+  }
+  std::weak_ptr<TcpConnPool> weak_pool = pool;
+  timer_queue_.Schedule(reconnect_delay, [this, pool_handle, weak_pool, slot]() {
+    auto pool = weak_pool.lock();
+    if (pool != nullptr) {
+      ConnectTcpPoolSlot(pool_handle, pool, slot);
+    }
+  });
+}
+
+bool NetResMgr::ValidRudpConfig(const RudpConfig& config) {
+  return config.mtu > kRudpHeaderSize && config.mtu <= kMaxUdpPacketSize && config.interval_ms > 0 &&
+    config.send_window > 0 && config.recv_window > 0 && config.recv_window <= 0xFFFF && config.min_rto_ms > 0 &&
+    config.fast_resend >= 0 && config.dead_link > 0 && config.pacing_rate >= 0;
+}
+
+bool NetResMgr::CreateRudpSession(const std::weak_ptr<NetInterface>& callback, UdpHandle udp_handle, const std::shared_ptr<UdpSocket>& udp_socket, const NetEndpoint& peer, unsigned int conv, const RudpConfig& config, RudpHandle& new_handle) {
+  auto new_session = std::make_shared<RudpSession>(udp_handle, peer, conv, config);
+  new_session->set_callback(callback);
+  if (!AddRudpSession(new_session, new_handle)) {
+    return false;
+  }
+  if (!udp_socket->rudp_mux().Add(peer, conv, new_handle)) {
+    NET_LOG(kError, "create rudp handle failed: conversation %u with the peer already exists.", conv);
+    RemoveRudpSession(new_handle);
+    return false;
+  }
+  ScheduleRudpFlush(new_handle, config.interval_ms);
+  return true;
+}
+
+bool NetResMgr::AddRudpSession(const std::shared_ptr<RudpSession>& new_session, RudpHandle& new_handle) {
+  auto new_index = rudp_indexer_.CreateIndex();
+  if (new_index == utility::kInvalidIndex) {
+    NET_LOG(kError, "fail to new rudp handle: no useful index.");
+    return false;
+  }
+  new_handle = new_index;
+  std::lock_guard<std::mutex> lock(rudp_sessions_lock_);
+  rudp_sessions_.insert(std::make_pair(new_handle, new_session));
+  return true;
+}
+
+std::shared_ptr<RudpSession> NetResMgr::RemoveRudpSession(RudpHandle handle) {
+  rudp_sessions_lock_.lock();
+  auto session = rudp_sessions_.find(handle);
+  if (session == rudp_sessions_.end()) {
+    rudp_sessions_lock_.unlock();
+    return nullptr;
+  }
+  auto removed_session = std::move(session->second);
+  rudp_sessions_.erase(session);
+  rudp_sessions_lock_.unlock();
+  rudp_indexer_.DestroyIndex(handle);
+  return removed_session;
+}
+
+std::shared_ptr<RudpSession> NetResMgr::GetRudpSession(RudpHandle handle) {
+  auto session = FindRudpSession(handle);
+  if (session == nullptr) {
+    NET_LOG(kError, "can not find rudp handle: %u.", handle);
+  }
+  return session;
+}
+
+// no log, a flush timer still queued for a destroyed session finds nothing
+std::shared_ptr<RudpSession> NetResMgr::FindRudpSession(RudpHandle handle) {
+  std::lock_guard<std::mutex> lock(rudp_sessions_lock_);
+  auto session = rudp_sessions_.find(handle);
+  return session != rudp_sessions_.end() ? session->second : nullptr;
+}
+
+void NetResMgr::CloseRudpSession(RudpHandle handle) {
+  auto session = RemoveRudpSession(handle);
+  if (session == nullptr) {
+    return;
+  }
+  auto udp_socket = GetUdpSocket(session->udp_handle());
+  if (udp_socket != nullptr) {
+    udp_socket->rudp_mux().Remove(session->peer(), session->conv());
+  }
+}
+
+// the flush timer of a session stops once its handle is gone
+void NetResMgr::ScheduleRudpFlush(RudpHandle handle, int delay_ms) {
+  timer_queue_.Schedule(delay_ms, [this, handle]() { OnRudpTimer(handle); });
+}
+
+void NetResMgr::OnRudpTimer(RudpHandle handle) {
+  auto session = FindRudpSession(handle);
+  if (session == nullptr) {
+    return;
+  }
+  if (FlushRudpSession(handle, session, GetUdpSocket(session->udp_handle()))) {
+    ScheduleRudpFlush(handle, session->interval_ms());
+  }
+}
+
+bool NetResMgr::FlushRudpSession(RudpHandle handle, const std::shared_ptr<RudpSession>& session, const std::shared_ptr<UdpSocket>& udp_socket) {
+  if (udp_socket == nullptr) {
+    OnRudpError(handle, session->callback(), 1);
+    return false;
+  }
+  auto output = [&](std::unique_ptr<char[]>&& packet, int size) {
+    AsyncUdpSendTo(session->udp_handle(), udp_socket, std::move(packet), size, session->peer());
+  };
+  if (!session->Flush(output)) {
+    NET_LOG(kError, "rudp handle: %u dead link.", handle);
+    OnRudpError(handle, session->callback(), 1);
+    return false;
+  }
+  return true;
+}
+
+// datagrams of rudp sessions are consumed, the others stay for the udp callbacks
+void NetResMgr::DispatchRudpDatagrams(UdpHandle udp_handle, const std::shared_ptr<UdpSocket>& udp_socket, std::vector<UdpDatagram>& datagrams) {
+  if (!udp_socket->rudp_mux().active()) {
+    return;
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < datagrams.size(); ++i) {
+    if (!OnRudpDatagram(udp_handle, udp_socket, datagrams[i])) {
+      datagrams[kept++] = datagrams[i];
+    }
+  }
+  datagrams.resize(kept);
+}
+
+// an unknown conversation opens a session on a listening handle, acks go out at once
+bool NetResMgr::OnRudpDatagram(UdpHandle udp_handle, const std::shared_ptr<UdpSocket>& udp_socket, const UdpDatagram& datagram) {
+  unsigned int conv = 0;
+  auto cmd = 0;
+  if (!RudpSession::PeekConv(datagram.packet, datagram.size, conv, cmd)) {
+    return false;
+  }
+  auto& mux = udp_socket->rudp_mux();
+  auto handle = mux.Find(datagram.from, conv);
+  if (handle == kInvalidRudpHandle) {
+    RudpConfig config;
+    std::shared_ptr<NetInterface> callback;
+    if (cmd != kRudpCmdPush || !mux.listening(config, callback)) {
+      return false;
+    }
+    if (!CreateRudpSession(callback, udp_handle, udp_socket, datagram.from, conv, config, handle)) {
+      return true;
+    }
+    callback->OnRudpAccepted(udp_handle, handle);
+  }
+  auto session = GetRudpSession(handle);
+  if (session == nullptr) {
+    return true;
+  }
+  if (!session->Input(datagram.packet, datagram.size)) {
+    return true;
+  }
+  FlushRudpSession(handle, session, udp_socket);
+  auto callback = session->callback();
+  if (callback != nullptr) {
+    session->Deliver([&](const char* packet, int size) { callback->OnRudpReceived(handle, packet, size); });
+  }
+  if (session->TakeDroppedMessage()) {
+    NET_LOG(kError, "rudp handle: %u message over %d fragments dropped.", handle, kMaxRudpFragments);
+    OnRudpError(handle, callback, 3);
+  }
+  return true;
+}
+
+void NetResMgr::OnRudpError(RudpHandle handle, const std::shared_ptr<NetInterface>& callback, int error) {
+  stats_.AddError(kNetCounterRudpErrors, error);
+  if (callback != nullptr) {
+    callback->OnRudpError(handle, error);
+  }
+  CloseRudpSession(handle);
+}
+
+bool NetResMgr::PostTask(TimerQueue::Task&& task) {
+  auto task_buffer = GetTaskBuffer();
+  if (task_buffer == nullptr) {
+    return false;
+  }
+  task_buffer->set_task(std::move(task));
+  StampPost(task_buffer);
+  if (!iocp_.PostCompletion(task_buffer->ovlp(), 0)) {
+    ReturnTaskBuffer(task_buffer);
+    return false;
+  }
+  return true;
+}
+
+TcpAcceptBuffer* NetResMgr::GetTcpAcceptBuffer() {
+  auto buffer = new TcpAcceptBuffer;
+  stats_.Add(kNetCounterBuffers + kAsyncTypeTcpAccept, 1);
+  return buffer;
+}
+
+TcpConnectBuffer* NetResMgr::GetTcpConnectBuffer() {
+  auto buffer = new TcpConnectBuffer;
+  stats_.Add(kNetCounterBuffers + kAsyncTypeTcpConnect, 1);
+  return buffer;
+}
+
+TcpDisconnectBuffer* NetResMgr::GetTcpDisconnectBuffer() {
+  auto buffer = new TcpDisconnectBuffer;
+  stats_.Add(kNetCounterBuffers + kAsyncTypeTcpDisconnect, 1);
+  return buffer;
+}
+
+TcpSendBuffer* NetResMgr::GetTcpSendBuffer() {
+  auto buffer = tcp_send_buffers_.Get();
+  stats_.Add(kNetCounterBuffers + kAsyncTypeTcpSend, 1);
+  return buffer;
+}
+
+TcpRecvBuffer* NetResMgr::GetTcpRecvBuffer() {
+  auto buffer = new TcpRecvBuffer;
+  stats_.Add(kNetCounterBuffers + kAsyncTypeTcpRecv, 1);
+  return buffer;
+}
+
+UdpSendBuffer* NetResMgr::GetUdpSendBuffer() {
+  auto buffer = udp_send_buffers_.Get();
+  stats_.Add(kNetCounterBuffers + kAsyncTypeUdpSend, 1);
+  return buffer;
+}
+
+UdpRecvBuffer* NetResMgr::GetUdpRecvBuffer(bool coalesced) {
+  auto buffer = new UdpRecvBuffer(coalesced);
+  stats_.Add(kNetCounterBuffers + kAsyncTypeUdpRecv, 1);
+  return buffer;
+}
+
+TaskBuffer* NetResMgr::GetTaskBuffer() {
+  auto buffer = new TaskBuffer;
+  stats_.Add(kNetCounterBuffers + kAsyncTypeTask, 1);
+  return buffer;
+}
+
+void NetResMgr::ReturnTcpAcceptBuffer(TcpAcceptBuffer* buffer) {
+  if (buffer != nullptr) {
+    delete buffer;
+    stats_.Add(kNetCounterBuffers + kAsyncTypeTcpAccept, -1);
+  }
+}
+
+void NetResMgr::ReturnTcpConnectBuffer(TcpConnectBuffer* buffer) {
+  if (buffer != nullptr) {
+    delete buffer;
+    stats_.Add(kNetCounterBuffers + kAsyncTypeTcpConnect, -1);
+  }
+}
+
+void NetResMgr::ReturnTcpDisconnectBuffer(TcpDisconnectBuffer* buffer) {
+  if (buffer != nullptr) {
+    delete buffer;
+    stats_.Add(kNetCounterBuffers + kAsyncTypeTcpDisconnect, -1);
+  }
+}
+
+void NetResMgr::ReturnTcpSendBuffer(TcpSendBuffer* buffer) {
+  if (buffer != nullptr) {
+    tcp_send_buffers_.Put(buffer);
+    stats_.Add(kNetCounterBuffers + kAsyncTypeTcpSend, -1);
+  }
+}
+
+void NetResMgr::ReturnTcpRecvBuffer(TcpRecvBuffer* buffer) {
+  if (buffer != nullptr) {
+    delete buffer;
+    stats_.Add(kNetCounterBuffers + kAsyncTypeTcpRecv, -1);
+  }
+}
+
+void NetResMgr::ReturnUdpSendBuffer(UdpSendBuffer* buffer) {
+  if (buffer != nullptr) {
+    udp_send_buffers_.Put(buffer);
+    stats_.Add(kNetCounterBuffers + kAsyncTypeUdpSend, -1);
+  }
+}
+
+void NetResMgr::ReturnUdpRecvBuffer(UdpRecvBuffer* buffer) {
+  if (buffer != nullptr) {
+    delete buffer;
+    stats_.Add(kNetCounterBuffers + kAsyncTypeUdpRecv, -1);
+  }
+}
+
+void NetResMgr::ReturnTaskBuffer(TaskBuffer* buffer) {
+  if (buffer != nullptr) {
+    delete buffer;
+    stats_.Add(kNetCounterBuffers + kAsyncTypeTask, -1);
+  }
+}
+
+bool NetResMgr::AsyncTcpAccept(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpAcceptBuffer* buffer) {
+  auto listener = socket->listener();
+  auto accept_socket = listener != nullptr && listener->sharded() ? nullptr : tcp_socket_pool_.Get();
+  if (accept_socket != nullptr) {
+    if (!accept_socket->Reuse(socket->callback())) {
+      ReturnTcpAcceptBuffer(buffer);
+      return false;
+    }
+  } else {
+    accept_socket.reset(new TcpSocket);
+    if (!accept_socket->Create(socket->callback())) {
+      ReturnTcpAcceptBuffer(buffer);
+      return false;
+    }
+    tcp_socket_pool_.OnCreated();
+  }
+  auto async_sock = accept_socket->socket();
+  buffer->set_handle(handle);
+  buffer->set_accept_socket(std::move(accept_socket));
+  StampPost(buffer);
+  if (!socket->AsyncAccept(async_sock, buffer->buffer(), buffer->buffer_size(), buffer->ovlp())) {
+    ReturnTcpAcceptBuffer(buffer);
+    return false;
+  }
+  return true;
+}
+
+// post count accepts, reusing buffer for the first one if it is not null
+bool NetResMgr::PostTcpAccepts(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpAcceptBuffer* buffer, int count) {
+  auto listener = socket->listener();
+  for (auto i = 0; i < count; ++i) {
+    auto accept_buffer = buffer != nullptr ? buffer : GetTcpAcceptBuffer();
+    buffer = nullptr;
+    if (accept_buffer == nullptr || !AsyncTcpAccept(handle, socket, accept_buffer)) {
+      for (auto j = i; j < count; ++j) {
+        listener->OnAcceptPostFailed();
+      }
+      return false;
+    }
+  }
+  if (buffer != nullptr) {
+    ReturnTcpAcceptBuffer(buffer);
+  }
+  return true;
+}
+
+// the given buffer is posted first, the others are new buffers of the same kind
+bool NetResMgr::PostUdpRecvs(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpRecvBuffer* buffer, int count) {
+  return PostUdpRecvs(handle, socket, &buffer, 1, count);
+}
+
+// the given buffers are posted first, new ones make up the rest and unused ones are returned
+bool NetResMgr::PostUdpRecvs(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpRecvBuffer** buffers, int buffer_count, int count) {
+  auto recv_queue = socket->recv_queue();
+  auto coalesced = buffers[0]->coalesced();
+  auto batch = buffers[0]->batch();
+  auto used = 0;
+  auto all_posted = true;
+  for (auto i = 0; i < count; ++i) {
+    auto recv_buffer = i < buffer_count ? buffers[i] : GetUdpRecvBuffer(coalesced);
+    used = i + 1;
+    if (recv_buffer != nullptr) {
+      recv_buffer->set_batch(batch);
+    }
+    if (recv_buffer == nullptr || !AsyncUdpRecv(handle, socket, recv_buffer)) {
+      for (auto j = i; j < count; ++j) {
+        recv_queue->OnRecvPostFailed();
+      }
+      all_posted = false;
+      break;
+    }
+  }
+  for (auto i = used; i < buffer_count; ++i) {
+    ReturnUdpRecvBuffer(buffers[i]);
+  }
+  return all_posted;
+}
+
+// the buffer may be returned once posted, read it before
+bool NetResMgr::AsyncTcpSend(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpSendBuffer* buffer) {
+  buffer->set_handle(handle);
+  buffer->set_socket(socket);
+  buffer->set_pinned_socket(socket->recyclable() ? socket : nullptr);
+  socket->OnSendPosted();
+  stats_.Add(kNetCounterTcpPendingSends, 1);
+  auto size = buffer->buffer_size();
+  StampPost(buffer);
+  if (!socket->AsyncSend(buffer->head(), buffer->buffer(), size, buffer->ovlp())) {
+    socket->OnSendCompleted();
+    stats_.Add(kNetCounterTcpPendingSends, -1);
+    ReturnTcpSendBuffer(buffer);
+    return false;
+  }
+  // the remover may have cancelled before this post
+  if (socket->io_cancelled()) {
+    socket->CancelIo();
+  }
+  socket->OnBytesSent(size);
+  stats_.Add(kNetCounterTcpBytesOut, size);
+  stats_.Add(kNetCounterTcpPacketsOut, 1);
+  return true;
+}
+
+bool NetResMgr::AsyncTcpRecv(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpRecvBuffer* buffer) {
+  buffer->set_handle(handle);
+  buffer->set_pinned_socket(socket->recyclable() ? socket : nullptr);
+  StampPost(buffer);
+  if (!socket->AsyncRecv(buffer->buffer(), buffer->buffer_size(), buffer->ovlp())) {
+    ReturnTcpRecvBuffer(buffer);
+    return false;
+  }
+  if (socket->io_cancelled()) {
+    socket->CancelIo();
+  }
+  return true;
+}
+
+bool NetResMgr::AsyncUdpSendTo(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, SendPayload&& packet, int size, const NetEndpoint& to) {
+  auto send_buffer = GetUdpSendBuffer();
+  if (send_buffer == nullptr) {
+    return false;
+  }
+  send_buffer->set_buffer(std::move(packet), size);
+  send_buffer->set_handle(handle);
+  send_buffer->set_to(to, 0);
+  StampPost(send_buffer);
+  if (!socket->AsyncSendTo(send_buffer->buffer(), send_buffer->buffer_size(), to, send_buffer->ovlp())) {
+    ReturnUdpSendBuffer(send_buffer);
+    return false;
+  }
+  stats_.Add(kNetCounterUdpDatagramsOut, 1);
+  stats_.Add(kNetCounterUdpBytesOut, size);
+  return true;
+}
+
+bool NetResMgr::AsyncUdpSend(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, SendPayload&& packet, int size) {
+  auto send_buffer = GetUdpSendBuffer();
+  if (send_buffer == nullptr) {
+    return false;
+  }
+  send_buffer->set_buffer(std::move(packet), size);
+  send_buffer->set_handle(handle);
+  StampPost(send_buffer);
+  if (!socket->AsyncSend(send_buffer->buffer(), send_buffer->buffer_size(), send_buffer->ovlp())) {
+    ReturnUdpSendBuffer(send_buffer);
+    return false;
+  }
+  stats_.Add(kNetCounterUdpDatagramsOut, 1);
+  stats_.Add(kNetCounterUdpBytesOut, size);
+  return true;
+}
+
+// without offload each segment is a slice of one payload, any failed segment fails the send
+bool NetResMgr::AsyncUdpSendSegments(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, SendPayload&& packet, int size, int segment_size, const NetEndpoint& to) {
+  if (socket->send_segmentation()) {
+    auto send_buffer = GetUdpSendBuffer();
+    if (send_buffer == nullptr) {
+      return false;
+    }
+    send_buffer->set_buffer(std::move(packet), size);
+    send_buffer->set_handle(handle);
+    send_buffer->set_to(to, segment_size);
+    StampPost(send_buffer);
+    if (!socket->AsyncSendSegments(send_buffer->buffer(), size, segment_size, to, send_buffer->ovlp())) {
+      ReturnUdpSendBuffer(send_buffer);
+      return false;
+    }
+    stats_.Add(kNetCounterUdpDatagramsOut, (size + segment_size - 1) / segment_size);
+    stats_.Add(kNetCounterUdpBytesOut, size);
+    return true;
+  }
+  auto whole = std::make_shared<SendPayload>(std::move(packet));
+  auto failed = 0;
+  for (auto offset = 0; offset < size; offset += segment_size) {
+    auto segment_length = size - offset < segment_size ? size - offset : segment_size;
+    if (!AsyncUdpSendTo(handle, socket, SendPayload(whole, offset), segment_length, to)) {
+      ++failed;
+    }
+  }
+  if (failed > 0) {
+    NET_LOG(kError, "send udp handle: %u segments failed: %d of %d not posted.", handle, failed, (size + segment_size - 1) / segment_size);
+    return false;
+  }
+  return true;
+}
+
+// a datagram over the rate is queued and sent by the pacer timer, it then counts as sent
+bool NetResMgr::PaceUdpSend(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpPacer::Datagram&& datagram) {
+  auto pacer = socket->pacer();
+  if (!pacer->enabled()) {
+    return SendUdpDatagram(handle, socket, std::move(datagram));
+  }
+  auto send_now = false;
+  auto timer_ms = -1;
+  if (!pacer->Pace(datagram, send_now, timer_ms)) {
+    NET_LOG(kError, "send udp handle: %u packet failed: pacing queue full.", handle);
+    return false;
+  }
+  if (timer_ms >= 0) {
+    ScheduleUdpPacer(handle, pacer, timer_ms);
+  }
+  return send_now ? SendUdpDatagram(handle, socket, std::move(datagram)) : true;
+}
+
+bool NetResMgr::SendUdpDatagram(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpPacer::Datagram&& datagram) {
+  if (!datagram.to.valid()) {
+    return AsyncUdpSend(handle, socket, std::move(datagram.packet), datagram.size);
+  }
+  if (datagram.segment_size > 0) {
+    return AsyncUdpSendSegments(handle, socket, std::move(datagram.packet), datagram.size, datagram.segment_size, datagram.to);
+  }
+  return AsyncUdpSendTo(handle, socket, std::move(datagram.packet), datagram.size, datagram.to);
+}
+
+void NetResMgr::ScheduleUdpPacer(UdpHandle handle, const std::weak_ptr<UdpPacer>& pacer, int delay_ms) {
+  timer_queue_.Schedule(delay_ms, [this, handle, pacer]() { OnUdpPacerTimer(handle, pacer); });
+}
+
+// the pacer is checked against the socket, a reused handle must not drain another pacer
+void NetResMgr::OnUdpPacerTimer(UdpHandle handle, const std::weak_ptr<UdpPacer>& pacer) {
+  auto udp_pacer = pacer.lock();
+  auto socket = GetUdpSocket(handle);
+  if (udp_pacer == nullptr || socket == nullptr || socket->pacer() != udp_pacer) {
+    return;
+  }
+  std::vector<UdpPacer::Datagram> ready;
+  auto timer_ms = udp_pacer->Drain(ready);
+  for (auto& i : ready) {
+    SendUdpDatagram(handle, socket, std::move(i));
+  }
+  if (timer_ms >= 0) {
+    ScheduleUdpPacer(handle, udp_pacer, timer_ms);
+  }
+}
+
+bool NetResMgr::AsyncUdpRecv(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpRecvBuffer* buffer) {
+  buffer->set_handle(handle);
+  StampPost(buffer);
+  auto posted = buffer->coalesced() ? socket->AsyncRecvMsg(buffer->msg(), buffer->ovlp()) :
+    socket->AsyncRecvFrom(buffer->buffer(), buffer->buffer_size(), buffer->from_addr(), buffer->addr_size(), buffer->ovlp());
+  if (!posted) {
+    ReturnUdpRecvBuffer(buffer);
+    return false;
+  }
+  return true;
+}
+
+// udp receives are handled per handle after the rest, type and post time are read first
+bool NetResMgr::TransferAsyncTypes(LPOVERLAPPED_ENTRY entries, ULONG count) {
+  UdpRecvBuffer* udp_buffers[kMaxDequeueEntries];
+  int udp_sizes[kMaxDequeueEntries];
+  auto udp_count = 0;
+  auto tracking = latency_.enabled();
+  auto dequeue_time = tracking ? NetLatency::Now() : 0;
+  for (ULONG i = 0; i < count; ++i) {
+    auto async_buffer = (BaseBuffer*)entries[i].lpOverlapped;
+    auto async_type = async_buffer->async_type();
+    stats_.Add(kNetCounterCompletions + async_type, 1);
+    if (tracking) {
+      latency_.Record(kLatencyPostToCompletion, async_type, async_buffer->post_time(), dequeue_time);
+    }
+    if (async_type == kAsyncTypeUdpRecv) {
+      udp_buffers[udp_count] = (UdpRecvBuffer*)async_buffer;
+      udp_sizes[udp_count] = entries[i].dwNumberOfBytesTransferred;
+      ++udp_count;
+      continue;
+    }
+    if (!tracking) {
+      TransferAsyncType(entries[i].lpOverlapped, entries[i].dwNumberOfBytesTransferred);
+      continue;
+    }
+    auto begin_time = NetLatency::Now();
+    latency_.Record(kLatencyCompletionToCallback, async_type, dequeue_time, begin_time);
+    TransferAsyncType(entries[i].lpOverlapped, entries[i].dwNumberOfBytesTransferred);
+    latency_.Record(kLatencyCallback, async_type, begin_time, NetLatency::Now());
+  }
+  if (udp_count > 0) {
+    auto begin_time = tracking ? NetLatency::Now() : 0;
+    for (auto i = 0; tracking && i < udp_count; ++i) {
+      latency_.Record(kLatencyCompletionToCallback, kAsyncTypeUdpRecv, dequeue_time, begin_time);
+    }
+    OnUdpRecvs(udp_buffers, udp_sizes, udp_count);
+    if (tracking) {
+      latency_.Record(kLatencyCallback, kAsyncTypeUdpRecv, begin_time, NetLatency::Now());
+    }
+  }
+  return true;
+}
+
+// sends are captured on completion with the time they were posted
+void NetResMgr::StampPost(BaseBuffer* buffer) {
+  buffer->set_post_time(latency_.enabled() || capture_.enabled() ? NetLatency::Now() : 0);
+}
+
+bool NetResMgr::TransferAsyncType(LPOVERLAPPED ovlp, DWORD transfer_size) {
+  auto async_buffer = (BaseBuffer*)ovlp;
+  switch (async_buffer->async_type()) {
+  case kAsyncTypeTcpAccept:
     return OnTcpAccept((TcpAcceptBuffer*)async_buffer);
   case kAsyncTypeTcpSend:
     return OnTcpSend((TcpSendBuffer*)async_buffer);
@@ -443,29 +1827,111 @@ bool NetResMgr::TransferAsyncType(LPOVERLAPPED ovlp, DWORD transfer_size) {
     return OnUdpSend((UdpSendBuffer*)async_buffer);
   case kAsyncTypeUdpRecv:
     return OnUdpRecv((UdpRecvBuffer*)async_buffer, transfer_size);
+  case kAsyncTypeTcpConnect:
+    return OnTcpConnect((TcpConnectBuffer*)async_buffer);
+  case kAsyncTypeTask:
+    return OnTask((TaskBuffer*)async_buffer);
+  case kAsyncTypeTcpDisconnect:
+    return OnTcpDisconnect((TcpDisconnectBuffer*)async_buffer);
   default:
     return false;
   }
 }
 
+// refill the accept queue before the accepted socket is handed out
 bool NetResMgr::OnTcpAccept(TcpAcceptBuffer* buffer) {
-  std::shared_ptr<TcpSocket> accept_socket(buffer->accept_socket());
+  std::shared_ptr<TcpSocket> accept_socket(buffer->accept_socket().release(), [this](TcpSocket* socket) { RecycleTcpSocket(socket); });
   auto listen_handle = buffer->handle();
   auto listen_socket = GetTcpSocket(listen_handle);
   if (listen_socket == nullptr) {
     ReturnTcpAcceptBuffer(buffer);
     return true;
   }
-  OnTcpAccept(listen_handle, listen_socket, accept_socket);
+  auto error = 0;
+  auto accepted = listen_socket->GetAsyncResult(buffer->ovlp(), error);
+  auto admitted = accepted && AdmitTcpSocket(listen_socket, accept_socket, buffer);
+  auto post_count = listen_socket->listener()->OnAcceptCompleted(accepted);
   buffer->ResetBuffer();
-  if (!AsyncTcpAccept(listen_handle, listen_socket, buffer)) {
-    OnTcpError(listen_handle, listen_socket->callback(), 1);
+  auto posted = PostTcpAccepts(listen_handle, listen_socket, buffer, post_count);
+  if (admitted) {
+    OnTcpAccept(listen_handle, listen_socket, accept_socket);
+  }
+  // hand out the accepted connection before reporting the failed refill
+  if (!posted) {
+    NET_LOG(kError, "tcp handle %u refill accepts failed, %d accepts pending.", listen_handle, listen_socket->listener()->pending_accepts());
+    OnTcpError(listen_handle, listen_socket, listen_socket->callback(), 1);
     return false;
   }
   return true;
 }
 
+bool NetResMgr::OnTcpConnect(TcpConnectBuffer* buffer) {
+  auto connect_handle = buffer->handle();
+  auto connect_socket = GetTcpSocket(connect_handle);
+  if (connect_socket == nullptr) {
+    ReturnTcpConnectBuffer(buffer);
+    return true;
+  }
+  auto error = 0;
+  auto connected = connect_socket->GetAsyncResult(buffer->ovlp(), error);
+  ReturnTcpConnectBuffer(buffer);
+  if (!connected) {
+    NET_LOG(kError, "tcp handle %u connect failed, error code: %d.", connect_handle, error);
+    RemoveTcpSocket(connect_handle);
+    return true;
+  }
+  if (!connect_socket->SetConnected()) {
+    RemoveTcpSocket(connect_handle);
+    return false;
+  }
+  stats_.Add(kNetCounterTcpConnected, 1);
+  auto callback = connect_socket->callback();
+  auto pool_handle = connect_socket->pool_handle();
+  if (pool_handle != kInvalidTcpPoolHandle) {
+    auto pool = GetTcpPool(pool_handle);
+    if (pool == nullptr || !pool->OnConnected(connect_socket->pool_slot(), connect_handle, connect_socket)) {
+      RemoveTcpSocket(connect_handle);
+      return true;
+    }
+    if (callback != nullptr) {
+      DispatchTcpCallback(connect_socket, [callback, pool_handle, connect_handle]() { callback->OnTcpPoolConnected(pool_handle, connect_handle); });
+    }
+  }
+  auto recv_buffer = GetTcpRecvBuffer();
+  if (recv_buffer == nullptr) {
+    OnTcpError(connect_handle, connect_socket, callback, 2);
+    return false;
+  }
+  if (!AsyncTcpRecv(connect_handle, connect_socket, recv_buffer)) {
+    OnTcpError(connect_handle, connect_socket, callback, 4);
+    return false;
+  }
+  return true;
+}
+
+bool NetResMgr::OnTcpDisconnect(TcpDisconnectBuffer* buffer) {
+  auto disconnect_socket = buffer->socket();
+  auto error = 0;
+  auto disconnected = disconnect_socket->GetAsyncResult(buffer->ovlp(), error);
+  ReturnTcpDisconnectBuffer(buffer);
+  if (!disconnected) {
+    tcp_socket_pool_.OnDiscarded();
+    return true;
+  }
+  disconnect_socket->Recycle();
+  tcp_socket_pool_.Put(std::move(disconnect_socket));
+  return true;
+}
+
 bool NetResMgr::OnTcpSend(TcpSendBuffer* buffer) {
+  if (capture_.enabled() && buffer->post_time() != 0) {
+    capture_.WriteAt(buffer->post_time(), kCaptureTcpSend, buffer->handle(), nullptr, reinterpret_cast<const char*>(buffer->head()), kTcpHeadSize, buffer->buffer(), buffer->buffer_size());
+  }
+  auto send_socket = buffer->socket();
+  if (send_socket != nullptr) {
+    send_socket->OnSendCompleted();
+    stats_.Add(kNetCounterTcpPendingSends, -1);
+  }
   ReturnTcpSendBuffer(buffer);
   return true;
 }
@@ -478,10 +1944,15 @@ bool NetResMgr::OnTcpRecv(TcpRecvBuffer* buffer, int size) {
     return true;
   }
   auto callback = recv_socket->callback();
+  if (capture_.enabled() && size > 0) {
+    capture_.Write(kCaptureTcpRecv, recv_handle, nullptr, buffer->buffer(), size);
+  }
   if (size == 0) {
     ReturnTcpRecvBuffer(buffer);
+    stats_.Add(kNetCounterTcpDisconnected, 1);
     if (callback != nullptr) {
-      callback->OnTcpDisconnected(recv_handle);
+      auto context = recv_socket->context();
+      DispatchTcpCallback(recv_socket, [callback, recv_handle, context]() { callback->OnTcpDisconnected(recv_handle, context); });
     }
     RemoveTcpSocket(recv_handle);
     return true;
@@ -489,46 +1960,164 @@ bool NetResMgr::OnTcpRecv(TcpRecvBuffer* buffer, int size) {
   auto recv_buff = buffer->buffer();
   if (!recv_socket->OnRecv(recv_buff, size)) {
     ReturnTcpRecvBuffer(buffer);
-    OnTcpError(recv_handle, callback, 3);
+    OnTcpError(recv_handle, recv_socket, callback, 3);
     return false;
   }
   auto all_packets = recv_socket->all_packets();
-  if (callback != nullptr) {
+  stats_.Add(kNetCounterTcpBytesIn, size);
+  stats_.Add(kNetCounterTcpPacketsIn, all_packets.size());
+  auto context = recv_socket->context();
+  if (callback != nullptr && callback_strands_) {
+    // the recv buffer may be reposted before the task runs
+    for (auto& i : all_packets) {
+      i->Detach();
+    }
+    auto packets = std::make_shared<std::vector<std::unique_ptr<RecvPacket>>>(std::move(all_packets));
+    recv_socket->strand().Post([callback, recv_handle, context, packets]() {
+      for (const auto& i : *packets) {
+        callback->OnTcpReceived(recv_handle, context, i->packet(), i->size());
+      }
+    });
+  } else if (callback != nullptr) {
     for (const auto& i : all_packets) {
-      callback->OnTcpReceived(recv_handle, i->packet(), i->size());
+      callback->OnTcpReceived(recv_handle, context, i->packet(), i->size());
     }
   }
   buffer->ResetBuffer();
   if (!AsyncTcpRecv(recv_handle, recv_socket, buffer)) {
-    OnTcpError(recv_handle, callback, 4);
+    OnTcpError(recv_handle, recv_socket, callback, 4);
     return false;
   }
   return true;
 }
 
 bool NetResMgr::OnUdpSend(UdpSendBuffer* buffer) {
+  if (capture_.enabled() && buffer->post_time() != 0) {
+    auto size = buffer->buffer_size();
+    auto segment_size = buffer->segment_size() > 0 ? buffer->segment_size() : size;
+    auto offset = 0;
+    do {
+      capture_.WriteAt(buffer->post_time(), kCaptureUdpSend, buffer->handle(), &buffer->to(), nullptr, 0, buffer->buffer() + offset, std::min(size - offset, segment_size));
+      offset += segment_size;
+    } while (offset < size);
+  }
   ReturnUdpSendBuffer(buffer);
   return true;
 }
 
 bool NetResMgr::OnUdpRecv(UdpRecvBuffer* buffer, int size) {
-  auto recv_handle = buffer->handle();
-  auto recv_socket = GetUdpSocket(recv_handle);
-  if (recv_socket != nullptr) {
-    ReturnUdpRecvBuffer(buffer);
-    return true;
+  return OnUdpRecvs(&buffer, &size, 1);
+}
+
+// grouped by handle, a batch handle gets its group in one callback
+bool NetResMgr::OnUdpRecvs(UdpRecvBuffer** buffers, int* sizes, int count) {
+  thread_local std::vector<UdpDatagram> datagrams;
+  UdpRecvBuffer* group[kMaxDequeueEntries];
+  for (auto i = 0; i < count; ++i) {
+    if (buffers[i] == nullptr) {
+      continue;
+    }
+    auto recv_handle = buffers[i]->handle();
+    auto batch = buffers[i]->batch();
+    auto recv_socket = GetUdpSocket(recv_handle);
+    auto callback = recv_socket != nullptr ? recv_socket->callback() : nullptr;
+    auto group_count = 0;
+    datagrams.clear();
+    for (auto j = i; j < count; ++j) {
+      if (buffers[j] == nullptr || buffers[j]->handle() != recv_handle) {
+        continue;
+      }
+      if (recv_socket != nullptr) {
+        AppendUdpDatagrams(buffers[j], sizes[j], datagrams);
+        if (!batch) {
+          DispatchRudpDatagrams(recv_handle, recv_socket, datagrams);
+          NotifyUdpDatagrams(recv_handle, recv_socket, callback, datagrams, false);
+          datagrams.clear();
+        }
+      }
+      group[group_count++] = buffers[j];
+      buffers[j] = nullptr;
+    }
+    if (recv_socket == nullptr) {
+      for (auto j = 0; j < group_count; ++j) {
+        ReturnUdpRecvBuffer(group[j]);
+      }
+      continue;
+    }
+    if (batch) {
+      DispatchRudpDatagrams(recv_handle, recv_socket, datagrams);
+      NotifyUdpDatagrams(recv_handle, recv_socket, callback, datagrams, true);
+    }
+    for (auto j = 0; j < group_count; ++j) {
+      group[j]->ResetBuffer();
+    }
+    if (!PostUdpRecvs(recv_handle, recv_socket, group, group_count, recv_socket->recv_queue()->OnRecvCompleted(group_count))) {
+      OnUdpError(recv_handle, recv_socket, callback, 1);
+    }
   }
-  std::string ip;
-  int port = 0;
-  utility::FromSockAddr(*buffer->from_addr(), ip, port);
-  auto callback = recv_socket->callback();
+  return true;
+}
+
+// a coalesced receive is split into datagrams of coalesced_size bytes
+void NetResMgr::AppendUdpDatagrams(UdpRecvBuffer* buffer, int size, std::vector<UdpDatagram>& datagrams) {
+  if (size <= 0) {
+    return;
+  }
+  UdpDatagram datagram;
+  datagram.from.Assign(buffer->from_addr(), buffer->coalesced() ? buffer->msg()->namelen : *buffer->addr_size());
+  auto segment_size = buffer->coalesced_size();
+  if (segment_size <= 0) {
+    segment_size = size;
+  }
+  for (auto offset = 0; offset < size; offset += segment_size) {
+    datagram.packet = buffer->buffer() + offset;
+    datagram.size = size - offset < segment_size ? size - offset : segment_size;
+    datagrams.push_back(datagram);
+    if (capture_.enabled()) {
+      capture_.Write(kCaptureUdpRecv, buffer->handle(), &datagram.from, datagram.packet, datagram.size);
+    }
+    stats_.Add(kNetCounterUdpDatagramsIn, 1);
+  }
+  stats_.Add(kNetCounterUdpBytesIn, size);
+}
+
+// owner and subscribers share the receive buffer, reposted after all returned
+void NetResMgr::NotifyUdpDatagrams(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, const std::shared_ptr<NetInterface>& callback, const std::vector<UdpDatagram>& datagrams, bool batch) {
+  if (datagrams.empty()) {
+    return;
+  }
+  auto notify = [&](const std::shared_ptr<NetInterface>& consumer, void* context) {
+    if (batch) {
+      consumer->OnUdpBatchReceived(handle, context, datagrams.data(), static_cast<int>(datagrams.size()));
+      return;
+    }
+    for (auto& i : datagrams) {
+      consumer->OnUdpReceivedFrom(handle, context, i.packet, i.size, i.from);
+    }
+  };
   if (callback != nullptr) {
-    callback->OnUdpReceived(recv_handle, buffer->buffer(), size, ip, port);
+    notify(callback, socket->context());
   }
-  buffer->ResetBuffer();
-  if (!AsyncUdpRecv(recv_handle, recv_socket, buffer)) {
-    OnUdpError(recv_handle, callback, 1);
-    return false;
+  if (!socket->fan_out()) {
+    return;
+  }
+  auto subscribers = socket->subscribers();
+  if (subscribers == nullptr) {
+    return;
+  }
+  for (auto& i : *subscribers) {
+    auto subscriber = i.lock();
+    if (subscriber != nullptr) {
+      notify(subscriber, nullptr);
+    }
+  }
+}
+
+bool NetResMgr::OnTask(TaskBuffer* buffer) {
+  auto task = buffer->task();
+  ReturnTaskBuffer(buffer);
+  if (task != nullptr) {
+    task();
   }
   return true;
 }
@@ -542,38 +2131,59 @@ bool NetResMgr::OnTcpAccept(TcpHandle listen_handle, const std::shared_ptr<TcpSo
     RemoveTcpSocket(accept_handle);
     return false;
   }
-  if (!iocp_.BindToIOCP(accept_socket->socket())) {
+  if (!BindAcceptedTcpSocket(listen_socket, accept_socket)) {
     RemoveTcpSocket(accept_handle);
     return false;
   }
+  accept_socket->set_recyclable(listen_socket->listener()->recycle_sockets() && !listen_socket->listener()->sharded() && !accept_socket->inproc());
+  stats_.Add(kNetCounterTcpAccepted, 1);
   auto callback = accept_socket->callback();
-  if (callback != nullptr) {
+  if (callback != nullptr && callback_strands_) {
+    // the new connection's strand is held until OnTcpAccepted is done
+    accept_socket->strand().TryAcquire();
+    listen_socket->strand().Post([callback, listen_handle, accept_handle, accept_socket]() {
+      callback->OnTcpAccepted(listen_handle, accept_handle);
+      accept_socket->strand().Release();
+    });
+  } else if (callback != nullptr) {
     callback->OnTcpAccepted(listen_handle, accept_handle);
   }
   auto recv_buffer = GetTcpRecvBuffer();
   if (recv_buffer == nullptr) {
-    OnTcpError(accept_handle, callback, 2);
+    OnTcpError(accept_handle, accept_socket, callback, 2);
     return false;
   }
   if (!AsyncTcpRecv(accept_handle, accept_socket, recv_buffer)) {
-    OnTcpError(accept_handle, callback, 4);
+    OnTcpError(accept_handle, accept_socket, callback, 4);
     return false;
   }
   return true;
 }
 
-void NetResMgr::OnTcpError(TcpHandle handle, const std::shared_ptr<NetInterface>& callback, int error) {
-  LOG(kError, "tcp handle %u error: %d.", handle, error);
+void NetResMgr::OnTcpError(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, const std::shared_ptr<NetInterface>& callback, int error) {
+  NET_LOG(kError, "tcp handle %u error: %d.", handle, error);
+  stats_.AddError(kNetCounterTcpErrors, error);
   if (callback != nullptr) {
-    callback->OnTcpError(handle, error);
+    auto context = socket != nullptr ? socket->context() : nullptr;
+    DispatchTcpCallback(socket, [callback, handle, context, error]() { callback->OnTcpError(handle, context, error); });
   }
   RemoveTcpSocket(handle);
 }
 
-void NetResMgr::OnUdpError(UdpHandle handle, const std::shared_ptr<NetInterface>& callback, int error) {
-  LOG(kError, "udp handle %u error: %d.", handle, error);
+// with strands the callback may run later, tasks own what they pass
+void NetResMgr::DispatchTcpCallback(const std::shared_ptr<TcpSocket>& socket, NetStrand::Task&& task) {
+  if (!callback_strands_ || socket == nullptr) {
+    task();
+    return;
+  }
+  socket->strand().Post(std::move(task));
+}
+
+void NetResMgr::OnUdpError(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, const std::shared_ptr<NetInterface>& callback, int error) {
+  NET_LOG(kError, "udp handle %u error: %d.", handle, error);
+  stats_.AddError(kNetCounterUdpErrors, error);
   if (callback != nullptr) {
-    callback->OnUdpError(handle, error);
+    callback->OnUdpError(handle, socket->context(), error);
   }
   RemoveUdpSocket(handle);
 }
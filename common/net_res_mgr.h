@@ -3,13 +3,27 @@
 
 #include "indexer.h"
 #include "iocp.h"
+#include "net_capture.h"
 #include "net_interface.h"
+#include "net_latency.h"
+#include "net_stats.h"
+#include "rudp_session.h"
+#include "send_buffer_pool.h"
+#include "send_payload.h"
+#include "task_buffer.h"
 #include "tcp_buffer.h"
+#include "tcp_conn_pool.h"
+#include "tcp_listener.h"
 #include "tcp_socket.h"
+#include "tcp_socket_pool.h"
+#include "timer_queue.h"
 #include "udp_buffer.h"
+#include "udp_pacer.h"
+#include "udp_recv_queue.h"
 #include "udp_socket.h"
 #include "singleton.h"
 #include "uncopyable.h"
+#include <atomic>
 #include <unordered_map>
 
 namespace net {
@@ -19,18 +33,58 @@ class NetResMgr : public utility::Uncopyable {
   NetResMgr();
   ~NetResMgr();
 
-  bool StartupNet();
+  bool StartupNet(const NetConfig& config);
   bool CleanupNet();
+  bool IsWorkerThread() const { return iocp_.IsWorkerThread(); }
   bool TcpCreate(const std::weak_ptr<NetInterface>& callback, const std::string& ip, int port, TcpHandle& new_handle);
   bool TcpDestroy(TcpHandle handle);
-  bool TcpListen(TcpHandle handle);
+  bool TcpListen(TcpHandle handle, const TcpListenConfig& config);
+  bool TcpGetListenStats(TcpHandle handle, TcpListenStats& stats);
+  bool TcpGetSocketPoolStats(TcpSocketPoolStats& stats);
+  bool GetNetStats(NetStats& stats);
+  bool SetLatencyTracking(bool enabled);
+  bool GetLatencyStats(NetLatencyStats& stats);
+  bool DumpLatencyStats(std::string& report);
+  bool SetLogSink(LogSink&& sink);
+  bool StartCapture(const CaptureConfig& config);
+  bool StopCapture();
+  bool GetCaptureStats(CaptureStats& stats);
+  bool ReplayCapture(const std::shared_ptr<NetInterface>& callback, const std::string& path, bool original_speed, CaptureReplayStats& stats);
   bool TcpConnect(TcpHandle handle, const std::string& ip, int port);
-  bool TcpSend(TcpHandle handle, std::unique_ptr<char[]>&& packet, int size);
+  bool TcpSend(TcpHandle handle, SendPayload&& packet, int size);
   bool TcpGetLocalAddr(TcpHandle handle, char ip[16], int& port);
   bool TcpGetRemoteAddr(TcpHandle handle, char ip[16], int& port);
-  bool UdpCreate(const std::weak_ptr<NetInterface>& callback, const std::string& ip, int port, UdpHandle& new_handle);
+  bool TcpGetStats(TcpHandle handle, TcpStats& stats);
+  bool SetTcpContext(TcpHandle handle, void* context);
+  bool GetTcpContext(TcpHandle handle, void*& context);
+  bool UdpCreate(const std::weak_ptr<NetInterface>& callback, const std::string& ip, int port, const UdpConfig& config, UdpHandle& new_handle);
   bool UdpDestroy(UdpHandle handle);
   bool UdpSendTo(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, const std::string& ip, int port);
+  bool UdpSendTo(UdpHandle handle, SendPayload&& packet, int size, const NetEndpoint& to);
+  bool UdpSendToBatch(UdpHandle handle, std::vector<UdpSendItem>&& items);
+  bool UdpSendSegments(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, int segment_size, const std::string& ip, int port);
+  bool UdpSendSegments(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, int segment_size, const NetEndpoint& to);
+  bool UdpConnect(UdpHandle handle, const NetEndpoint& peer);
+  bool UdpSend(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size);
+  bool UdpGetOffloadInfo(UdpHandle handle, UdpOffloadInfo& info);
+  bool UdpGetRecvStats(UdpHandle handle, UdpRecvStats& stats);
+  bool SetUdpContext(UdpHandle handle, void* context);
+  bool GetUdpContext(UdpHandle handle, void*& context);
+  bool UdpSetPacing(UdpHandle handle, int rate, int burst);
+  bool UdpGetPacingStats(UdpHandle handle, UdpPacingStats& stats);
+  bool UdpJoinGroup(UdpHandle handle, const std::string& group, const std::string& interface_ip, const std::string& source);
+  bool UdpLeaveGroup(UdpHandle handle, const std::string& group, const std::string& interface_ip, const std::string& source);
+  bool UdpSubscribe(const std::weak_ptr<NetInterface>& subscriber, UdpHandle handle);
+  bool UdpUnsubscribe(const std::shared_ptr<NetInterface>& subscriber, UdpHandle handle);
+  bool RudpCreate(const std::weak_ptr<NetInterface>& callback, UdpHandle udp_handle, const NetEndpoint& peer, unsigned int conv, const RudpConfig& config, RudpHandle& new_handle);
+  bool RudpListen(const std::weak_ptr<NetInterface>& callback, UdpHandle udp_handle, const RudpConfig& config);
+  bool RudpDestroy(RudpHandle handle);
+  bool RudpSend(RudpHandle handle, std::unique_ptr<char[]>&& packet, int size);
+  bool RudpGetStats(RudpHandle handle, RudpStats& stats);
+  bool TcpPoolCreate(const std::weak_ptr<NetInterface>& callback, const std::string& ip, int port, const TcpPoolConfig& config, TcpPoolHandle& new_handle);
+  bool TcpPoolDestroy(TcpPoolHandle handle);
+  bool TcpPoolSend(TcpPoolHandle handle, std::unique_ptr<char[]>&& packet, int size);
+  bool TcpPoolGetStats(TcpPoolHandle handle, TcpPoolStats& stats);
 
  private:
   bool AddTcpSocket(const std::shared_ptr<TcpSocket>& new_socket, TcpHandle& new_handle);
@@ -39,42 +93,113 @@ class NetResMgr : public utility::Uncopyable {
   void RemoveUdpSocket(UdpHandle handle);
   std::shared_ptr<TcpSocket> GetTcpSocket(TcpHandle handle);
   std::shared_ptr<UdpSocket> GetUdpSocket(UdpHandle handle);
+  void RecycleTcpSocket(TcpSocket* socket);
+  bool AdmitTcpSocket(const std::shared_ptr<TcpSocket>& listen_socket, const std::shared_ptr<TcpSocket>& accept_socket, TcpAcceptBuffer* buffer);
+  bool BindAcceptedTcpSocket(const std::shared_ptr<TcpSocket>& listen_socket, const std::shared_ptr<TcpSocket>& accept_socket);
+  bool CreateInprocTcpSocket(const std::shared_ptr<TcpSocket>& socket, const std::weak_ptr<NetInterface>& callback);
+  std::shared_ptr<TcpSocket> GetInprocListener(TcpHandle handle, int port);
+  bool ConnectInproc(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, int port);
+  bool AddTcpPool(const std::shared_ptr<TcpConnPool>& new_pool, TcpPoolHandle& new_handle);
+  std::shared_ptr<TcpConnPool> RemoveTcpPool(TcpPoolHandle handle);
+  std::shared_ptr<TcpConnPool> GetTcpPool(TcpPoolHandle handle);
+  void ConnectTcpPoolSlot(TcpPoolHandle pool_handle, const std::shared_ptr<TcpConnPool>& pool, int slot);
+  void OnTcpPoolClosed(TcpPoolHandle pool_handle, int slot, TcpHandle handle);
+  void RescheduleTcpPoolSlot(TcpPoolHandle pool_handle, const std::shared_ptr<TcpConnPool>& pool, int slot, TcpHandle handle);
+  bool PostTask(TimerQueue::Task&& task);
+  static bool ValidRudpConfig(const RudpConfig& config);
+  bool CreateRudpSession(const std::weak_ptr<NetInterface>& callback, UdpHandle udp_handle, const std::shared_ptr<UdpSocket>& udp_socket, const NetEndpoint& peer, unsigned int conv, const RudpConfig& config, RudpHandle& new_handle);
+  bool AddRudpSession(const std::shared_ptr<RudpSession>& new_session, RudpHandle& new_handle);
+  std::shared_ptr<RudpSession> RemoveRudpSession(RudpHandle handle);
+  std::shared_ptr<RudpSession> GetRudpSession(RudpHandle handle);
+  std::shared_ptr<RudpSession> FindRudpSession(RudpHandle handle);
+  void CloseRudpSession(RudpHandle handle);
+  void ScheduleRudpFlush(RudpHandle handle, int delay_ms);
+  void OnRudpTimer(RudpHandle handle);
+  bool FlushRudpSession(RudpHandle handle, const std::shared_ptr<RudpSession>& session, const std::shared_ptr<UdpSocket>& udp_socket);
+  void DispatchRudpDatagrams(UdpHandle udp_handle, const std::shared_ptr<UdpSocket>& udp_socket, std::vector<UdpDatagram>& datagrams);
+  bool OnRudpDatagram(UdpHandle udp_handle, const std::shared_ptr<UdpSocket>& udp_socket, const UdpDatagram& datagram);
+  void OnRudpError(RudpHandle handle, const std::shared_ptr<NetInterface>& callback, int error);
 
   TcpAcceptBuffer* GetTcpAcceptBuffer();
+  TcpConnectBuffer* GetTcpConnectBuffer();
+  TcpDisconnectBuffer* GetTcpDisconnectBuffer();
   TcpSendBuffer* GetTcpSendBuffer();
   TcpRecvBuffer* GetTcpRecvBuffer();
   UdpSendBuffer* GetUdpSendBuffer();
-  UdpRecvBuffer* GetUdpRecvBuffer();
+  UdpRecvBuffer* GetUdpRecvBuffer(bool coalesced);
+  TaskBuffer* GetTaskBuffer();
   void ReturnTcpAcceptBuffer(TcpAcceptBuffer* buffer);
+  void ReturnTcpConnectBuffer(TcpConnectBuffer* buffer);
+  void ReturnTcpDisconnectBuffer(TcpDisconnectBuffer* buffer);
   void ReturnTcpSendBuffer(TcpSendBuffer* buffer);
   void ReturnTcpRecvBuffer(TcpRecvBuffer* buffer);
   void ReturnUdpSendBuffer(UdpSendBuffer* buffer);
   void ReturnUdpRecvBuffer(UdpRecvBuffer* buffer);
+  void ReturnTaskBuffer(TaskBuffer* buffer);
 
   bool AsyncTcpAccept(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpAcceptBuffer* buffer);
+  bool PostTcpAccepts(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpAcceptBuffer* buffer, int count);
+  bool AsyncTcpSend(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpSendBuffer* buffer);
   bool AsyncTcpRecv(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, TcpRecvBuffer* buffer);
+  bool AsyncUdpSendTo(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, SendPayload&& packet, int size, const NetEndpoint& to);
+  bool AsyncUdpSend(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, SendPayload&& packet, int size);
+  bool AsyncUdpSendSegments(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, SendPayload&& packet, int size, int segment_size, const NetEndpoint& to);
+  bool PaceUdpSend(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpPacer::Datagram&& datagram);
+  bool SendUdpDatagram(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpPacer::Datagram&& datagram);
+  void ScheduleUdpPacer(UdpHandle handle, const std::weak_ptr<UdpPacer>& pacer, int delay_ms);
+  void OnUdpPacerTimer(UdpHandle handle, const std::weak_ptr<UdpPacer>& pacer);
   bool AsyncUdpRecv(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpRecvBuffer* buffer);
+  bool PostUdpRecvs(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpRecvBuffer* buffer, int count);
+  bool PostUdpRecvs(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, UdpRecvBuffer** buffers, int buffer_count, int count);
 
+  void StampPost(BaseBuffer* buffer);
+  bool TransferAsyncTypes(LPOVERLAPPED_ENTRY entries, ULONG count);
   bool TransferAsyncType(LPOVERLAPPED ovlp, DWORD transfer_size);
   bool OnTcpAccept(TcpAcceptBuffer* buffer);
+  bool OnTcpConnect(TcpConnectBuffer* buffer);
+  bool OnTcpDisconnect(TcpDisconnectBuffer* buffer);
   bool OnTcpSend(TcpSendBuffer* buffer);
   bool OnTcpRecv(TcpRecvBuffer* buffer, int size);
   bool OnUdpSend(UdpSendBuffer* buffer);
   bool OnUdpRecv(UdpRecvBuffer* buffer, int size);
+  bool OnUdpRecvs(UdpRecvBuffer** buffers, int* sizes, int count);
+  void AppendUdpDatagrams(UdpRecvBuffer* buffer, int size, std::vector<UdpDatagram>& datagrams);
+  void NotifyUdpDatagrams(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, const std::shared_ptr<NetInterface>& callback, const std::vector<UdpDatagram>& datagrams, bool batch);
+  bool OnTask(TaskBuffer* buffer);
 
   bool OnTcpAccept(TcpHandle listen_handle, const std::shared_ptr<TcpSocket>& listen_socket, const std::shared_ptr<TcpSocket>& accept_socket);
-  void OnTcpError(TcpHandle handle, const std::shared_ptr<NetInterface>& callback, int error);
-  void OnUdpError(UdpHandle handle, const std::shared_ptr<NetInterface>& callback, int error);
+  void OnTcpError(TcpHandle handle, const std::shared_ptr<TcpSocket>& socket, const std::shared_ptr<NetInterface>& callback, int error);
+  void OnUdpError(UdpHandle handle, const std::shared_ptr<UdpSocket>& socket, const std::shared_ptr<NetInterface>& callback, int error);
+  void DispatchTcpCallback(const std::shared_ptr<TcpSocket>& socket, NetStrand::Task&& task);
 
  private:
   bool net_started_;
+  bool logger_started_;
+  bool inproc_transport_;
+  bool callback_strands_;
   IOCP iocp_;
+  NetStatsCounters stats_;
+  NetLatency latency_;
+  NetCapture capture_;
+  TimerQueue timer_queue_;
+  TcpSocketPool tcp_socket_pool_;
+  SendBufferPool<TcpSendBuffer> tcp_send_buffers_;
+  SendBufferPool<UdpSendBuffer> udp_send_buffers_;
   utility::Indexer tcp_indexer_;
   utility::Indexer udp_indexer_;
+  utility::Indexer tcp_pool_indexer_;
+  utility::Indexer rudp_indexer_;
   std::unordered_map<TcpHandle, std::shared_ptr<TcpSocket>> tcp_sockets_;
   std::unordered_map<UdpHandle, std::shared_ptr<UdpSocket>> udp_sockets_;
+  std::unordered_map<TcpPoolHandle, std::shared_ptr<TcpConnPool>> tcp_pools_;
+  std::unordered_map<RudpHandle, std::shared_ptr<RudpSession>> rudp_sessions_;
   std::mutex tcp_sockets_lock_;
   std::mutex udp_sockets_lock_;
+  std::mutex tcp_pools_lock_;
+  std::mutex rudp_sessions_lock_;
+  std::unordered_map<int, TcpHandle> inproc_listeners_;
+  std::mutex inproc_listeners_lock_;
+  std::atomic<int> inproc_next_port_;
 };
 
 typedef utility::Singleton<NetResMgr> SingleNetResMgr;
@@ -0,0 +1,96 @@
+#include "net_stats.h"
+#include "base_buffer.h"
+
+namespace net {
+
+const int kNetStatsCachedInstances = 8;
+
+namespace {
+
+std::atomic<unsigned long long> next_stats_id(1);
+
+// the slot indexes a thread claimed, by instance id; a thread that updates more instances
+// than fit here uses their shared slot for the others
+struct SlotCache {
+  unsigned long long ids[kNetStatsCachedInstances] = {0};
+  int indexes[kNetStatsCachedInstances] = {0};
+  int count = 0;
+};
+
+thread_local SlotCache slot_cache;
+
+} // namespace
+
+NetStatsCounters::NetStatsCounters() : next_slot_(0), id_(next_stats_id++) {
+  for (auto& slot : slots_) {
+    for (auto& i : slot.counters) {
+      i = 0;
+    }
+    slot.shared = false;
+  }
+  slots_[kNetStatsSlots - 1].shared = true;
+}
+
+NetStatsCounters::CounterSlot& NetStatsCounters::Slot() {
+  auto& cache = slot_cache;
+  for (auto i = 0; i < cache.count; ++i) {
+    if (cache.ids[i] == id_) {
+      return slots_[cache.indexes[i]];
+    }
+  }
+  if (cache.count == kNetStatsCachedInstances) {
+    return slots_[kNetStatsSlots - 1];
+  }
+  auto slot_index = next_slot_++;
+  if (slot_index >= kNetStatsSlots) {
+    slot_index = kNetStatsSlots - 1;
+  }
+  cache.ids[cache.count] = id_;
+  cache.indexes[cache.count] = slot_index;
+  ++cache.count;
+  return slots_[slot_index];
+}
+
+long long NetStatsCounters::Sum(int counter) {
+  long long sum = 0;
+  for (auto& slot : slots_) {
+    sum += slot.counters[counter].load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+void NetStatsCounters::GetOpStats(int base, NetOpStats& stats) {
+  stats.tcp_accept = Sum(base + kAsyncTypeTcpAccept);
+  stats.tcp_send = Sum(base + kAsyncTypeTcpSend);
+  stats.tcp_recv = Sum(base + kAsyncTypeTcpRecv);
+  stats.udp_send = Sum(base + kAsyncTypeUdpSend);
+  stats.udp_recv = Sum(base + kAsyncTypeUdpRecv);
+  stats.tcp_connect = Sum(base + kAsyncTypeTcpConnect);
+  stats.task = Sum(base + kAsyncTypeTask);
+  stats.tcp_disconnect = Sum(base + kAsyncTypeTcpDisconnect);
+}
+
+// the sums are not one atomic snapshot, each counter is exact on its own
+void NetStatsCounters::GetStats(NetStats& stats) {
+  stats.tcp_bytes_in = Sum(kNetCounterTcpBytesIn);
+  stats.tcp_bytes_out = Sum(kNetCounterTcpBytesOut);
+  stats.tcp_packets_in = Sum(kNetCounterTcpPacketsIn);
+  stats.tcp_packets_out = Sum(kNetCounterTcpPacketsOut);
+  stats.udp_bytes_in = Sum(kNetCounterUdpBytesIn);
+  stats.udp_bytes_out = Sum(kNetCounterUdpBytesOut);
+  stats.udp_datagrams_in = Sum(kNetCounterUdpDatagramsIn);
+  stats.udp_datagrams_out = Sum(kNetCounterUdpDatagramsOut);
+  stats.tcp_accepted = Sum(kNetCounterTcpAccepted);
+  stats.tcp_connected = Sum(kNetCounterTcpConnected);
+  stats.tcp_disconnected = Sum(kNetCounterTcpDisconnected);
+  stats.tcp_pending_sends = Sum(kNetCounterTcpPendingSends);
+  GetOpStats(kNetCounterCompletions, stats.completions);
+  GetOpStats(kNetCounterBuffers, stats.buffers_in_use);
+  for (auto i = 0; i <= kMaxNetErrorCode; ++i) {
+    stats.tcp_errors[i] = Sum(kNetCounterTcpErrors + i);
+    stats.udp_errors[i] = Sum(kNetCounterUdpErrors + i);
+    stats.rudp_errors[i] = Sum(kNetCounterRudpErrors + i);
+  }
+}
+
+} // namespace net
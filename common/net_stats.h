@@ -0,0 +1,68 @@
+#ifndef NET_NET_STATS_H_
+#define NET_NET_STATS_H_
+
+#include "net_interface.h"
+#include "uncopyable.h"
+#include <atomic>
+
+namespace net {
+
+const int kNetStatsSlots = 64;
+const int kNetOpTypes = 9;
+
+// counter indexes; per operation counters are followed by one entry per async type and
+// error counters by one entry per error code
+const int kNetCounterTcpBytesIn = 0;
+const int kNetCounterTcpBytesOut = 1;
+const int kNetCounterTcpPacketsIn = 2;
+const int kNetCounterTcpPacketsOut = 3;
+const int kNetCounterUdpBytesIn = 4;
+const int kNetCounterUdpBytesOut = 5;
+const int kNetCounterUdpDatagramsIn = 6;
+const int kNetCounterUdpDatagramsOut = 7;
+const int kNetCounterTcpAccepted = 8;
+const int kNetCounterTcpConnected = 9;
+const int kNetCounterTcpDisconnected = 10;
+const int kNetCounterTcpPendingSends = 11;
+const int kNetCounterCompletions = 12;
+const int kNetCounterBuffers = kNetCounterCompletions + kNetOpTypes;
+const int kNetCounterTcpErrors = kNetCounterBuffers + kNetOpTypes;
+const int kNetCounterUdpErrors = kNetCounterTcpErrors + kMaxNetErrorCode + 1;
+const int kNetCounterRudpErrors = kNetCounterUdpErrors + kMaxNetErrorCode + 1;
+const int kNetCounterNum = kNetCounterRudpErrors + kMaxNetErrorCode + 1;
+
+// counters summed over per thread cache line slots
+class NetStatsCounters : public utility::Uncopyable {
+ public:
+  NetStatsCounters();
+
+  void Add(int counter, long long value) {
+    auto& slot = Slot();
+    if (slot.shared) {
+      slot.counters[counter].fetch_add(value, std::memory_order_relaxed);
+    } else {
+      slot.counters[counter].store(slot.counters[counter].load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+  }
+  void AddError(int base, int error) { Add(base + (error >= 0 && error <= kMaxNetErrorCode ? error : kMaxNetErrorCode), 1); }
+  void GetStats(NetStats& stats);
+
+ private:
+  struct alignas(64) CounterSlot {
+    std::atomic<long long> counters[kNetCounterNum];
+    bool shared;
+  };
+
+  CounterSlot& Slot();
+  long long Sum(int counter);
+  void GetOpStats(int base, NetOpStats& stats);
+
+ private:
+  CounterSlot slots_[kNetStatsSlots];
+  std::atomic<int> next_slot_;
+  unsigned long long id_;
+};
+
+} // namespace net
+
+#endif	// NET_NET_STATS_H_
@@ -0,0 +1,79 @@
+#include "net_strand.h"
+#include <thread>
+
+namespace net {
+
+NetStrand::NetStrand() : pending_(0), head_(&stub_), tail_(&stub_) {
+  stub_.next = nullptr;
+}
+
+NetStrand::~NetStrand() {
+  Node* node = nullptr;
+  while ((node = Pop()) != nullptr) {
+    delete node;
+  }
+}
+
+void NetStrand::Post(Task&& task) {
+  if (pending_.fetch_add(1, std::memory_order_acq_rel) == 0) {
+    task();
+    Release();
+    return;
+  }
+  auto node = new Node;
+  node->task = std::move(task);
+  Push(node);
+}
+
+bool NetStrand::TryAcquire() {
+  auto free = 0;
+  return pending_.compare_exchange_strong(free, 1, std::memory_order_acq_rel);
+}
+
+// a poster counts itself before it links its node, so a missing node is about to appear
+void NetStrand::Release() {
+  while (pending_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    Node* node = nullptr;
+    while ((node = Pop()) == nullptr) {
+      std::this_thread::yield();
+    }
+    node->task();
+    delete node;
+  }
+}
+
+void NetStrand::Push(Node* node) {
+  node->next.store(nullptr, std::memory_order_relaxed);
+  auto prev = head_.exchange(node, std::memory_order_acq_rel);
+  prev->next.store(node, std::memory_order_release);
+}
+
+// only the thread running the strand pops; the stub keeps the list non-empty
+NetStrand::Node* NetStrand::Pop() {
+  auto tail = tail_;
+  auto next = tail->next.load(std::memory_order_acquire);
+  if (tail == &stub_) {
+    if (next == nullptr) {
+      return nullptr;
+    }
+    tail_ = next;
+    tail = next;
+    next = next->next.load(std::memory_order_acquire);
+  }
+  if (next != nullptr) {
+    tail_ = next;
+    return tail;
+  }
+  if (tail != head_.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  Push(&stub_);
+  next = tail->next.load(std::memory_order_acquire);
+  if (next != nullptr) {
+    tail_ = next;
+    return tail;
+  }
+  return nullptr;
+}
+
+} // namespace net
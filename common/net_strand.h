@@ -0,0 +1,41 @@
+#ifndef NET_NET_STRAND_H_
+#define NET_NET_STRAND_H_
+
+#include "uncopyable.h"
+#include <atomic>
+#include <functional>
+
+namespace net {
+
+// lock free task serializer, the poster that finds it free runs the queued tasks in order
+class NetStrand : public utility::Uncopyable {
+ public:
+  typedef std::function<void ()> Task;
+
+  NetStrand();
+  ~NetStrand();
+
+  void Post(Task&& task);
+  // holds a free strand without a task, tasks posted until Release wait for it
+  bool TryAcquire();
+  void Release();
+
+ private:
+  struct Node {
+    std::atomic<Node*> next;
+    Task task;
+  };
+
+  void Push(Node* node);
+  Node* Pop();
+
+ private:
+  std::atomic<int> pending_;
+  std::atomic<Node*> head_;
+  Node* tail_;
+  Node stub_;
+};
+
+} // namespace net
+
+#endif	// NET_NET_STRAND_H_
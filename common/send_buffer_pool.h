@@ -0,0 +1,55 @@
+#ifndef NET_SEND_BUFFER_POOL_H_
+#define NET_SEND_BUFFER_POOL_H_
+
+#include "uncopyable.h"
+#include <mutex>
+#include <vector>
+
+namespace net {
+
+const int kSendBufferPoolDepth = 1024;
+
+// idle send contexts of one type, handed out again instead of allocating one per send;
+// Put resets the context outside the lock, since dropping a lent payload runs its release
+template <typename T>
+class SendBufferPool : public utility::Uncopyable {
+ public:
+  SendBufferPool() {}
+  ~SendBufferPool() {
+    for (auto buffer : idle_buffers_) {
+      delete buffer;
+    }
+  }
+
+  T* Get() {
+    {
+      std::lock_guard<std::mutex> lock(pool_lock_);
+      if (!idle_buffers_.empty()) {
+        auto buffer = idle_buffers_.back();
+        idle_buffers_.pop_back();
+        return buffer;
+      }
+    }
+    return new T;
+  }
+
+  void Put(T* buffer) {
+    buffer->Reset();
+    {
+      std::lock_guard<std::mutex> lock(pool_lock_);
+      if (idle_buffers_.size() < kSendBufferPoolDepth) {
+        idle_buffers_.push_back(buffer);
+        return;
+      }
+    }
+    delete buffer;
+  }
+
+ private:
+  std::vector<T*> idle_buffers_;
+  std::mutex pool_lock_;
+};
+
+} // namespace net
+
+#endif	// NET_SEND_BUFFER_POOL_H_
@@ -0,0 +1,71 @@
+#ifndef NET_SEND_PAYLOAD_H_
+#define NET_SEND_PAYLOAD_H_
+
+#include "net_buffer.h"
+#include <cstddef>
+#include <memory>
+
+namespace net {
+
+// owned packet, shared NetBuffer, borrowed memory or a slice of a shared payload
+class SendPayload {
+ public:
+  SendPayload() : release_(nullptr), cookie_(nullptr), data_(nullptr) {}
+  SendPayload(std::unique_ptr<char[]>&& owned) : owned_(std::move(owned)), release_(nullptr), cookie_(nullptr), data_(owned_.get()) {}
+  SendPayload(const NetBufferPtr& shared)
+    : shared_(shared), release_(nullptr), cookie_(nullptr), data_(shared ? shared->data() : nullptr) {}
+  SendPayload(const char* borrowed, SendRelease release, void* cookie) : release_(release), cookie_(cookie), data_(borrowed) {}
+  SendPayload(const std::shared_ptr<SendPayload>& whole, int offset)
+    : whole_(whole), release_(nullptr), cookie_(nullptr), data_(whole->get() + offset) {}
+  SendPayload(SendPayload&& other) noexcept
+    : owned_(std::move(other.owned_)), shared_(std::move(other.shared_)), whole_(std::move(other.whole_)), release_(other.release_),
+      cookie_(other.cookie_), data_(other.data_) {
+    other.release_ = nullptr;
+    other.data_ = nullptr;
+  }
+  SendPayload(const SendPayload&) = delete;
+  ~SendPayload() { reset(); }
+
+  SendPayload& operator=(SendPayload&& other) noexcept {
+    if (this != &other) {
+      reset();
+      owned_ = std::move(other.owned_);
+      shared_ = std::move(other.shared_);
+      whole_ = std::move(other.whole_);
+      release_ = other.release_;
+      cookie_ = other.cookie_;
+      data_ = other.data_;
+      other.release_ = nullptr;
+      other.data_ = nullptr;
+    }
+    return *this;
+  }
+  SendPayload& operator=(const SendPayload&) = delete;
+  bool operator==(std::nullptr_t) const { return data_ == nullptr; }
+
+  const char* get() const { return data_; }
+  void reset() {
+    owned_.reset();
+    shared_.reset();
+    whole_.reset();
+    auto release = release_;
+    auto data = data_;
+    release_ = nullptr;
+    data_ = nullptr;
+    if (release != nullptr) {
+      release(data, cookie_);
+    }
+  }
+
+ private:
+  std::unique_ptr<char[]> owned_;
+  NetBufferPtr shared_;
+  std::shared_ptr<SendPayload> whole_;
+  SendRelease release_;
+  void* cookie_;
+  const char* data_;
+};
+
+} // namespace net
+
+#endif	// NET_SEND_PAYLOAD_H_
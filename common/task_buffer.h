@@ -0,0 +1,23 @@
+#ifndef NET_TASK_BUFFER_H_
+#define NET_TASK_BUFFER_H_
+
+#include "base_buffer.h"
+#include <functional>
+
+namespace net {
+
+class TaskBuffer : public BaseBuffer {
+ public:
+  TaskBuffer() {
+    set_async_type(kAsyncTypeTask);
+  }
+  void set_task(std::function<void ()>&& task) { task_ = std::move(task); }
+  std::function<void ()> task() { return std::move(task_); }
+
+ private:
+  std::function<void ()> task_;
+};
+
+} // namespace net
+
+#endif	// NET_TASK_BUFFER_H_
@@ -0,0 +1,90 @@
+#include "timer_queue.h"
+#include "net_log.h"
+#include <vector>
+
+namespace net {
+
+TimerQueue::TimerQueue() {
+  init_ = false;
+  stop_ = false;
+}
+
+TimerQueue::~TimerQueue() {
+  Uninit();
+}
+
+bool TimerQueue::Init(std::function<void (Task&&)>&& dispatcher) {
+  if (init_) {
+    return true;
+  }
+  if (dispatcher == nullptr) {
+    NET_LOG(kStartup, "initialize timer queue failed: invalid dispatcher parameter.");
+    return false;
+  }
+  dispatcher_ = std::move(dispatcher);
+  stop_ = false;
+  timer_thread_ = std::make_unique<std::thread>(std::bind(&TimerQueue::ThreadWorker, this));
+  init_ = true;
+  return true;
+}
+
+void TimerQueue::Uninit() {
+  if (!init_) {
+    return;
+  }
+  timers_lock_.lock();
+  stop_ = true;
+  timers_lock_.unlock();
+  timers_cond_.notify_all();
+  timer_thread_->join();
+  timer_thread_.reset();
+  timers_.clear();
+  dispatcher_ = nullptr;
+  init_ = false;
+}
+
+bool TimerQueue::Schedule(int delay_ms, Task&& task) {
+  if (task == nullptr || delay_ms < 0) {
+    NET_LOG(kError, "schedule timer failed: invalid parameter.");
+    return false;
+  }
+  auto expire_time = Clock::now() + std::chrono::milliseconds(delay_ms);
+  std::lock_guard<std::mutex> lock(timers_lock_);
+  if (!init_ || stop_) {
+    NET_LOG(kError, "schedule timer failed: timer queue not started.");
+    return false;
+  }
+  auto new_timer = timers_.insert(std::make_pair(expire_time, std::move(task)));
+  if (new_timer == timers_.begin()) {
+    timers_cond_.notify_one();
+  }
+  return true;
+}
+
+void TimerQueue::ThreadWorker() {
+  std::unique_lock<std::mutex> lock(timers_lock_);
+  while (!stop_) {
+    if (timers_.empty()) {
+      timers_cond_.wait(lock);
+      continue;
+    }
+    auto now = Clock::now();
+    if (timers_.begin()->first > now) {
+      timers_cond_.wait_until(lock, timers_.begin()->first);
+      continue;
+    }
+    std::vector<Task> expired_tasks;
+    auto expired_end = timers_.upper_bound(now);
+    for (auto i = timers_.begin(); i != expired_end; ++i) {
+      expired_tasks.push_back(std::move(i->second));
+    }
+    timers_.erase(timers_.begin(), expired_end);
+    lock.unlock();
+    for (auto& i : expired_tasks) {
+      dispatcher_(std::move(i));
+    }
+    lock.lock();
+  }
+}
+
+} // namespace net
@@ -0,0 +1,43 @@
+#ifndef NET_TIMER_QUEUE_H_
+#define NET_TIMER_QUEUE_H_
+
+#include "uncopyable.h"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace net {
+
+// one thread sleeping until the earliest deadline, expired tasks are handed to
+// the dispatcher which posts them to the iocp workers
+class TimerQueue : public utility::Uncopyable {
+ public:
+  typedef std::function<void ()> Task;
+  typedef std::chrono::steady_clock Clock;
+
+  TimerQueue();
+  ~TimerQueue();
+  bool Init(std::function<void (Task&&)>&& dispatcher);
+  void Uninit();
+  bool Schedule(int delay_ms, Task&& task);
+
+ private:
+  void ThreadWorker();
+
+ private:
+  bool init_;
+  bool stop_;
+  std::function<void (Task&&)> dispatcher_;
+  std::multimap<Clock::time_point, Task> timers_;
+  std::mutex timers_lock_;
+  std::condition_variable timers_cond_;
+  std::unique_ptr<std::thread> timer_thread_;
+};
+
+} // namespace net
+
+#endif	// NET_TIMER_QUEUE_H_
@@ -0,0 +1,74 @@
+#include "token_bucket.h"
+#include <algorithm>
+#include <cmath>
+
+namespace net {
+
+TokenBucket::TokenBucket() {
+  rate_ = 0;
+  burst_ = 0;
+  tokens_ = 0;
+  last_refill_ = Clock::now();
+}
+
+void TokenBucket::Init(double rate, double burst) {
+  rate_ = rate;
+  burst_ = std::max(burst, 1.0);
+  tokens_ = burst_;
+  last_refill_ = Clock::now();
+}
+
+// unlike Init the current balance is kept, only capped by the new burst
+void TokenBucket::SetRate(double rate, double burst) {
+  if (!enabled()) {
+    Init(rate, burst);
+    return;
+  }
+  Refill();
+  rate_ = rate;
+  burst_ = std::max(burst, 1.0);
+  tokens_ = std::min(tokens_, burst_);
+}
+
+// a disabled bucket always has enough tokens
+bool TokenBucket::Consume(double tokens) {
+  if (!enabled()) {
+    return true;
+  }
+  Refill();
+  if (tokens_ < tokens) {
+    return false;
+  }
+  tokens_ -= tokens;
+  return true;
+}
+
+// the balance may go negative, so one oversized request still gets through and is paid later
+void TokenBucket::ForceConsume(double tokens) {
+  if (!enabled()) {
+    return;
+  }
+  Refill();
+  tokens_ -= tokens;
+}
+
+// milliseconds until tokens are available, 0 if they are already
+int TokenBucket::DelayMs(double tokens) {
+  if (!enabled()) {
+    return 0;
+  }
+  Refill();
+  if (tokens_ >= tokens) {
+    return 0;
+  }
+  return static_cast<int>(std::ceil((tokens - tokens_) * 1000 / rate_));
+}
+
+void TokenBucket::Refill() {
+  auto now = Clock::now();
+  auto elapsed = std::chrono::duration<double>(now - last_refill_).count();
+  last_refill_ = now;
+  tokens_ = std::min(tokens_ + elapsed * rate_, burst_);
+}
+
+} // namespace net
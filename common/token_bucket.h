@@ -0,0 +1,33 @@
+#ifndef NET_TOKEN_BUCKET_H_
+#define NET_TOKEN_BUCKET_H_
+
+#include <chrono>
+
+namespace net {
+
+// rate tokens per second up to burst tokens; not thread safe, guarded by the owner
+class TokenBucket {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  TokenBucket();
+  void Init(double rate, double burst);
+  void SetRate(double rate, double burst);
+  bool enabled() const { return rate_ > 0; }
+  bool Consume(double tokens);
+  void ForceConsume(double tokens);
+  int DelayMs(double tokens);
+
+ private:
+  void Refill();
+
+ private:
+  double rate_;
+  double burst_;
+  double tokens_;
+  Clock::time_point last_refill_;
+};
+
+} // namespace net
+
+#endif	// NET_TOKEN_BUCKET_H_
@@ -0,0 +1,68 @@
+/************************************************************************/
+/*  TCP framing parser fuzz target (libFuzzer)                          */
+/*  the first input byte chooses the read size, the rest is the stream */
+/*  fed to TcpSocket::OnRecv; every packet is checked against a plain  */
+/*  reference parser of the whole stream                               */
+/*  BUILD: clang++ -fsanitize=fuzzer,address with the net sources      */
+/*  USAGE: tcp_parse_fuzz fuzz/corpus/tcp_parse                        */
+/************************************************************************/
+
+#include "tcp_head.h"
+#include "tcp_socket.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+// frames until the first invalid head; a frame is complete once its head and body are
+bool ReferenceParse(const char* data, size_t size, std::vector<std::string>& packets) {
+  size_t offset = 0;
+  while (size - offset >= static_cast<size_t>(net::kTcpHeadSize)) {
+    net::TcpHead head;
+    if (!head.Init(data + offset, net::kTcpHeadSize)) {
+      return false;
+    }
+    if (size - offset - net::kTcpHeadSize < head.size()) {
+      break;
+    }
+    packets.emplace_back(data + offset + net::kTcpHeadSize, head.size());
+    offset += net::kTcpHeadSize + head.size();
+  }
+  return true;
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  if (size < 2) {
+    return 0;
+  }
+  auto read_size = data[0] == 0 ? size - 1 : static_cast<size_t>(data[0]);
+  auto stream = reinterpret_cast<const char*>(data + 1);
+  auto stream_size = size - 1;
+  std::vector<std::string> expected;
+  auto expected_valid = ReferenceParse(stream, stream_size, expected);
+  net::TcpSocket socket;
+  std::vector<std::string> parsed;
+  auto parsed_valid = true;
+  for (size_t offset = 0; offset < stream_size && parsed_valid; offset += read_size) {
+    auto length = stream_size - offset < read_size ? stream_size - offset : read_size;
+    // a private copy per read, so a packet pointing into an old read is caught by asan
+    std::unique_ptr<char[]> read(new char[length]);
+    memcpy(read.get(), stream + offset, length);
+    parsed_valid = socket.OnRecv(read.get(), static_cast<int>(length));
+    for (const auto& i : socket.all_packets()) {
+      parsed.emplace_back(i->packet(), i->size());
+    }
+  }
+  if (parsed_valid != expected_valid) {
+    abort();
+  }
+  if (parsed != expected) {
+    abort();
+  }
+  return 0;
+}
@@ -0,0 +1,278 @@
+#include "net_async.h"
+#include <cstring>
+#include <new>
+
+namespace net {
+
+const size_t kFrameGranularity = 64;
+const int kFrameClasses = 32;
+const int kFrameCacheDepth = 256;
+
+namespace {
+
+// freed frames of one size class are linked through their first bytes
+struct FrameCache {
+  void* heads[kFrameClasses] = {nullptr};
+  int counts[kFrameClasses] = {0};
+
+  ~FrameCache() {
+    for (auto i = 0; i < kFrameClasses; ++i) {
+      while (heads[i] != nullptr) {
+        auto frame = heads[i];
+        heads[i] = *static_cast<void**>(frame);
+        ::operator delete(frame);
+      }
+    }
+  }
+};
+
+thread_local FrameCache frame_cache;
+
+int FrameClass(size_t size) {
+  return static_cast<int>((size + kFrameGranularity - 1) / kFrameGranularity) - 1;
+}
+
+} // namespace
+
+// a frame freed on another worker than it was allocated on joins that worker's cache
+void* CoroutineFramePool::Allocate(size_t size) {
+  auto frame_class = FrameClass(size);
+  if (frame_class >= kFrameClasses) {
+    return ::operator new(size);
+  }
+  auto& head = frame_cache.heads[frame_class];
+  if (head != nullptr) {
+    auto frame = head;
+    head = *static_cast<void**>(frame);
+    --frame_cache.counts[frame_class];
+    return frame;
+  }
+  return ::operator new((frame_class + 1) * kFrameGranularity);
+}
+
+void CoroutineFramePool::Free(void* frame, size_t size) {
+  auto frame_class = FrameClass(size);
+  if (frame_class >= kFrameClasses || frame_cache.counts[frame_class] >= kFrameCacheDepth) {
+    ::operator delete(frame);
+    return;
+  }
+  *static_cast<void**>(frame) = frame_cache.heads[frame_class];
+  frame_cache.heads[frame_class] = frame;
+  ++frame_cache.counts[frame_class];
+}
+
+bool AsyncNet::AcceptAwaiter::await_suspend(std::coroutine_handle<> waiter) {
+  auto slot = net_->GetSlot(false, handle_, true);
+  std::unique_lock<std::mutex> lock(slot->lock);
+  if (!slot->accepted.empty()) {
+    accepted_.handle = slot->accepted.front();
+    slot->accepted.pop_front();
+    return false;
+  }
+  if (slot->closed) {
+    accepted_.error = slot->error;
+    lock.unlock();
+    net_->EraseSlot(false, handle_);
+    return false;
+  }
+  if (slot->waiter) {
+    accepted_.error = kAsyncBusy;
+    return false;
+  }
+  slot->waiter = waiter;
+  slot->accept_out = &accepted_;
+  return true;
+}
+
+bool AsyncNet::RecvAwaiter::await_suspend(std::coroutine_handle<> waiter) {
+  auto slot = net_->GetSlot(udp_, handle_, true);
+  std::unique_lock<std::mutex> lock(slot->lock);
+  if (!slot->packets.empty()) {
+    packet_ = std::move(slot->packets.front());
+    slot->packets.pop_front();
+    return false;
+  }
+  if (slot->closed) {
+    packet_.error = slot->error;
+    lock.unlock();
+    net_->EraseSlot(udp_, handle_);
+    return false;
+  }
+  if (slot->waiter) {
+    packet_.error = kAsyncBusy;
+    return false;
+  }
+  slot->waiter = waiter;
+  slot->packet_out = &packet_;
+  return true;
+}
+
+bool AsyncNet::OnTcpDisconnected(TcpHandle handle) {
+  Close(false, handle, kAsyncClosed);
+  return true;
+}
+
+// a handle index is reused once its socket is gone, what is left of the old one is dropped
+bool AsyncNet::OnTcpAccepted(TcpHandle handle, TcpHandle accept_handle) {
+  EraseSlot(false, accept_handle);
+  auto slot = GetSlot(false, handle, true);
+  std::unique_lock<std::mutex> lock(slot->lock);
+  if (!slot->waiter || slot->accept_out == nullptr) {
+    slot->accepted.push_back(accept_handle);
+    return true;
+  }
+  slot->accept_out->handle = accept_handle;
+  auto waiter = slot->waiter;
+  slot->waiter = nullptr;
+  slot->accept_out = nullptr;
+  lock.unlock();
+  waiter.resume();
+  return true;
+}
+
+bool AsyncNet::OnTcpReceived(TcpHandle handle, const char* packet, int size) {
+  Deliver(false, handle, packet, size, nullptr);
+  return true;
+}
+
+bool AsyncNet::OnTcpError(TcpHandle handle, int error) {
+  Close(false, handle, error);
+  return true;
+}
+
+bool AsyncNet::OnUdpReceived(UdpHandle handle, const char* packet, int size, std::string ip, int port) {
+  return OnUdpReceivedFrom(handle, packet, size, NetEndpoint(ip, port));
+}
+
+bool AsyncNet::OnUdpReceivedFrom(UdpHandle handle, const char* packet, int size, const NetEndpoint& from) {
+  Deliver(true, handle, packet, size, &from);
+  return true;
+}
+
+bool AsyncNet::OnUdpError(UdpHandle handle, int error) {
+  Close(true, handle, error);
+  return true;
+}
+
+bool AsyncNet::TcpCreate(const std::string& ip, int port, TcpHandle& new_handle) {
+  if (!NetInterface::TcpCreate(ip, port, new_handle)) {
+    return false;
+  }
+  ResetClosedSlot(false, new_handle);
+  return true;
+}
+
+bool AsyncNet::UdpCreate(const std::string& ip, int port, UdpHandle& new_handle) {
+  return UdpCreate(ip, port, UdpConfig(), new_handle);
+}
+
+bool AsyncNet::UdpCreate(const std::string& ip, int port, const UdpConfig& config, UdpHandle& new_handle) {
+  if (!NetInterface::UdpCreate(ip, port, config, new_handle)) {
+    return false;
+  }
+  ResetClosedSlot(true, new_handle);
+  return true;
+}
+
+bool AsyncNet::TcpDestroy(TcpHandle handle) {
+  auto destroyed = NetInterface::TcpDestroy(handle);
+  Close(false, handle, kAsyncClosed);
+  EraseSlot(false, handle);
+  return destroyed;
+}
+
+bool AsyncNet::UdpDestroy(UdpHandle handle) {
+  auto destroyed = NetInterface::UdpDestroy(handle);
+  Close(true, handle, kAsyncClosed);
+  EraseSlot(true, handle);
+  return destroyed;
+}
+
+std::shared_ptr<AsyncNet::Slot> AsyncNet::GetSlot(bool udp, unsigned long handle, bool create) {
+  std::lock_guard<std::mutex> lock(slots_lock_);
+  auto& slots = udp ? udp_slots_ : tcp_slots_;
+  auto slot = slots.find(handle);
+  if (slot != slots.end()) {
+    return slot->second;
+  }
+  if (!create) {
+    return nullptr;
+  }
+  auto new_slot = std::make_shared<Slot>();
+  slots.insert(std::make_pair(handle, new_slot));
+  return new_slot;
+}
+
+void AsyncNet::EraseSlot(bool udp, unsigned long handle) {
+  std::lock_guard<std::mutex> lock(slots_lock_);
+  (udp ? udp_slots_ : tcp_slots_).erase(handle);
+}
+
+// datagrams of a new udp handle may already have reset the slot, then it is left as it is
+void AsyncNet::ResetClosedSlot(bool udp, unsigned long handle) {
+  auto slot = GetSlot(udp, handle, false);
+  if (slot == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(slot->lock);
+  if (slot->closed) {
+    slot->Reset();
+  }
+}
+
+// a waiting coroutine reads the packet in place, otherwise it is copied; data for a closed
+// slot belongs to a new socket that got the handle index of the closed one
+void AsyncNet::Deliver(bool udp, unsigned long handle, const char* packet, int size, const NetEndpoint* from) {
+  auto slot = GetSlot(udp, handle, true);
+  std::unique_lock<std::mutex> lock(slot->lock);
+  if (slot->closed) {
+    slot->Reset();
+  }
+  if (!slot->waiter || slot->packet_out == nullptr) {
+    AsyncPacket queued;
+    queued.storage.reset(new char[size]);
+    memcpy(queued.storage.get(), packet, size);
+    queued.data = queued.storage.get();
+    queued.size = size;
+    if (from != nullptr) {
+      queued.from = *from;
+    }
+    slot->packets.push_back(std::move(queued));
+    return;
+  }
+  auto out = slot->packet_out;
+  out->data = packet;
+  out->size = size;
+  if (from != nullptr) {
+    out->from = *from;
+  }
+  auto waiter = slot->waiter;
+  slot->waiter = nullptr;
+  slot->packet_out = nullptr;
+  lock.unlock();
+  waiter.resume();
+}
+
+void AsyncNet::Close(bool udp, unsigned long handle, int error) {
+  auto slot = GetSlot(udp, handle, true);
+  std::unique_lock<std::mutex> lock(slot->lock);
+  slot->closed = true;
+  slot->error = error;
+  if (!slot->waiter) {
+    return;
+  }
+  if (slot->packet_out != nullptr) {
+    slot->packet_out->error = error;
+  }
+  if (slot->accept_out != nullptr) {
+    slot->accept_out->error = error;
+  }
+  auto waiter = slot->waiter;
+  slot->waiter = nullptr;
+  slot->packet_out = nullptr;
+  slot->accept_out = nullptr;
+  lock.unlock();
+  waiter.resume();
+}
+
+} // namespace net
@@ -0,0 +1,164 @@
+/************************************************************************/
+/*  Net Async                                                           */
+/*  coroutine front end of NetInterface: a coroutine returning NetTask  */
+/*  co_awaits accepts, tcp packets and udp datagrams of its handles     */
+/*  and is resumed on the worker that delivered them                    */
+/*  THREAD: safe                                                        */
+/************************************************************************/
+
+#ifndef NET_ASYNC_H_
+#define NET_ASYNC_H_
+
+#include "net_interface.h"
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace net {
+
+const int kAsyncClosed = -1;
+const int kAsyncBusy = -2;
+
+// frames of NetTask coroutines, recycled in per thread free lists by size class
+class CoroutineFramePool {
+ public:
+  static void* Allocate(size_t size);
+  static void Free(void* frame, size_t size);
+};
+
+// fire and forget coroutine: runs at once until its first suspension, its frame is freed
+// when it returns
+class NetTask {
+ public:
+  struct promise_type {
+    NetTask get_return_object() { return NetTask(); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+    static void* operator new(size_t size) { return CoroutineFramePool::Allocate(size); }
+    static void operator delete(void* frame, size_t size) { CoroutineFramePool::Free(frame, size); }
+  };
+};
+
+// data is valid until the next suspension, a queued packet is copied into storage;
+// error kAsyncClosed is a disconnect
+struct AsyncPacket {
+  const char* data = nullptr;
+  int size = 0;
+  int error = 0;
+  NetEndpoint from;
+  std::unique_ptr<char[]> storage;
+
+  explicit operator bool() const { return size > 0; }
+};
+
+// an invalid handle with error kAsyncClosed when the listener was closed, kAsyncBusy when
+// another coroutine already waits on it
+struct AsyncAccept {
+  TcpHandle handle = kInvalidTcpHandle;
+  int error = 0;
+
+  explicit operator bool() const { return handle != kInvalidTcpHandle; }
+};
+
+// one waiting coroutine per handle, arrivals without a waiter are queued;
+// TcpSend completes at once
+class AsyncNet : public NetInterface {
+ private:
+  struct Slot {
+    std::mutex lock;
+    std::deque<AsyncPacket> packets;
+    std::deque<TcpHandle> accepted;
+    bool closed = false;
+    int error = 0;
+    std::coroutine_handle<> waiter;
+    AsyncPacket* packet_out = nullptr;
+    AsyncAccept* accept_out = nullptr;
+
+    void Reset() { packets.clear(); accepted.clear(); closed = false; error = 0; }
+  };
+  typedef std::unordered_map<unsigned long, std::shared_ptr<Slot>> Slots;
+
+ public:
+  class AcceptAwaiter {
+   public:
+    AcceptAwaiter(AsyncNet* net, TcpHandle handle) : net_(net), handle_(handle) {}
+    bool await_ready() const { return false; }
+    bool await_suspend(std::coroutine_handle<> waiter);
+    AsyncAccept await_resume() const { return accepted_; }
+
+   private:
+    AsyncNet* net_;
+    TcpHandle handle_;
+    AsyncAccept accepted_;
+  };
+
+  class RecvAwaiter {
+   public:
+    RecvAwaiter(AsyncNet* net, bool udp, unsigned long handle) : net_(net), udp_(udp), handle_(handle) {}
+    bool await_ready() const { return false; }
+    bool await_suspend(std::coroutine_handle<> waiter);
+    AsyncPacket await_resume() { return std::move(packet_); }
+
+   private:
+    AsyncNet* net_;
+    bool udp_;
+    unsigned long handle_;
+    AsyncPacket packet_;
+  };
+
+  class SendAwaiter {
+   public:
+    explicit SendAwaiter(bool sent) : sent_(sent) {}
+    bool await_ready() const { return true; }
+    void await_suspend(std::coroutine_handle<>) const {}
+    bool await_resume() const { return sent_; }
+
+   private:
+    bool sent_;
+  };
+
+  bool OnTcpDisconnected(TcpHandle handle) override;
+  bool OnTcpAccepted(TcpHandle handle, TcpHandle accept_handle) override;
+  bool OnTcpReceived(TcpHandle handle, const char* packet, int size) override;
+  bool OnTcpError(TcpHandle handle, int error) override;
+  bool OnUdpReceived(UdpHandle handle, const char* packet, int size, std::string ip, int port) override;
+  bool OnUdpReceivedFrom(UdpHandle handle, const char* packet, int size, const NetEndpoint& from) override;
+  bool OnUdpError(UdpHandle handle, int error) override;
+
+  AcceptAwaiter TcpAccept(TcpHandle listen_handle) { return AcceptAwaiter(this, listen_handle); }
+  RecvAwaiter TcpRecv(TcpHandle handle) { return RecvAwaiter(this, false, handle); }
+  using NetInterface::TcpSend;
+  SendAwaiter TcpSend(TcpHandle handle, std::unique_ptr<char[]>&& packet, int size) {
+    return SendAwaiter(NetInterface::TcpSend(handle, std::move(packet), size));
+  }
+  RecvAwaiter UdpRecvFrom(UdpHandle handle) { return RecvAwaiter(this, true, handle); }
+  // a new handle may reuse a closed index, its leftovers are dropped
+  bool TcpCreate(const std::string& ip, int port, TcpHandle& new_handle);
+  bool UdpCreate(const std::string& ip, int port, UdpHandle& new_handle);
+  bool UdpCreate(const std::string& ip, int port, const UdpConfig& config, UdpHandle& new_handle);
+  // also resumes a coroutine waiting on the handle with kAsyncClosed
+  bool TcpDestroy(TcpHandle handle);
+  bool UdpDestroy(UdpHandle handle);
+
+ private:
+  std::shared_ptr<Slot> GetSlot(bool udp, unsigned long handle, bool create);
+  void EraseSlot(bool udp, unsigned long handle);
+  void ResetClosedSlot(bool udp, unsigned long handle);
+  void Deliver(bool udp, unsigned long handle, const char* packet, int size, const NetEndpoint* from);
+  void Close(bool udp, unsigned long handle, int error);
+
+ private:
+  Slots tcp_slots_;
+  Slots udp_slots_;
+  std::mutex slots_lock_;
+};
+
+} // namespace net
+
+#endif	// NET_ASYNC_H_
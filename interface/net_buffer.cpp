@@ -0,0 +1,152 @@
+#include "net_buffer.h"
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace net {
+
+const int kNetBufferMinBlock = 256;
+const int kNetBufferClasses = 10;
+const int kNetBufferPoolDepth = 1024;
+const int kNetBufferMaxCapacity = 16 * 1024 * 1024;
+
+namespace {
+
+// blocks of kNetBufferMinBlock << class bytes, larger buffers are not pooled
+class NetBufferPool {
+ public:
+  ~NetBufferPool() {
+    for (auto& i : free_blocks_) {
+      for (auto block : i) {
+        ::operator delete(block);
+      }
+    }
+  }
+
+  static int BlockSize(int block_class) { return kNetBufferMinBlock << block_class; }
+
+  static int BlockClass(int size) {
+    for (auto i = 0; i < kNetBufferClasses; ++i) {
+      if (size <= BlockSize(i)) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  void* Get(int block_class, int size) {
+    if (block_class < 0) {
+      return ::operator new(size);
+    }
+    {
+      std::lock_guard<std::mutex> lock(locks_[block_class]);
+      auto& blocks = free_blocks_[block_class];
+      if (!blocks.empty()) {
+        auto block = blocks.back();
+        blocks.pop_back();
+        return block;
+      }
+    }
+    return ::operator new(BlockSize(block_class));
+  }
+
+  void Put(int block_class, void* block) {
+    if (block_class >= 0) {
+      std::lock_guard<std::mutex> lock(locks_[block_class]);
+      auto& blocks = free_blocks_[block_class];
+      if (blocks.size() < kNetBufferPoolDepth) {
+        blocks.push_back(block);
+        return;
+      }
+    }
+    ::operator delete(block);
+  }
+
+ private:
+  std::vector<void*> free_blocks_[kNetBufferClasses];
+  std::mutex locks_[kNetBufferClasses];
+};
+
+NetBufferPool& BufferPool() {
+  static NetBufferPool pool;
+  return pool;
+}
+
+} // namespace
+
+NetBufferPtr::NetBufferPtr(const NetBufferPtr& other) : buffer_(other.buffer_) {
+  if (buffer_ != nullptr) {
+    buffer_->AddRef();
+  }
+}
+
+NetBufferPtr& NetBufferPtr::operator=(const NetBufferPtr& other) {
+  if (other.buffer_ != nullptr) {
+    other.buffer_->AddRef();
+  }
+  reset();
+  buffer_ = other.buffer_;
+  return *this;
+}
+
+NetBufferPtr& NetBufferPtr::operator=(NetBufferPtr&& other) noexcept {
+  if (this != &other) {
+    reset();
+    buffer_ = other.buffer_;
+    other.buffer_ = nullptr;
+  }
+  return *this;
+}
+
+void NetBufferPtr::reset() {
+  if (buffer_ != nullptr) {
+    buffer_->Release();
+    buffer_ = nullptr;
+  }
+}
+
+NetBuffer::NetBuffer(int block_class, int capacity, int size)
+  : refs_(1), block_class_(block_class), capacity_(capacity), size_(size), data_(begin() + kNetBufferHeadroom) {
+}
+
+// a pooled block may be larger than asked for, capacity then covers all of it
+NetBufferPtr NetBuffer::Create(int capacity) {
+  if (capacity <= 0 || capacity > kNetBufferMaxCapacity) {
+    return NetBufferPtr();
+  }
+  auto block_size = static_cast<int>(sizeof(NetBuffer)) + kNetBufferHeadroom + capacity;
+  auto block_class = NetBufferPool::BlockClass(block_size);
+  if (block_class >= 0) {
+    block_size = NetBufferPool::BlockSize(block_class);
+  }
+  auto block = BufferPool().Get(block_class, block_size);
+  return NetBufferPtr(new (block) NetBuffer(block_class, block_size - static_cast<int>(sizeof(NetBuffer)), capacity));
+}
+
+bool NetBuffer::set_size(int size) {
+  if (size < 0 || size > capacity()) {
+    return false;
+  }
+  size_ = size;
+  return true;
+}
+
+bool NetBuffer::Prepend(int size) {
+  if (size < 0 || size > headroom()) {
+    return false;
+  }
+  data_ -= size;
+  size_ += size;
+  return true;
+}
+
+void NetBuffer::Release() {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  auto block_class = block_class_;
+  this->~NetBuffer();
+  BufferPool().Put(block_class, this);
+}
+
+} // namespace net
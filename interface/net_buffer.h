@@ -0,0 +1,79 @@
+/************************************************************************/
+/*  Net Buffer                                                          */
+/*  reference counted send buffer from the library's pool, with         */
+/*  headroom in front of the data for headers added after the payload   */
+/*  was written; a buffer is read only once it was handed to a send     */
+/*  THREAD: safe                                                        */
+/************************************************************************/
+
+#ifndef NET_BUFFER_H_
+#define NET_BUFFER_H_
+
+#include <atomic>
+
+namespace net {
+
+const int kNetBufferHeadroom = 64;
+
+// called once the borrowed buffer is no longer read, on a worker or on the sending thread
+// when the post failed; it must not block
+typedef void (*SendRelease)(const char* packet, void* cookie);
+
+class NetBuffer;
+
+class NetBufferPtr {
+ public:
+  NetBufferPtr() : buffer_(nullptr) {}
+  NetBufferPtr(const NetBufferPtr& other);
+  NetBufferPtr(NetBufferPtr&& other) noexcept : buffer_(other.buffer_) { other.buffer_ = nullptr; }
+  ~NetBufferPtr() { reset(); }
+  NetBufferPtr& operator=(const NetBufferPtr& other);
+  NetBufferPtr& operator=(NetBufferPtr&& other) noexcept;
+
+  void reset();
+  NetBuffer* get() const { return buffer_; }
+  NetBuffer* operator->() const { return buffer_; }
+  NetBuffer& operator*() const { return *buffer_; }
+  explicit operator bool() const { return buffer_ != nullptr; }
+
+ private:
+  friend class NetBuffer;
+  explicit NetBufferPtr(NetBuffer* buffer) : buffer_(buffer) {}
+
+ private:
+  NetBuffer* buffer_;
+};
+
+// the object, its headroom and its data share one pooled block; size starts at the capacity
+// asked for, Prepend moves the start of the data into the headroom
+class NetBuffer {
+ public:
+  static NetBufferPtr Create(int capacity);
+
+  char* data() { return data_; }
+  const char* data() const { return data_; }
+  int size() const { return size_; }
+  int capacity() const { return capacity_ - headroom(); }
+  int headroom() const { return static_cast<int>(data_ - begin()); }
+  bool set_size(int size);
+  bool Prepend(int size);
+
+ private:
+  friend class NetBufferPtr;
+  NetBuffer(int block_class, int capacity, int size);
+  ~NetBuffer() {}
+  char* begin() const { return const_cast<char*>(reinterpret_cast<const char*>(this + 1)); }
+  void AddRef() { refs_.fetch_add(1, std::memory_order_relaxed); }
+  void Release();
+
+ private:
+  std::atomic<int> refs_;
+  int block_class_;
+  int capacity_;
+  int size_;
+  char* data_;
+};
+
+} // namespace net
+
+#endif	// NET_BUFFER_H_
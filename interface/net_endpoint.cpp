@@ -0,0 +1,114 @@
+#include "net_endpoint.h"
+#include <cstring>
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+namespace net {
+
+bool NetEndpoint::Assign(const std::string& ip, int port) {
+  Reset();
+  if (port < 0 || port > 0xFFFF) {
+    return false;
+  }
+  SOCKADDR_IN addr4 = {0};
+  if (inet_pton(AF_INET, ip.c_str(), &addr4.sin_addr) == 1) {
+    addr4.sin_family = AF_INET;
+    addr4.sin_port = htons(port);
+    return Assign(&addr4, sizeof(addr4));
+  }
+  SOCKADDR_IN6 addr6 = {0};
+  if (inet_pton(AF_INET6, ip.c_str(), &addr6.sin6_addr) == 1) {
+    addr6.sin6_family = AF_INET6;
+    addr6.sin6_port = htons(port);
+    return Assign(&addr6, sizeof(addr6));
+  }
+  return false;
+}
+
+bool NetEndpoint::Assign(const void* addr, int addr_size) {
+  Reset();
+  if (addr == nullptr) {
+    return false;
+  }
+  auto addr_family = ((const SOCKADDR*)addr)->sa_family;
+  if ((addr_family == AF_INET && addr_size < (int)sizeof(SOCKADDR_IN)) ||
+    (addr_family == AF_INET6 && addr_size < (int)sizeof(SOCKADDR_IN6)) ||
+    (addr_family != AF_INET && addr_family != AF_INET6)) {
+    return false;
+  }
+  size_ = addr_family == AF_INET ? sizeof(SOCKADDR_IN) : sizeof(SOCKADDR_IN6);
+  memcpy(storage_, addr, size_);
+  return true;
+}
+
+bool NetEndpoint::ToString(char ip[kNetEndpointIpSize], int& port) const {
+  if (!valid()) {
+    return false;
+  }
+  const void* ip_addr = family() == AF_INET ? (const void*)&((const SOCKADDR_IN*)storage_)->sin_addr :
+    (const void*)&((const SOCKADDR_IN6*)storage_)->sin6_addr;
+  if (inet_ntop(family(), ip_addr, ip, kNetEndpointIpSize) == nullptr) {
+    return false;
+  }
+  port = this->port();
+  return true;
+}
+
+std::string NetEndpoint::ip() const {
+  char ip[kNetEndpointIpSize] = {0};
+  int port = 0;
+  ToString(ip, port);
+  return ip;
+}
+
+int NetEndpoint::port() const {
+  if (!valid()) {
+    return 0;
+  }
+  return family() == AF_INET ? ntohs(((const SOCKADDR_IN*)storage_)->sin_port) :
+    ntohs(((const SOCKADDR_IN6*)storage_)->sin6_port);
+}
+
+int NetEndpoint::family() const {
+  return valid() ? ((const SOCKADDR*)storage_)->sa_family : AF_UNSPEC;
+}
+
+// fnv-1a over the address bytes and the port, zero padding is not hashed
+size_t NetEndpoint::Hash() const {
+  size_t hash = 14695981039346656037ULL;
+  auto mix = [&hash](const void* data, int size) {
+    for (auto i = 0; i < size; ++i) {
+      hash = (hash ^ ((const unsigned char*)data)[i]) * 1099511628211ULL;
+    }
+  };
+  if (family() == AF_INET) {
+    auto addr4 = (const SOCKADDR_IN*)storage_;
+    mix(&addr4->sin_addr, sizeof(addr4->sin_addr));
+    mix(&addr4->sin_port, sizeof(addr4->sin_port));
+  } else if (family() == AF_INET6) {
+    auto addr6 = (const SOCKADDR_IN6*)storage_;
+    mix(&addr6->sin6_addr, sizeof(addr6->sin6_addr));
+    mix(&addr6->sin6_port, sizeof(addr6->sin6_port));
+  }
+  return hash;
+}
+
+bool NetEndpoint::operator==(const NetEndpoint& other) const {
+  if (family() != other.family()) {
+    return false;
+  }
+  if (family() == AF_INET) {
+    auto addr4 = (const SOCKADDR_IN*)storage_;
+    auto other4 = (const SOCKADDR_IN*)other.storage_;
+    return addr4->sin_port == other4->sin_port && memcmp(&addr4->sin_addr, &other4->sin_addr, sizeof(addr4->sin_addr)) == 0;
+  }
+  if (family() == AF_INET6) {
+    auto addr6 = (const SOCKADDR_IN6*)storage_;
+    auto other6 = (const SOCKADDR_IN6*)other.storage_;
+    return addr6->sin6_port == other6->sin6_port && addr6->sin6_scope_id == other6->sin6_scope_id &&
+      memcmp(&addr6->sin6_addr, &other6->sin6_addr, sizeof(addr6->sin6_addr)) == 0;
+  }
+  return true;
+}
+
+} // namespace net
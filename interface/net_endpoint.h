@@ -0,0 +1,49 @@
+/************************************************************************/
+/*  Net Endpoint                                                        */
+/*  binary ipv4 or ipv6 address and port, built once and passed to     */
+/*  the kernel as is on every send and receive                          */
+/************************************************************************/
+
+#ifndef NET_ENDPOINT_H_
+#define NET_ENDPOINT_H_
+
+#include <cstddef>
+#include <string>
+
+namespace net {
+
+const int kNetEndpointStorageSize = 28;
+const int kNetEndpointIpSize = 46;
+
+class NetEndpoint {
+ public:
+  NetEndpoint() : size_(0) {}
+  NetEndpoint(const std::string& ip, int port) : size_(0) { Assign(ip, port); }
+
+  bool Assign(const std::string& ip, int port);
+  bool Assign(const void* addr, int addr_size);
+  void Reset() { size_ = 0; }
+  bool ToString(char ip[kNetEndpointIpSize], int& port) const;
+  std::string ip() const;
+  int port() const;
+  int family() const;
+  size_t Hash() const;
+
+  bool valid() const { return size_ > 0; }
+  const void* addr() const { return storage_; }
+  int addr_size() const { return size_; }
+  bool operator==(const NetEndpoint& other) const;
+  bool operator!=(const NetEndpoint& other) const { return !(*this == other); }
+
+ private:
+  alignas(8) unsigned char storage_[kNetEndpointStorageSize];
+  int size_;
+};
+
+struct NetEndpointHash {
+  size_t operator()(const NetEndpoint& endpoint) const { return endpoint.Hash(); }
+};
+
+} // namespace net
+
+#endif	// NET_ENDPOINT_H_
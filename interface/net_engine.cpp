@@ -0,0 +1,63 @@
+#include "net_engine.h"
+#include "net_res_mgr.h"
+#include <thread>
+
+namespace net {
+
+NetEngine::NetEngine() : res_mgr_(new NetResMgr()) {
+}
+
+NetEngine::~NetEngine() {
+  res_mgr_->CleanupNet();
+}
+
+// a callback may drop the last reference on one of the engine's own workers, which can not
+// join itself, so the engine is then cleaned up by a thread of its own
+std::shared_ptr<NetEngine> NetEngine::Create(const NetConfig& config) {
+  auto deleter = [](NetEngine* engine) {
+    if (engine->res_mgr_->IsWorkerThread()) {
+      std::thread([engine]() { delete engine; }).detach();
+    } else {
+      delete engine;
+    }
+  };
+  std::shared_ptr<NetEngine> engine(new NetEngine(), deleter);
+  if (!engine->res_mgr_->StartupNet(config)) {
+    return nullptr;
+  }
+  return engine;
+}
+
+bool NetEngine::TcpGetSocketPoolStats(TcpSocketPoolStats& stats) {
+  return res_mgr_->TcpGetSocketPoolStats(stats);
+}
+
+bool NetEngine::GetNetStats(NetStats& stats) {
+  return res_mgr_->GetNetStats(stats);
+}
+
+bool NetEngine::SetLatencyTracking(bool enabled) {
+  return res_mgr_->SetLatencyTracking(enabled);
+}
+
+bool NetEngine::GetLatencyStats(NetLatencyStats& stats) {
+  return res_mgr_->GetLatencyStats(stats);
+}
+
+bool NetEngine::DumpLatencyStats(std::string& report) {
+  return res_mgr_->DumpLatencyStats(report);
+}
+
+bool NetEngine::StartCapture(const CaptureConfig& config) {
+  return res_mgr_->StartCapture(config);
+}
+
+bool NetEngine::StopCapture() {
+  return res_mgr_->StopCapture();
+}
+
+bool NetEngine::GetCaptureStats(CaptureStats& stats) {
+  return res_mgr_->GetCaptureStats(stats);
+}
+
+} // namespace net
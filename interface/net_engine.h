@@ -0,0 +1,49 @@
+/************************************************************************/
+/*  Net Engine                                                          */
+/*  an independent instance of the net library: its own workers,       */
+/*  handle spaces, buffer pools and configuration. interfaces bound    */
+/*  to it by NetInterface::BindEngine never share a worker with the    */
+/*  default engine of StartupNet or with other engines                 */
+/*  THREAD: safe                                                        */
+/************************************************************************/
+
+#ifndef NET_ENGINE_H_
+#define NET_ENGINE_H_
+
+#include "net_interface.h"
+#include "uncopyable.h"
+#include <memory>
+#include <string>
+
+namespace net {
+
+class NetResMgr;
+
+// started by Create and cleaned up when the last reference is gone; bound interfaces hold a
+// reference, handles of one engine mean nothing to another
+class NetEngine : public utility::Uncopyable {
+ public:
+  static std::shared_ptr<NetEngine> Create(const NetConfig& config);
+  ~NetEngine();
+
+  bool TcpGetSocketPoolStats(TcpSocketPoolStats& stats);
+  bool GetNetStats(NetStats& stats);
+  bool SetLatencyTracking(bool enabled);
+  bool GetLatencyStats(NetLatencyStats& stats);
+  bool DumpLatencyStats(std::string& report);
+  bool StartCapture(const CaptureConfig& config);
+  bool StopCapture();
+  bool GetCaptureStats(CaptureStats& stats);
+
+  NetResMgr* res_mgr() const { return res_mgr_.get(); }
+
+ private:
+  NetEngine();
+
+ private:
+  std::unique_ptr<NetResMgr> res_mgr_;
+};
+
+} // namespace net
+
+#endif	// NET_ENGINE_H_
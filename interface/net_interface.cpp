@@ -1,10 +1,15 @@
 #include "net_interface.h"
+#include "net_engine.h"
 #include "net_res_mgr.h"
 
 namespace net {
 
 bool NetInterface::StartupNet() {
-  return SingleNetResMgr::GetInstance()->StartupNet();
+  return SingleNetResMgr::GetInstance()->StartupNet(NetConfig());
+}
+
+bool NetInterface::StartupNet(const NetConfig& config) {
+  return SingleNetResMgr::GetInstance()->StartupNet(config);
 }
 
 bool NetInterface::CleanupNet() {
@@ -15,44 +20,233 @@ bool NetInterface::CleanupNet() {
   return true;
 }
 
+bool NetInterface::TcpGetSocketPoolStats(TcpSocketPoolStats& stats) {
+  return SingleNetResMgr::GetInstance()->TcpGetSocketPoolStats(stats);
+}
+
+bool NetInterface::GetNetStats(NetStats& stats) {
+  return SingleNetResMgr::GetInstance()->GetNetStats(stats);
+}
+
+bool NetInterface::SetLatencyTracking(bool enabled) {
+  return SingleNetResMgr::GetInstance()->SetLatencyTracking(enabled);
+}
+
+bool NetInterface::GetLatencyStats(NetLatencyStats& stats) {
+  return SingleNetResMgr::GetInstance()->GetLatencyStats(stats);
+}
+
+bool NetInterface::DumpLatencyStats(std::string& report) {
+  return SingleNetResMgr::GetInstance()->DumpLatencyStats(report);
+}
+
+bool NetInterface::SetLogSink(LogSink&& sink) {
+  return SingleNetResMgr::GetInstance()->SetLogSink(std::move(sink));
+}
+
+bool NetInterface::StartCapture(const CaptureConfig& config) {
+  return SingleNetResMgr::GetInstance()->StartCapture(config);
+}
+
+bool NetInterface::StopCapture() {
+  return SingleNetResMgr::GetInstance()->StopCapture();
+}
+
+bool NetInterface::GetCaptureStats(CaptureStats& stats) {
+  return SingleNetResMgr::GetInstance()->GetCaptureStats(stats);
+}
+
+bool NetInterface::BindEngine(const std::shared_ptr<NetEngine>& engine) {
+  engine_ = engine;
+  return true;
+}
+
 bool NetInterface::TcpCreate(const std::string& ip, int port, TcpHandle& new_handle) {
-  return SingleNetResMgr::GetInstance()->TcpCreate(shared_from_this(), ip, port, new_handle);
+  return res_mgr()->TcpCreate(shared_from_this(), ip, port, new_handle);
 }
 
 bool NetInterface::TcpDestroy(TcpHandle handle) {
-  return SingleNetResMgr::GetInstance()->TcpDestroy(handle);
+  return res_mgr()->TcpDestroy(handle);
 }
 
 bool NetInterface::TcpListen(TcpHandle handle) {
-  return SingleNetResMgr::GetInstance()->TcpListen(handle);
+  return res_mgr()->TcpListen(handle, TcpListenConfig());
+}
+
+bool NetInterface::TcpListen(TcpHandle handle, const TcpListenConfig& config) {
+  return res_mgr()->TcpListen(handle, config);
+}
+
+bool NetInterface::TcpGetListenStats(TcpHandle handle, TcpListenStats& stats) {
+  return res_mgr()->TcpGetListenStats(handle, stats);
 }
 
 bool NetInterface::TcpConnect(TcpHandle handle, const std::string& ip, int port) {
-  return SingleNetResMgr::GetInstance()->TcpConnect(handle, ip, port);
+  return res_mgr()->TcpConnect(handle, ip, port);
 }
 
 bool NetInterface::TcpSend(TcpHandle handle, std::unique_ptr<char[]>&& packet, int size) {
-  return SingleNetResMgr::GetInstance()->TcpSend(handle, std::move(packet), size);
+  return res_mgr()->TcpSend(handle, std::move(packet), size);
+}
+
+bool NetInterface::TcpSend(TcpHandle handle, const NetBufferPtr& packet) {
+  return res_mgr()->TcpSend(handle, packet, packet ? packet->size() : 0);
+}
+
+bool NetInterface::TcpSend(TcpHandle handle, const char* packet, int size, SendRelease release, void* cookie) {
+  return res_mgr()->TcpSend(handle, SendPayload(packet, release, cookie), size);
 }
 
 bool NetInterface::TcpGetLocalAddr(TcpHandle handle, char ip[16], int& port) {
-  return SingleNetResMgr::GetInstance()->TcpGetLocalAddr(handle, ip, port);
+  return res_mgr()->TcpGetLocalAddr(handle, ip, port);
 }
 
 bool NetInterface::TcpGetRemoteAddr(TcpHandle handle, char ip[16], int& port) {
-  return SingleNetResMgr::GetInstance()->TcpGetRemoteAddr(handle, ip, port);
+  return res_mgr()->TcpGetRemoteAddr(handle, ip, port);
+}
+
+bool NetInterface::TcpGetStats(TcpHandle handle, TcpStats& stats) {
+  return res_mgr()->TcpGetStats(handle, stats);
+}
+
+bool NetInterface::SetTcpContext(TcpHandle handle, void* context) {
+  return res_mgr()->SetTcpContext(handle, context);
+}
+
+bool NetInterface::GetTcpContext(TcpHandle handle, void*& context) {
+  return res_mgr()->GetTcpContext(handle, context);
 }
 
 bool NetInterface::UdpCreate(const std::string& ip, int port, UdpHandle& new_handle) {
-  return SingleNetResMgr::GetInstance()->UdpCreate(shared_from_this(), ip, port, new_handle);
+  return res_mgr()->UdpCreate(shared_from_this(), ip, port, UdpConfig(), new_handle);
+}
+
+bool NetInterface::UdpCreate(const std::string& ip, int port, const UdpConfig& config, UdpHandle& new_handle) {
+  return res_mgr()->UdpCreate(shared_from_this(), ip, port, config, new_handle);
 }
 
 bool NetInterface::UdpDestroy(UdpHandle handle) {
-  return SingleNetResMgr::GetInstance()->UdpDestroy(handle);
+  return res_mgr()->UdpDestroy(handle);
 }
 
 bool NetInterface::UdpSendTo(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, const std::string& ip, int port) {
-  return SingleNetResMgr::GetInstance()->UdpSendTo(handle, std::move(packet), size, ip, port);
+  return res_mgr()->UdpSendTo(handle, std::move(packet), size, ip, port);
+}
+
+bool NetInterface::UdpSendTo(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, const NetEndpoint& to) {
+  return res_mgr()->UdpSendTo(handle, std::move(packet), size, to);
+}
+
+bool NetInterface::UdpSendTo(UdpHandle handle, const NetBufferPtr& packet, const NetEndpoint& to) {
+  return res_mgr()->UdpSendTo(handle, packet, packet ? packet->size() : 0, to);
+}
+
+bool NetInterface::UdpSendTo(UdpHandle handle, const char* packet, int size, const NetEndpoint& to, SendRelease release, void* cookie) {
+  return res_mgr()->UdpSendTo(handle, SendPayload(packet, release, cookie), size, to);
+}
+
+bool NetInterface::UdpSendToBatch(UdpHandle handle, std::vector<UdpSendItem>&& items) {
+  return res_mgr()->UdpSendToBatch(handle, std::move(items));
+}
+
+bool NetInterface::UdpSendSegments(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, int segment_size, const std::string& ip, int port) {
+  return res_mgr()->UdpSendSegments(handle, std::move(packet), size, segment_size, ip, port);
+}
+
+bool NetInterface::UdpSendSegments(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, int segment_size, const NetEndpoint& to) {
+  return res_mgr()->UdpSendSegments(handle, std::move(packet), size, segment_size, to);
+}
+
+bool NetInterface::UdpConnect(UdpHandle handle, const NetEndpoint& peer) {
+  return res_mgr()->UdpConnect(handle, peer);
+}
+
+bool NetInterface::UdpSend(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size) {
+  return res_mgr()->UdpSend(handle, std::move(packet), size);
+}
+
+bool NetInterface::UdpGetOffloadInfo(UdpHandle handle, UdpOffloadInfo& info) {
+  return res_mgr()->UdpGetOffloadInfo(handle, info);
+}
+
+bool NetInterface::UdpGetRecvStats(UdpHandle handle, UdpRecvStats& stats) {
+  return res_mgr()->UdpGetRecvStats(handle, stats);
+}
+
+bool NetInterface::SetUdpContext(UdpHandle handle, void* context) {
+  return res_mgr()->SetUdpContext(handle, context);
+}
+
+bool NetInterface::GetUdpContext(UdpHandle handle, void*& context) {
+  return res_mgr()->GetUdpContext(handle, context);
+}
+
+bool NetInterface::UdpSetPacing(UdpHandle handle, int rate, int burst) {
+  return res_mgr()->UdpSetPacing(handle, rate, burst);
+}
+
+bool NetInterface::UdpGetPacingStats(UdpHandle handle, UdpPacingStats& stats) {
+  return res_mgr()->UdpGetPacingStats(handle, stats);
+}
+
+bool NetInterface::UdpJoinGroup(UdpHandle handle, const std::string& group, const std::string& interface_ip, const std::string& source) {
+  return res_mgr()->UdpJoinGroup(handle, group, interface_ip, source);
+}
+
+bool NetInterface::UdpLeaveGroup(UdpHandle handle, const std::string& group, const std::string& interface_ip, const std::string& source) {
+  return res_mgr()->UdpLeaveGroup(handle, group, interface_ip, source);
+}
+
+bool NetInterface::UdpSubscribe(UdpHandle handle) {
+  return res_mgr()->UdpSubscribe(shared_from_this(), handle);
+}
+
+bool NetInterface::UdpUnsubscribe(UdpHandle handle) {
+  return res_mgr()->UdpUnsubscribe(shared_from_this(), handle);
+}
+
+bool NetInterface::RudpCreate(UdpHandle udp_handle, const NetEndpoint& peer, unsigned int conv, const RudpConfig& config, RudpHandle& new_handle) {
+  return res_mgr()->RudpCreate(shared_from_this(), udp_handle, peer, conv, config, new_handle);
+}
+
+bool NetInterface::RudpListen(UdpHandle udp_handle, const RudpConfig& config) {
+  return res_mgr()->RudpListen(shared_from_this(), udp_handle, config);
+}
+
+bool NetInterface::RudpDestroy(RudpHandle handle) {
+  return res_mgr()->RudpDestroy(handle);
+}
+
+bool NetInterface::RudpSend(RudpHandle handle, std::unique_ptr<char[]>&& packet, int size) {
+  return res_mgr()->RudpSend(handle, std::move(packet), size);
+}
+
+bool NetInterface::RudpGetStats(RudpHandle handle, RudpStats& stats) {
+  return res_mgr()->RudpGetStats(handle, stats);
+}
+
+bool NetInterface::TcpPoolCreate(const std::string& ip, int port, const TcpPoolConfig& config, TcpPoolHandle& new_handle) {
+  return res_mgr()->TcpPoolCreate(shared_from_this(), ip, port, config, new_handle);
+}
+
+bool NetInterface::TcpPoolDestroy(TcpPoolHandle handle) {
+  return res_mgr()->TcpPoolDestroy(handle);
+}
+
+bool NetInterface::TcpPoolSend(TcpPoolHandle handle, std::unique_ptr<char[]>&& packet, int size) {
+  return res_mgr()->TcpPoolSend(handle, std::move(packet), size);
+}
+
+bool NetInterface::TcpPoolGetStats(TcpPoolHandle handle, TcpPoolStats& stats) {
+  return res_mgr()->TcpPoolGetStats(handle, stats);
+}
+
+bool NetInterface::ReplayCapture(const std::string& path, bool original_speed, CaptureReplayStats& stats) {
+  return res_mgr()->ReplayCapture(shared_from_this(), path, original_speed, stats);
+}
+
+NetResMgr* NetInterface::res_mgr() const {
+  return engine_ != nullptr ? engine_->res_mgr() : SingleNetResMgr::GetInstance();
 }
 
 } // namespace net
\ No newline at end of file
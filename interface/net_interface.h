@@ -7,21 +7,312 @@
 #ifndef NET_INTERFACE_H_
 #define NET_INTERFACE_H_
 
+#include "net_buffer.h"
+#include "net_endpoint.h"
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace net {
 
 typedef unsigned long TcpHandle;
 typedef unsigned long UdpHandle;
+typedef unsigned long TcpPoolHandle;
+typedef unsigned long RudpHandle;
+// receives every formatted log line of the net library on its background log thread
+typedef std::function<void (int, const char*)> LogSink;
 
 const TcpHandle kInvalidTcpHandle = 0;
 const UdpHandle kInvalidUdpHandle = 0;
+const TcpPoolHandle kInvalidTcpPoolHandle = 0;
+const RudpHandle kInvalidRudpHandle = 0;
 
 const int kOneKibibyte = 1024;
 const int kOneMebibyte = 1024 * kOneKibibyte;
 const int kMaxTcpPacketSize = 16 * kOneMebibyte;
 const int kMaxUdpPacketSize = 8 * kOneKibibyte;
+const int kMaxUdpSegmentedSize = 63 * kOneKibibyte;
+
+// worker_shards: completion ports with pinned workers, sockets spread round-robin
+// latency_tracking: timestamps every overlapped operation, see GetLatencyStats
+// inproc_transport: tcp handles of this process connect in memory
+// callback_strands: callbacks of one tcp handle never overlap, OnTcpAccepted runs first
+// processors: if not empty the only processors used, numbered across groups, group 0 first
+struct NetConfig {
+  int worker_shards = 1;
+  bool latency_tracking = false;
+  bool inproc_transport = false;
+  bool callback_strands = false;
+  std::vector<int> processors;
+};
+
+const int kTcpPoolSelectRoundRobin = 0;
+const int kTcpPoolSelectLeastOutstanding = 1;
+
+// pool of outbound connections to one upstream endpoint, every closed member is
+// reconnected after a jittered exponential backoff between min and max
+struct TcpPoolConfig {
+  int connections = 4;
+  int select_policy = kTcpPoolSelectRoundRobin;
+  int min_backoff_ms = 100;
+  int max_backoff_ms = 30 * 1000;
+};
+
+// backlog <= 0: SOMAXCONN, min_accepts <= 0: 2 * processors, max_accepts <= 0: 16 * min_accepts
+// recycle_sockets: reuse the sockets of closed accepted connections
+// sharded: accepted connections go to the shard of their RSS processor, never recycled
+// connections over max_connections, max_connections_per_ip or accept_rate / accept_burst
+// are reset after AcceptEx, 0 is unlimited; sources without an IPv4 address are reset
+struct TcpListenConfig {
+  int backlog = 0;
+  int min_accepts = 0;
+  int max_accepts = 0;
+  bool recycle_sockets = false;
+  bool sharded = false;
+  int max_connections = 0;
+  int max_connections_per_ip = 0;
+  int accept_rate = 0;
+  int accept_burst = 0;
+};
+
+struct TcpListenStats {
+  int backlog = 0;
+  int pending_accepts = 0;
+  int target_accepts = 0;
+  double accept_rate = 0;
+  unsigned long long accepted = 0;
+  unsigned long long accept_failures = 0;
+  unsigned long long accept_post_failures = 0;
+  unsigned long long accept_starvations = 0;
+  unsigned long long shard_mismatches = 0;
+  std::vector<unsigned long long> shard_accepts;
+  int connections = 0;
+  unsigned long long rejected_max_connections = 0;
+  unsigned long long rejected_per_ip = 0;
+  unsigned long long rejected_no_addr = 0;
+  unsigned long long rejected_rate = 0;
+};
+
+struct TcpSocketPoolStats {
+  int idle = 0;
+  unsigned long long reused = 0;
+  unsigned long long created = 0;
+  unsigned long long recycled = 0;
+  unsigned long long discarded = 0;
+};
+
+const int kMaxUdpRecvBatch = 64;
+
+// recv_batch > 0: datagrams dequeued together go to one OnUdpBatchReceived, default min_recvs
+// recv_coalescing: stack coalesced receives, split again before they are reported
+// reuse_address: several handles or processes bind the same multicast port
+// outstanding receives follow the bursts, min_recvs <= 0: 2, max_recvs <= 0: 4 * processors
+// recv_buffer_size, send_buffer_size: SO_RCVBUF and SO_SNDBUF, 0 keeps the default
+// pacing_rate > 0: bytes per second per handle or destination, pacing_burst <= 0:
+// kMaxUdpPacketSize, pacing_queue_limit <= 0: 1024 waiting datagrams
+struct UdpConfig {
+  int recv_batch = 0;
+  bool recv_coalescing = false;
+  bool reuse_address = false;
+  int min_recvs = 0;
+  int max_recvs = 0;
+  int recv_buffer_size = 0;
+  int send_buffer_size = 0;
+  int pacing_rate = 0;
+  int pacing_burst = 0;
+  bool pacing_per_destination = false;
+  int pacing_queue_limit = 0;
+};
+
+// recv_starvations: times no receive was outstanding; system_* are machine wide counters
+struct UdpRecvStats {
+  int min_recvs = 0;
+  int max_recvs = 0;
+  int pending_recvs = 0;
+  int target_recvs = 0;
+  unsigned long long received = 0;
+  unsigned long long recv_starvations = 0;
+  int recv_buffer_size = 0;
+  int send_buffer_size = 0;
+  unsigned long long system_in_errors = 0;
+  unsigned long long system_no_ports = 0;
+};
+
+struct UdpOffloadInfo {
+  bool send_segmentation = false;
+  bool recv_coalescing = false;
+};
+
+struct UdpPacingStats {
+  int rate = 0;
+  int burst = 0;
+  int flows = 0;
+  int queued = 0;
+  unsigned long long delayed = 0;
+  unsigned long long dropped = 0;
+};
+
+struct UdpDatagram {
+  const char* packet = nullptr;
+  int size = 0;
+  NetEndpoint from;
+};
+
+struct UdpSendItem {
+  std::unique_ptr<char[]> packet;
+  int size = 0;
+  NetEndpoint to;
+};
+
+const int kMaxRudpFragments = 128;
+
+// reliable udp session per peer and conversation id, selective acks and fast retransmit
+// pacing_rate 0 derives the rate from the window and srtt
+// ordered false delivers on arrival, messages must then fit in one segment
+struct RudpConfig {
+  int mtu = 1400;
+  int interval_ms = 10;
+  int send_window = 128;
+  int recv_window = 128;
+  int min_rto_ms = 30;
+  int fast_resend = 2;
+  int dead_link = 20;
+  bool congestion_control = true;
+  int pacing_rate = 0;
+  bool ordered = true;
+};
+
+struct RudpStats {
+  int srtt_ms = 0;
+  int rttvar_ms = 0;
+  int rto_ms = 0;
+  int congestion_window = 0;
+  int remote_window = 0;
+  int in_flight = 0;
+  int queued = 0;
+  unsigned long long sent_segments = 0;
+  unsigned long long retransmits = 0;
+  unsigned long long fast_retransmits = 0;
+  unsigned long long received_segments = 0;
+  unsigned long long duplicates = 0;
+  unsigned long long delivered = 0;
+  unsigned long long oversized_drops = 0;
+};
+
+struct TcpPoolStats {
+  int connections = 0;
+  int connected = 0;
+  int connecting = 0;
+  int backing_off = 0;
+  unsigned long long connect_attempts = 0;
+  unsigned long long connect_failures = 0;
+  unsigned long long disconnects = 0;
+  unsigned long long sends = 0;
+  unsigned long long send_failures = 0;
+  unsigned long long pending_sends = 0;
+};
+
+// error codes above kMaxNetErrorCode are counted as kMaxNetErrorCode
+const int kMaxNetErrorCode = 15;
+
+struct NetOpStats {
+  unsigned long long tcp_accept = 0;
+  unsigned long long tcp_connect = 0;
+  unsigned long long tcp_disconnect = 0;
+  unsigned long long tcp_send = 0;
+  unsigned long long tcp_recv = 0;
+  unsigned long long udp_send = 0;
+  unsigned long long udp_recv = 0;
+  unsigned long long task = 0;
+};
+
+// completions counts the dequeued completions by operation, buffers_in_use the async buffers
+// handed out and not yet returned; errors are indexed by the code of the error callbacks
+struct NetStats {
+  unsigned long long tcp_bytes_in = 0;
+  unsigned long long tcp_bytes_out = 0;
+  unsigned long long tcp_packets_in = 0;
+  unsigned long long tcp_packets_out = 0;
+  unsigned long long udp_bytes_in = 0;
+  unsigned long long udp_bytes_out = 0;
+  unsigned long long udp_datagrams_in = 0;
+  unsigned long long udp_datagrams_out = 0;
+  unsigned long long tcp_accepted = 0;
+  unsigned long long tcp_connected = 0;
+  unsigned long long tcp_disconnected = 0;
+  long long tcp_pending_sends = 0;
+  NetOpStats completions;
+  NetOpStats buffers_in_use;
+  unsigned long long tcp_errors[kMaxNetErrorCode + 1] = {0};
+  unsigned long long udp_errors[kMaxNetErrorCode + 1] = {0};
+  unsigned long long rudp_errors[kMaxNetErrorCode + 1] = {0};
+};
+
+struct LatencySummary {
+  unsigned long long count = 0;
+  unsigned long long p50_ns = 0;
+  unsigned long long p90_ns = 0;
+  unsigned long long p99_ns = 0;
+  unsigned long long p999_ns = 0;
+  unsigned long long max_ns = 0;
+};
+
+// post_to_completion includes waiting for the peer on receives and accepts
+struct NetLatencyOpStats {
+  LatencySummary post_to_completion;
+  LatencySummary completion_to_callback;
+  LatencySummary callback;
+};
+
+struct NetLatencyStats {
+  NetLatencyOpStats tcp_accept;
+  NetLatencyOpStats tcp_connect;
+  NetLatencyOpStats tcp_disconnect;
+  NetLatencyOpStats tcp_send;
+  NetLatencyOpStats tcp_recv;
+  NetLatencyOpStats udp_send;
+  NetLatencyOpStats udp_recv;
+  NetLatencyOpStats task;
+};
+
+struct TcpStats {
+  unsigned long long bytes_in = 0;
+  unsigned long long bytes_out = 0;
+  unsigned long long packets_in = 0;
+  unsigned long long packets_out = 0;
+  int pending_sends = 0;
+};
+
+// capacity bytes of records are mapped at start, the file is cut to the used size at stop
+struct CaptureConfig {
+  std::string path;
+  unsigned long long capacity = 256ULL * kOneMebibyte;
+};
+
+struct CaptureStats {
+  bool enabled = false;
+  unsigned long long capacity = 0;
+  unsigned long long used = 0;
+  unsigned long long records = 0;
+  unsigned long long bytes = 0;
+  unsigned long long dropped = 0;
+};
+
+// send records are part of the capture but are not replayed, they are counted as skipped
+struct CaptureReplayStats {
+  unsigned long long records = 0;
+  unsigned long long tcp_bytes = 0;
+  unsigned long long tcp_packets = 0;
+  unsigned long long tcp_disconnects = 0;
+  unsigned long long udp_datagrams = 0;
+  unsigned long long skipped = 0;
+  unsigned long long errors = 0;
+  unsigned long long elapsed_ms = 0;
+};
+
+class NetEngine;
+class NetResMgr;
 
 class NetInterface : public std::enable_shared_from_this<NetInterface> {
  public:
@@ -31,21 +322,116 @@ class NetInterface : public std::enable_shared_from_this<NetInterface> {
   virtual bool OnTcpError(TcpHandle handle, int error) = 0;
   virtual bool OnUdpReceived(UdpHandle handle, const char* packet, int size, std::string ip, int port) = 0;
   virtual bool OnUdpError(UdpHandle handle, int error) = 0;
+  virtual bool OnTcpPoolConnected(TcpPoolHandle pool_handle, TcpHandle handle) { return true; }
+  virtual bool OnUdpReceivedFrom(UdpHandle handle, const char* packet, int size, const NetEndpoint& from) {
+    return OnUdpReceived(handle, packet, size, from.ip(), from.port());
+  }
+  virtual bool OnUdpBatchReceived(UdpHandle handle, const UdpDatagram* datagrams, int count) {
+    for (auto i = 0; i < count; ++i) {
+      OnUdpReceivedFrom(handle, datagrams[i].packet, datagrams[i].size, datagrams[i].from);
+    }
+    return true;
+  }
+  // called with the SetTcpContext or SetUdpContext pointer, nullptr for udp subscribers and
+  // replayed captures; by default they forward to the overloads above
+  virtual bool OnTcpDisconnected(TcpHandle handle, void* context) { return OnTcpDisconnected(handle); }
+  virtual bool OnTcpReceived(TcpHandle handle, void* context, const char* packet, int size) {
+    return OnTcpReceived(handle, packet, size);
+  }
+  virtual bool OnTcpError(TcpHandle handle, void* context, int error) { return OnTcpError(handle, error); }
+  virtual bool OnUdpReceivedFrom(UdpHandle handle, void* context, const char* packet, int size, const NetEndpoint& from) {
+    return OnUdpReceivedFrom(handle, packet, size, from);
+  }
+  virtual bool OnUdpBatchReceived(UdpHandle handle, void* context, const UdpDatagram* datagrams, int count) {
+    return OnUdpBatchReceived(handle, datagrams, count);
+  }
+  virtual bool OnUdpError(UdpHandle handle, void* context, int error) { return OnUdpError(handle, error); }
+  virtual bool OnRudpAccepted(UdpHandle udp_handle, RudpHandle handle) { return true; }
+  virtual bool OnRudpReceived(RudpHandle handle, const char* packet, int size) { return true; }
+  virtual bool OnRudpError(RudpHandle handle, int error) { return true; }
 
  public:
   static bool StartupNet();
+  static bool StartupNet(const NetConfig& config);
   static bool CleanupNet();
+  static bool TcpGetSocketPoolStats(TcpSocketPoolStats& stats);
+  static bool GetNetStats(NetStats& stats);
+  static bool SetLatencyTracking(bool enabled);
+  static bool GetLatencyStats(NetLatencyStats& stats);
+  static bool DumpLatencyStats(std::string& report);
+  static bool SetLogSink(LogSink&& sink);
+  // records the raw tcp stream and every udp datagram of all handles in both directions, a send
+  // is recorded once it completed, with the time it was posted
+  static bool StartCapture(const CaptureConfig& config);
+  static bool StopCapture();
+  static bool GetCaptureStats(CaptureStats& stats);
 
   bool TcpCreate(const std::string& ip, int port, TcpHandle& new_handle);
   bool TcpDestroy(TcpHandle handle);
   bool TcpListen(TcpHandle handle);
+  bool TcpListen(TcpHandle handle, const TcpListenConfig& config);
+  bool TcpGetListenStats(TcpHandle handle, TcpListenStats& stats);
   bool TcpConnect(TcpHandle handle, const std::string& ip, int port);
   bool TcpSend(TcpHandle handle, std::unique_ptr<char[]>&& packet, int size);
+  // sends size() bytes from data(), the buffer is shared and must not change until released
+  bool TcpSend(TcpHandle handle, const NetBufferPtr& packet);
+  // the caller keeps packet unchanged until release(packet, cookie) runs, also when the send
+  // fails; see SendRelease for the thread it runs on
+  bool TcpSend(TcpHandle handle, const char* packet, int size, SendRelease release, void* cookie);
   bool TcpGetLocalAddr(TcpHandle handle, char ip[16], int& port);
   bool TcpGetRemoteAddr(TcpHandle handle, char ip[16], int& port);
+  bool TcpGetStats(TcpHandle handle, TcpStats& stats);
+  // an opaque pointer kept on the socket and handed to its callbacks, cleared when it closes
+  bool SetTcpContext(TcpHandle handle, void* context);
+  bool GetTcpContext(TcpHandle handle, void*& context);
   bool UdpCreate(const std::string& ip, int port, UdpHandle& new_handle);
+  bool UdpCreate(const std::string& ip, int port, const UdpConfig& config, UdpHandle& new_handle);
   bool UdpDestroy(UdpHandle handle);
   bool UdpSendTo(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, const std::string& ip, int port);
+  bool UdpSendTo(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, const NetEndpoint& to);
+  bool UdpSendTo(UdpHandle handle, const NetBufferPtr& packet, const NetEndpoint& to);
+  bool UdpSendTo(UdpHandle handle, const char* packet, int size, const NetEndpoint& to, SendRelease release, void* cookie);
+  bool UdpSendToBatch(UdpHandle handle, std::vector<UdpSendItem>&& items);
+  // without send offload the segments are sent one by one, false then means at least one of
+  // them was not sent while the others still were
+  bool UdpSendSegments(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, int segment_size, const std::string& ip, int port);
+  bool UdpSendSegments(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size, int segment_size, const NetEndpoint& to);
+  bool UdpConnect(UdpHandle handle, const NetEndpoint& peer);
+  bool UdpSend(UdpHandle handle, std::unique_ptr<char[]>&& packet, int size);
+  bool UdpGetOffloadInfo(UdpHandle handle, UdpOffloadInfo& info);
+  bool UdpGetRecvStats(UdpHandle handle, UdpRecvStats& stats);
+  bool SetUdpContext(UdpHandle handle, void* context);
+  bool GetUdpContext(UdpHandle handle, void*& context);
+  bool UdpSetPacing(UdpHandle handle, int rate, int burst);
+  bool UdpGetPacingStats(UdpHandle handle, UdpPacingStats& stats);
+  // an empty interface_ip lets the stack choose, a non empty source joins that source only
+  bool UdpJoinGroup(UdpHandle handle, const std::string& group, const std::string& interface_ip, const std::string& source);
+  bool UdpLeaveGroup(UdpHandle handle, const std::string& group, const std::string& interface_ip, const std::string& source);
+  // subscribers receive every datagram of a handle created by another interface, the packet
+  // memory is shared with the owner and only valid during the callback
+  bool UdpSubscribe(UdpHandle handle);
+  bool UdpUnsubscribe(UdpHandle handle);
+  bool RudpCreate(UdpHandle udp_handle, const NetEndpoint& peer, unsigned int conv, const RudpConfig& config, RudpHandle& new_handle);
+  bool RudpListen(UdpHandle udp_handle, const RudpConfig& config);
+  bool RudpDestroy(RudpHandle handle);
+  bool RudpSend(RudpHandle handle, std::unique_ptr<char[]>&& packet, int size);
+  bool RudpGetStats(RudpHandle handle, RudpStats& stats);
+  bool TcpPoolCreate(const std::string& ip, int port, const TcpPoolConfig& config, TcpPoolHandle& new_handle);
+  bool TcpPoolDestroy(TcpPoolHandle handle);
+  bool TcpPoolSend(TcpPoolHandle handle, std::unique_ptr<char[]>&& packet, int size);
+  bool TcpPoolGetStats(TcpPoolHandle handle, TcpPoolStats& stats);
+  // feeds the received traffic of a capture to this interface on the calling thread with the
+  // captured handles, at the captured pace or as fast as possible; needs no started net
+  bool ReplayCapture(const std::string& path, bool original_speed, CaptureReplayStats& stats);
+  // routes the handles of this interface to engine instead of the default one, call it before
+  // the first handle is created; a null engine goes back to the default
+  bool BindEngine(const std::shared_ptr<NetEngine>& engine);
+
+ private:
+  NetResMgr* res_mgr() const;
+
+ private:
+  std::shared_ptr<NetEngine> engine_;
 };
 
 } // namespace net
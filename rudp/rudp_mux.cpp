@@ -0,0 +1,45 @@
+#include "rudp_mux.h"
+
+namespace net {
+
+RudpMux::RudpMux() {
+  active_ = false;
+  listening_ = false;
+}
+
+void RudpMux::Listen(const RudpConfig& config, const std::weak_ptr<NetInterface>& callback) {
+  std::lock_guard<std::mutex> lock(mux_lock_);
+  listening_ = true;
+  listen_config_ = config;
+  listen_callback_ = callback;
+  active_ = true;
+}
+
+bool RudpMux::listening(RudpConfig& config, std::shared_ptr<NetInterface>& callback) {
+  std::lock_guard<std::mutex> lock(mux_lock_);
+  if (!listening_) {
+    return false;
+  }
+  config = listen_config_;
+  callback = listen_callback_.lock();
+  return callback != nullptr;
+}
+
+bool RudpMux::Add(const NetEndpoint& peer, unsigned int conv, RudpHandle handle) {
+  std::lock_guard<std::mutex> lock(mux_lock_);
+  active_ = true;
+  return sessions_.emplace(Key{peer, conv}, handle).second;
+}
+
+void RudpMux::Remove(const NetEndpoint& peer, unsigned int conv) {
+  std::lock_guard<std::mutex> lock(mux_lock_);
+  sessions_.erase(Key{peer, conv});
+}
+
+RudpHandle RudpMux::Find(const NetEndpoint& peer, unsigned int conv) {
+  std::lock_guard<std::mutex> lock(mux_lock_);
+  auto i = sessions_.find(Key{peer, conv});
+  return i == sessions_.end() ? kInvalidRudpHandle : i->second;
+}
+
+} // namespace net
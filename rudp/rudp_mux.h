@@ -0,0 +1,47 @@
+#ifndef NET_RUDP_MUX_H_
+#define NET_RUDP_MUX_H_
+
+#include "net_interface.h"
+#include "uncopyable.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace net {
+
+// reliable udp sessions sharing one udp handle, found by peer and conversation id;
+// a listening mux accepts sessions for unknown pairs with its config and callback
+class RudpMux : public utility::Uncopyable {
+ public:
+  RudpMux();
+
+  void Listen(const RudpConfig& config, const std::weak_ptr<NetInterface>& callback);
+  bool listening(RudpConfig& config, std::shared_ptr<NetInterface>& callback);
+  bool Add(const NetEndpoint& peer, unsigned int conv, RudpHandle handle);
+  void Remove(const NetEndpoint& peer, unsigned int conv);
+  RudpHandle Find(const NetEndpoint& peer, unsigned int conv);
+  bool active() const { return active_; }
+
+ private:
+  struct Key {
+    NetEndpoint peer;
+    unsigned int conv;
+    bool operator==(const Key& other) const { return conv == other.conv && peer == other.peer; }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& key) const { return key.peer.Hash() * 31 + key.conv; }
+  };
+
+ private:
+  std::atomic<bool> active_;
+  bool listening_;
+  RudpConfig listen_config_;
+  std::weak_ptr<NetInterface> listen_callback_;
+  std::unordered_map<Key, RudpHandle, KeyHash> sessions_;
+  std::mutex mux_lock_;
+};
+
+} // namespace net
+
+#endif	// NET_RUDP_MUX_H_
@@ -0,0 +1,488 @@
+#include "rudp_session.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+namespace net {
+
+namespace {
+
+const int kRudpMaxRto = 60 * 1000;
+const int kRudpProbeInitMs = 7 * 1000;
+const int kRudpProbeLimitMs = 120 * 1000;
+const int kRudpMinSsthresh = 2;
+const int kRudpInitSsthresh = 2;
+
+int Diff(unsigned int later, unsigned int earlier) {
+  return static_cast<int>(later - earlier);
+}
+
+char* Encode8(char* p, unsigned int value) {
+  *p = static_cast<char>(value);
+  return p + 1;
+}
+
+char* Encode16(char* p, unsigned int value) {
+  p[0] = static_cast<char>(value);
+  p[1] = static_cast<char>(value >> 8);
+  return p + 2;
+}
+
+char* Encode32(char* p, unsigned int value) {
+  for (auto i = 0; i < 4; ++i) {
+    p[i] = static_cast<char>(value >> (i * 8));
+  }
+  return p + 4;
+}
+
+const char* Decode8(const char* p, unsigned int& value) {
+  value = static_cast<unsigned char>(*p);
+  return p + 1;
+}
+
+const char* Decode16(const char* p, unsigned int& value) {
+  value = static_cast<unsigned char>(p[0]) | (static_cast<unsigned char>(p[1]) << 8);
+  return p + 2;
+}
+
+const char* Decode32(const char* p, unsigned int& value) {
+  value = 0;
+  for (auto i = 0; i < 4; ++i) {
+    value |= static_cast<unsigned int>(static_cast<unsigned char>(p[i])) << (i * 8);
+  }
+  return p + 4;
+}
+
+} // namespace
+
+RudpSession::RudpSession(UdpHandle udp_handle, const NetEndpoint& peer, unsigned int conv, const RudpConfig& config) {
+  udp_handle_ = udp_handle;
+  peer_ = peer;
+  conv_ = conv;
+  mtu_ = config.mtu;
+  mss_ = mtu_ - kRudpHeaderSize;
+  interval_ms_ = config.interval_ms;
+  send_window_ = config.send_window;
+  recv_window_ = config.recv_window;
+  min_rto_ = config.min_rto_ms;
+  fast_resend_ = config.fast_resend;
+  dead_link_ = config.dead_link;
+  congestion_control_ = config.congestion_control;
+  pacing_rate_ = config.pacing_rate;
+  ordered_ = config.ordered;
+  snd_una_ = 0;
+  snd_nxt_ = 0;
+  rcv_nxt_ = 0;
+  remote_window_ = recv_window_;
+  srtt_ = 0;
+  rttvar_ = 0;
+  rto_ = std::max(min_rto_, 200);
+  cwnd_ = 1;
+  ssthresh_ = kRudpInitSsthresh;
+  incr_ = mss_;
+  probe_ask_ = false;
+  probe_tell_ = false;
+  probe_ts_ = 0;
+  probe_wait_ = 0;
+  dropping_ = false;
+  dropped_message_ = false;
+  if (pacing_rate_ > 0) {
+    pacing_bucket_.Init(pacing_rate_, std::max(mtu_ * 4.0, pacing_rate_ * interval_ms_ / 1000.0));
+  }
+}
+
+bool RudpSession::PeekConv(const char* packet, int size, unsigned int& conv, int& cmd) {
+  if (packet == nullptr || size < kRudpHeaderSize) {
+    return false;
+  }
+  unsigned int value = 0;
+  auto p = Decode32(packet, conv);
+  Decode8(p, value);
+  cmd = static_cast<int>(value);
+  return cmd >= kRudpCmdPush && cmd <= kRudpCmdWindowTell;
+}
+
+// a message is cut into segments of mss bytes, frg counts the segments still to come
+bool RudpSession::Send(const char* packet, int size) {
+  if (packet == nullptr || size <= 0) {
+    return false;
+  }
+  auto count = (size + mss_ - 1) / mss_;
+  if (count > kMaxRudpFragments || count > recv_window_ || (!ordered_ && count > 1)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(session_lock_);
+  for (auto i = 0; i < count; ++i) {
+    auto offset = i * mss_;
+    auto length = std::min(mss_, size - offset);
+    Segment segment;
+    segment.frg = ordered_ ? count - 1 - i : 0;
+    segment.data.assign(packet + offset, packet + offset + length);
+    snd_queue_.push_back(std::move(segment));
+  }
+  return true;
+}
+
+bool RudpSession::Input(const char* packet, int size) {
+  if (packet == nullptr || size < kRudpHeaderSize) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(session_lock_);
+  auto prev_una = snd_una_;
+  auto ack_found = false;
+  unsigned int max_ack = 0;
+  while (size >= kRudpHeaderSize) {
+    unsigned int conv = 0, cmd = 0, frg = 0, wnd = 0, ts = 0, sn = 0, una = 0, len = 0;
+    auto p = Decode32(packet, conv);
+    p = Decode8(p, cmd);
+    p = Decode8(p, frg);
+    p = Decode16(p, wnd);
+    p = Decode32(p, ts);
+    p = Decode32(p, sn);
+    p = Decode32(p, una);
+    p = Decode32(p, len);
+    if (conv != conv_ || len > static_cast<unsigned int>(size - kRudpHeaderSize) ||
+      cmd < kRudpCmdPush || cmd > kRudpCmdWindowTell) {
+      return false;
+    }
+    remote_window_ = wnd;
+    ParseUna(una);
+    ShrinkSendBuffer();
+    if (cmd == kRudpCmdAck) {
+      auto rtt = Diff(Now(), ts);
+      if (rtt >= 0) {
+        UpdateRtt(rtt);
+      }
+      ParseAck(sn);
+      ShrinkSendBuffer();
+      if (!ack_found || Diff(sn, max_ack) > 0) {
+        max_ack = sn;
+        ack_found = true;
+      }
+    } else if (cmd == kRudpCmdPush) {
+      ++stats_.received_segments;
+      if (Diff(sn, rcv_nxt_ + recv_window_) < 0) {
+        acks_.push_back(std::make_pair(sn, ts));
+        if (Diff(sn, rcv_nxt_) >= 0) {
+          Segment segment;
+          segment.sn = sn;
+          segment.frg = frg;
+          segment.data.assign(p, p + len);
+          ParsePush(std::move(segment));
+        } else {
+          ++stats_.duplicates;
+        }
+      }
+    } else if (cmd == kRudpCmdWindowAsk) {
+      probe_tell_ = true;
+    }
+    packet = p + len;
+    size -= kRudpHeaderSize + len;
+  }
+  if (ack_found) {
+    ParseFastack(max_ack);
+  }
+  // slow start below ssthresh, then about one segment per window of acks
+  if (congestion_control_ && Diff(snd_una_, prev_una) > 0 && cwnd_ < remote_window_) {
+    if (cwnd_ < ssthresh_) {
+      ++cwnd_;
+      incr_ += mss_;
+    } else {
+      incr_ = std::max(incr_, mss_);
+      incr_ += (mss_ * mss_) / incr_ + mss_ / 16;
+      if ((cwnd_ + 1) * mss_ <= incr_) {
+        cwnd_ = (incr_ + mss_ - 1) / mss_;
+      }
+    }
+    if (cwnd_ > remote_window_) {
+      cwnd_ = remote_window_;
+      incr_ = remote_window_ * mss_;
+    }
+  }
+  return true;
+}
+
+// acks, window probes, new segments within the windows and the pacing budget, then
+// timeouts and fast retransmits, packed into datagrams of at most mtu bytes
+bool RudpSession::Flush(const Output& output) {
+  std::lock_guard<std::mutex> lock(session_lock_);
+  auto now = Now();
+  auto window_unused = RecvWindowUnused();
+  std::unique_ptr<char[]> datagram;
+  auto used = 0;
+  auto emit = [&]() {
+    if (used > 0) {
+      output(std::move(datagram), used);
+      datagram.reset();
+      used = 0;
+    }
+  };
+  auto append = [&](int cmd, int frg, unsigned int ts, unsigned int sn, const char* data, int len) {
+    if (used + kRudpHeaderSize + len > mtu_) {
+      emit();
+    }
+    if (datagram == nullptr) {
+      datagram.reset(new char[mtu_]);
+    }
+    auto p = datagram.get() + used;
+    p = Encode32(p, conv_);
+    p = Encode8(p, cmd);
+    p = Encode8(p, frg);
+    p = Encode16(p, window_unused);
+    p = Encode32(p, ts);
+    p = Encode32(p, sn);
+    p = Encode32(p, rcv_nxt_);
+    p = Encode32(p, len);
+    if (len > 0) {
+      memcpy(p, data, len);
+    }
+    used += kRudpHeaderSize + len;
+  };
+  for (auto& i : acks_) {
+    append(kRudpCmdAck, 0, i.second, i.first, nullptr, 0);
+  }
+  acks_.clear();
+  if (remote_window_ == 0) {
+    if (probe_wait_ == 0) {
+      probe_wait_ = kRudpProbeInitMs;
+      probe_ts_ = now + probe_wait_;
+    } else if (Diff(now, probe_ts_) >= 0) {
+      probe_wait_ = std::min(probe_wait_ + probe_wait_ / 2, kRudpProbeLimitMs);
+      probe_ts_ = now + probe_wait_;
+      probe_ask_ = true;
+    }
+  } else {
+    probe_ts_ = 0;
+    probe_wait_ = 0;
+  }
+  if (probe_ask_) {
+    append(kRudpCmdWindowAsk, 0, now, 0, nullptr, 0);
+  }
+  if (probe_tell_) {
+    append(kRudpCmdWindowTell, 0, now, 0, nullptr, 0);
+  }
+  probe_ask_ = false;
+  probe_tell_ = false;
+  auto limit = std::min(send_window_, remote_window_);
+  if (congestion_control_) {
+    limit = std::min(limit, cwnd_);
+  }
+  UpdatePacing();
+  while (Diff(snd_nxt_, snd_una_ + limit) < 0 && !snd_queue_.empty()) {
+    auto& segment = snd_queue_.front();
+    if (!pacing_bucket_.Consume(static_cast<double>(segment.data.size() + kRudpHeaderSize))) {
+      break;
+    }
+    segment.sn = snd_nxt_++;
+    snd_buf_.push_back(std::move(segment));
+    snd_queue_.pop_front();
+  }
+  auto resent = fast_resend_ > 0 ? fast_resend_ : INT_MAX;
+  auto changed = false;
+  auto lost = false;
+  auto dead = false;
+  for (auto& segment : snd_buf_) {
+    auto send = false;
+    if (segment.xmit == 0) {
+      send = true;
+      segment.rto = rto_;
+      segment.resend_ts = now + segment.rto;
+    } else if (Diff(now, segment.resend_ts) >= 0) {
+      send = true;
+      segment.rto = std::min(segment.rto + segment.rto / 2, kRudpMaxRto);
+      segment.resend_ts = now + segment.rto;
+      lost = true;
+      ++stats_.retransmits;
+    } else if (segment.fastack >= resent) {
+      send = true;
+      segment.fastack = 0;
+      segment.resend_ts = now + segment.rto;
+      changed = true;
+      ++stats_.fast_retransmits;
+    }
+    if (!send) {
+      continue;
+    }
+    if (segment.xmit > 0) {
+      pacing_bucket_.ForceConsume(static_cast<double>(segment.data.size() + kRudpHeaderSize));
+    }
+    ++segment.xmit;
+    segment.ts = now;
+    append(kRudpCmdPush, segment.frg, segment.ts, segment.sn, segment.data.data(), static_cast<int>(segment.data.size()));
+    ++stats_.sent_segments;
+    if (segment.xmit >= dead_link_) {
+      dead = true;
+    }
+  }
+  emit();
+  if (congestion_control_) {
+    if (changed) {
+      ssthresh_ = std::max(Diff(snd_nxt_, snd_una_) / 2, kRudpMinSsthresh);
+      cwnd_ = ssthresh_ + resent;
+      incr_ = cwnd_ * mss_;
+    }
+    if (lost) {
+      ssthresh_ = std::max(cwnd_ / 2, kRudpMinSsthresh);
+      cwnd_ = 1;
+      incr_ = mss_;
+    }
+    if (cwnd_ < 1) {
+      cwnd_ = 1;
+      incr_ = mss_;
+    }
+  }
+  return !dead;
+}
+
+// deliver_lock_ keeps the messages of one session in order across workers, the
+// callback runs without session_lock_ so it may send on the same session
+void RudpSession::Deliver(const Receive& receive) {
+  std::lock_guard<std::mutex> deliver_lock(deliver_lock_);
+  while (true) {
+    std::vector<char> message;
+    {
+      std::lock_guard<std::mutex> lock(session_lock_);
+      if (ready_.empty()) {
+        break;
+      }
+      message = std::move(ready_.front());
+      ready_.pop_front();
+    }
+    receive(message.data(), static_cast<int>(message.size()));
+  }
+}
+
+bool RudpSession::TakeDroppedMessage() {
+  std::lock_guard<std::mutex> lock(session_lock_);
+  auto dropped = dropped_message_;
+  dropped_message_ = false;
+  return dropped;
+}
+
+void RudpSession::GetStats(RudpStats& stats) {
+  std::lock_guard<std::mutex> lock(session_lock_);
+  stats = stats_;
+  stats.srtt_ms = srtt_;
+  stats.rttvar_ms = rttvar_;
+  stats.rto_ms = rto_;
+  stats.congestion_window = cwnd_;
+  stats.remote_window = remote_window_;
+  stats.in_flight = static_cast<int>(snd_buf_.size());
+  stats.queued = static_cast<int>(snd_queue_.size());
+}
+
+unsigned int RudpSession::Now() {
+  return static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+int RudpSession::RecvWindowUnused() const {
+  return std::max(recv_window_ - static_cast<int>(rcv_buf_.size() + ready_.size()), 0);
+}
+
+void RudpSession::UpdateRtt(int rtt) {
+  if (srtt_ == 0) {
+    srtt_ = std::max(rtt, 1);
+    rttvar_ = rtt / 2;
+  } else {
+    auto delta = std::abs(rtt - srtt_);
+    rttvar_ = (3 * rttvar_ + delta) / 4;
+    srtt_ = std::max((7 * srtt_ + rtt) / 8, 1);
+  }
+  rto_ = std::min(std::max(srtt_ + std::max(interval_ms_, 4 * rttvar_), min_rto_), kRudpMaxRto);
+}
+
+void RudpSession::ParseUna(unsigned int una) {
+  while (!snd_buf_.empty() && Diff(una, snd_buf_.front().sn) > 0) {
+    snd_buf_.pop_front();
+  }
+}
+
+void RudpSession::ParseAck(unsigned int sn) {
+  if (Diff(sn, snd_una_) < 0 || Diff(sn, snd_nxt_) >= 0) {
+    return;
+  }
+  for (auto i = snd_buf_.begin(); i != snd_buf_.end(); ++i) {
+    if (i->sn == sn) {
+      snd_buf_.erase(i);
+      break;
+    }
+    if (Diff(sn, i->sn) < 0) {
+      break;
+    }
+  }
+}
+
+// every segment older than the newest acked one was skipped by that ack
+void RudpSession::ParseFastack(unsigned int sn) {
+  if (Diff(sn, snd_una_) < 0 || Diff(sn, snd_nxt_) >= 0) {
+    return;
+  }
+  for (auto& i : snd_buf_) {
+    if (Diff(sn, i.sn) <= 0) {
+      break;
+    }
+    ++i.fastack;
+  }
+}
+
+void RudpSession::ShrinkSendBuffer() {
+  snd_una_ = snd_buf_.empty() ? snd_nxt_ : snd_buf_.front().sn;
+}
+
+// unordered sessions hand the message out at once and keep an empty placeholder,
+// so duplicates are still detected and rcv_nxt_ still advances
+void RudpSession::ParsePush(Segment&& segment) {
+  if (rcv_buf_.find(segment.sn) != rcv_buf_.end()) {
+    ++stats_.duplicates;
+    return;
+  }
+  if (!ordered_) {
+    ready_.push_back(std::move(segment.data));
+    ++stats_.delivered;
+    segment.data.clear();
+    segment.delivered = true;
+  }
+  auto sn = segment.sn;
+  rcv_buf_.emplace(sn, std::move(segment));
+  MoveToReady();
+}
+
+// a message over kMaxRudpFragments segments is counted and skipped up to its last fragment,
+// so its tail is not handed out as a message of its own
+void RudpSession::MoveToReady() {
+  auto i = rcv_buf_.find(rcv_nxt_);
+  while (i != rcv_buf_.end()) {
+    if (dropping_) {
+      dropping_ = i->second.frg != 0;
+    } else if (!i->second.delivered) {
+      partial_.insert(partial_.end(), i->second.data.begin(), i->second.data.end());
+      if (partial_.size() > static_cast<size_t>(kMaxRudpFragments * mss_)) {
+        partial_.clear();
+        dropping_ = i->second.frg != 0;
+        dropped_message_ = true;
+        ++stats_.oversized_drops;
+      } else if (i->second.frg == 0) {
+        ready_.push_back(std::move(partial_));
+        partial_.clear();
+        ++stats_.delivered;
+      }
+    }
+    rcv_buf_.erase(i);
+    ++rcv_nxt_;
+    i = rcv_buf_.find(rcv_nxt_);
+  }
+}
+
+// without a configured rate new segments are paced at 1.25 windows per srtt
+void RudpSession::UpdatePacing() {
+  if (pacing_rate_ > 0 || !congestion_control_ || srtt_ == 0) {
+    return;
+  }
+  auto rate = 1.25 * cwnd_ * mss_ * 1000 / srtt_;
+  pacing_bucket_.SetRate(rate, std::max(mtu_ * 4.0, rate * interval_ms_ / 1000 * 2));
+}
+
+} // namespace net
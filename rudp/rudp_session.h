@@ -0,0 +1,116 @@
+#ifndef NET_RUDP_SESSION_H_
+#define NET_RUDP_SESSION_H_
+
+#include "net_interface.h"
+#include "token_bucket.h"
+#include "uncopyable.h"
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace net {
+
+const int kRudpHeaderSize = 24;
+const int kRudpCmdPush = 81;
+const int kRudpCmdAck = 82;
+const int kRudpCmdWindowAsk = 83;
+const int kRudpCmdWindowTell = 84;
+
+// kcp style arq state of one session, every push is acked on its own (selective ack)
+class RudpSession : public utility::Uncopyable {
+ public:
+  typedef std::function<void (std::unique_ptr<char[]>&&, int)> Output;
+  typedef std::function<void (const char*, int)> Receive;
+
+  RudpSession(UdpHandle udp_handle, const NetEndpoint& peer, unsigned int conv, const RudpConfig& config);
+
+  static bool PeekConv(const char* packet, int size, unsigned int& conv, int& cmd);
+
+  bool Send(const char* packet, int size);
+  bool Input(const char* packet, int size);
+  bool Flush(const Output& output);
+  void Deliver(const Receive& receive);
+  // true once after Input dropped an oversized ordered message
+  bool TakeDroppedMessage();
+  void GetStats(RudpStats& stats);
+
+  void set_callback(const std::weak_ptr<NetInterface>& callback) { callback_ = callback; }
+  std::shared_ptr<NetInterface> callback() const { return callback_.lock(); }
+  UdpHandle udp_handle() const { return udp_handle_; }
+  const NetEndpoint& peer() const { return peer_; }
+  unsigned int conv() const { return conv_; }
+  int interval_ms() const { return interval_ms_; }
+
+ private:
+  struct Segment {
+    unsigned int sn = 0;
+    int frg = 0;
+    unsigned int ts = 0;
+    unsigned int resend_ts = 0;
+    int rto = 0;
+    int fastack = 0;
+    int xmit = 0;
+    bool delivered = false;
+    std::vector<char> data;
+  };
+
+  static unsigned int Now();
+  int RecvWindowUnused() const;
+  void UpdateRtt(int rtt);
+  void ParseUna(unsigned int una);
+  void ParseAck(unsigned int sn);
+  void ParseFastack(unsigned int sn);
+  void ShrinkSendBuffer();
+  void ParsePush(Segment&& segment);
+  void MoveToReady();
+  void UpdatePacing();
+
+ private:
+  std::weak_ptr<NetInterface> callback_;
+  UdpHandle udp_handle_;
+  NetEndpoint peer_;
+  unsigned int conv_;
+  int mtu_;
+  int mss_;
+  int interval_ms_;
+  int send_window_;
+  int recv_window_;
+  int min_rto_;
+  int fast_resend_;
+  int dead_link_;
+  bool congestion_control_;
+  int pacing_rate_;
+  bool ordered_;
+  unsigned int snd_una_;
+  unsigned int snd_nxt_;
+  unsigned int rcv_nxt_;
+  int remote_window_;
+  int srtt_;
+  int rttvar_;
+  int rto_;
+  int cwnd_;
+  int ssthresh_;
+  int incr_;
+  bool probe_ask_;
+  bool probe_tell_;
+  unsigned int probe_ts_;
+  int probe_wait_;
+  std::deque<Segment> snd_queue_;
+  std::deque<Segment> snd_buf_;
+  std::map<unsigned int, Segment> rcv_buf_;
+  std::vector<std::pair<unsigned int, unsigned int>> acks_;
+  std::vector<char> partial_;
+  bool dropping_;
+  bool dropped_message_;
+  std::deque<std::vector<char>> ready_;
+  TokenBucket pacing_bucket_;
+  RudpStats stats_;
+  std::mutex session_lock_;
+  std::mutex deliver_lock_;
+};
+
+} // namespace net
+
+#endif	// NET_RUDP_SESSION_H_
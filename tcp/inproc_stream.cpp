@@ -0,0 +1,154 @@
+#include "inproc_stream.h"
+#include "net_log.h"
+
+namespace net {
+
+InprocStream::InprocStream(Complete&& complete)
+  : complete_(std::move(complete)), paired_(false), closed_(false), pending_offset_(0),
+    recv_buffer_(nullptr), recv_size_(0), recv_ovlp_(nullptr), local_port_(0), remote_port_(0) {
+}
+
+void InprocStream::Pair(const std::shared_ptr<InprocStream>& first, const std::shared_ptr<InprocStream>& second) {
+  std::string first_ip;
+  std::string second_ip;
+  auto first_port = 0;
+  auto second_port = 0;
+  first->GetLocalAddr(first_ip, first_port);
+  second->GetLocalAddr(second_ip, second_port);
+  {
+    std::lock_guard<std::mutex> lock(first->stream_lock_);
+    first->peer_ = second;
+    first->paired_ = true;
+    first->remote_ip_ = second_ip;
+    first->remote_port_ = second_port;
+  }
+  std::lock_guard<std::mutex> lock(second->stream_lock_);
+  second->peer_ = first;
+  second->paired_ = true;
+  second->remote_ip_ = first_ip;
+  second->remote_port_ = first_port;
+}
+
+bool InprocStream::Send(const char* head, int head_size, const char* buffer, int size, LPOVERLAPPED ovlp) {
+  std::shared_ptr<InprocStream> peer;
+  {
+    std::lock_guard<std::mutex> lock(stream_lock_);
+    if (closed_) {
+      NET_LOG(kError, "inproc stream send failed: closed.");
+      return false;
+    }
+    peer = peer_.lock();
+  }
+  if (peer == nullptr || !peer->Deliver(head, head_size, buffer, size)) {
+    NET_LOG(kError, "inproc stream send failed: peer closed.");
+    return false;
+  }
+  return complete_(ovlp, head_size + size);
+}
+
+bool InprocStream::Recv(char* buffer, int size, LPOVERLAPPED ovlp) {
+  std::lock_guard<std::mutex> lock(stream_lock_);
+  if (recv_ovlp_ != nullptr) {
+    NET_LOG(kError, "inproc stream recv failed: recv already pending.");
+    return false;
+  }
+  recv_buffer_ = buffer;
+  recv_size_ = size;
+  recv_ovlp_ = ovlp;
+  if (pending_offset_ < pending_.size() || closed_) {
+    return CompleteRecv();
+  }
+  return true;
+}
+
+// the own recv completes empty, the peer reads what is pending and then sees the close
+void InprocStream::Close() {
+  std::shared_ptr<InprocStream> peer;
+  {
+    std::lock_guard<std::mutex> lock(stream_lock_);
+    if (closed_ && !paired_) {
+      return;
+    }
+    closed_ = true;
+    paired_ = false;
+    peer = peer_.lock();
+    peer_.reset();
+    pending_.clear();
+    pending_offset_ = 0;
+    if (recv_ovlp_ != nullptr) {
+      CompleteRecv();
+    }
+  }
+  if (peer != nullptr) {
+    peer->OnPeerClosed();
+  }
+}
+
+void InprocStream::SetLocalAddr(const std::string& ip, int port) {
+  std::lock_guard<std::mutex> lock(stream_lock_);
+  local_ip_ = ip;
+  local_port_ = port;
+}
+
+void InprocStream::GetLocalAddr(std::string& ip, int& port) {
+  std::lock_guard<std::mutex> lock(stream_lock_);
+  ip = local_ip_;
+  port = local_port_;
+}
+
+bool InprocStream::GetRemoteAddr(std::string& ip, int& port) {
+  std::lock_guard<std::mutex> lock(stream_lock_);
+  if (!paired_) {
+    return false;
+  }
+  ip = remote_ip_;
+  port = remote_port_;
+  return true;
+}
+
+bool InprocStream::Deliver(const char* head, int head_size, const char* buffer, int size) {
+  std::lock_guard<std::mutex> lock(stream_lock_);
+  if (closed_) {
+    return false;
+  }
+  pending_.insert(pending_.end(), head, head + head_size);
+  pending_.insert(pending_.end(), buffer, buffer + size);
+  if (recv_ovlp_ != nullptr) {
+    return CompleteRecv();
+  }
+  return true;
+}
+
+void InprocStream::OnPeerClosed() {
+  std::lock_guard<std::mutex> lock(stream_lock_);
+  closed_ = true;
+  peer_.reset();
+  if (recv_ovlp_ != nullptr) {
+    CompleteRecv();
+  }
+}
+
+// called with stream_lock_ held; read bytes are dropped from the front once they are the
+// larger part of pending_, so a slow reader does not move every byte twice
+bool InprocStream::CompleteRecv() {
+  auto available = pending_.size() - pending_offset_;
+  auto size = available < static_cast<size_t>(recv_size_) ? static_cast<int>(available) : recv_size_;
+  if (size > 0) {
+    memcpy(recv_buffer_, pending_.data() + pending_offset_, size);
+    pending_offset_ += size;
+    if (pending_offset_ == pending_.size()) {
+      pending_.clear();
+      pending_offset_ = 0;
+    } else if (pending_offset_ > pending_.size() / 2) {
+      pending_.erase(pending_.begin(), pending_.begin() + pending_offset_);
+      pending_offset_ = 0;
+    }
+  }
+  auto ovlp = recv_ovlp_;
+  recv_buffer_ = nullptr;
+  recv_size_ = 0;
+  recv_ovlp_ = nullptr;
+  return complete_(ovlp, size);
+}
+
+} // namespace net
@@ -0,0 +1,54 @@
+#ifndef NET_INPROC_STREAM_H_
+#define NET_INPROC_STREAM_H_
+
+#include "uncopyable.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <WinSock2.h>
+
+namespace net {
+
+// one end of an in-memory tcp connection, completions go through the iocp dispatch
+class InprocStream : public utility::Uncopyable {
+ public:
+  typedef std::function<bool (LPOVERLAPPED, DWORD)> Complete;
+
+  explicit InprocStream(Complete&& complete);
+
+  static void Pair(const std::shared_ptr<InprocStream>& first, const std::shared_ptr<InprocStream>& second);
+
+  bool Send(const char* head, int head_size, const char* buffer, int size, LPOVERLAPPED ovlp);
+  bool Recv(char* buffer, int size, LPOVERLAPPED ovlp);
+  void Close();
+  void SetLocalAddr(const std::string& ip, int port);
+  void GetLocalAddr(std::string& ip, int& port);
+  bool GetRemoteAddr(std::string& ip, int& port);
+
+ private:
+  bool Deliver(const char* head, int head_size, const char* buffer, int size);
+  void OnPeerClosed();
+  bool CompleteRecv();
+
+ private:
+  Complete complete_;
+  std::mutex stream_lock_;
+  std::weak_ptr<InprocStream> peer_;
+  bool paired_;
+  bool closed_;
+  std::vector<char> pending_;
+  size_t pending_offset_;
+  char* recv_buffer_;
+  int recv_size_;
+  LPOVERLAPPED recv_ovlp_;
+  std::string local_ip_;
+  int local_port_;
+  std::string remote_ip_;
+  int remote_port_;
+};
+
+} // namespace net
+
+#endif	// NET_INPROC_STREAM_H_
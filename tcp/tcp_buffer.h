@@ -2,6 +2,7 @@
 #define NET_TCP_BUFFER_H_
 
 #include "base_buffer.h"
+#include "send_payload.h"
 #include "tcp_head.h"
 #include <functional>
 #include <memory>
@@ -11,23 +12,38 @@ namespace net {
 const int kTcpAcceptBuffSize = 64;
 const int kTcpBufferSize = 2048;
 
+class TcpSocket;
+
 class TcpSendBuffer : public BaseBuffer {
  public:
   TcpSendBuffer() {
     set_async_type(kAsyncTypeTcpSend);
   }
   ~TcpSendBuffer() {}
-  void set_buffer(std::unique_ptr<char[]>&& buffer, int size) {
+  void set_buffer(SendPayload&& buffer, int size) {
     buffer_ = std::move(buffer);
     head_.Init(size);
     set_buffer_size(size);
   }
+  // drops the payload and the socket before the context goes back to its pool
+  void Reset() {
+    ResetBuffer();
+    buffer_.reset();
+    socket_.reset();
+    pinned_socket_.reset();
+  }
   const TcpHead* head() const { return &head_; }
   const char* buffer() const { return buffer_.get(); }
+  void set_socket(const std::weak_ptr<TcpSocket>& socket) { socket_ = socket; }
+  std::shared_ptr<TcpSocket> socket() const { return socket_.lock(); }
+  // a recyclable socket is kept until its last operation completed
+  void set_pinned_socket(const std::shared_ptr<TcpSocket>& socket) { pinned_socket_ = socket; }
 
  private:
   TcpHead head_;
-  std::unique_ptr<char[]> buffer_;
+  SendPayload buffer_;
+  std::weak_ptr<TcpSocket> socket_;
+  std::shared_ptr<TcpSocket> pinned_socket_;
 };
 
 class TcpRecvBuffer : public BaseBuffer {
@@ -37,13 +53,13 @@ class TcpRecvBuffer : public BaseBuffer {
     set_buffer_size(sizeof(buffer_));
   }
   char* buffer() { return buffer_; }
+  void set_pinned_socket(const std::shared_ptr<TcpSocket>& socket) { pinned_socket_ = socket; }
 
  private:
   char buffer_[kTcpBufferSize];
+  std::shared_ptr<TcpSocket> pinned_socket_;
 };
 
-class TcpSocket;
-
 class TcpAcceptBuffer : public BaseBuffer {
  public:
   TcpAcceptBuffer() {
@@ -59,6 +75,25 @@ class TcpAcceptBuffer : public BaseBuffer {
   std::unique_ptr<TcpSocket> accept_socket_;
 };
 
+class TcpConnectBuffer : public BaseBuffer {
+ public:
+  TcpConnectBuffer() {
+    set_async_type(kAsyncTypeTcpConnect);
+  }
+};
+
+class TcpDisconnectBuffer : public BaseBuffer {
+ public:
+  TcpDisconnectBuffer() {
+    set_async_type(kAsyncTypeTcpDisconnect);
+  }
+  void set_socket(std::unique_ptr<TcpSocket>&& value) { socket_ = std::move(value); }
+  std::unique_ptr<TcpSocket> socket() { return std::move(socket_); }
+
+ private:
+  std::unique_ptr<TcpSocket> socket_;
+};
+
 } // namespace net
 
 #endif	// NET_TCP_BUFFER_H_
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include "tcp_conn_pool.h"
+#include <algorithm>
+
+namespace net {
+
+const int kMaxBackoffShift = 20;
+
+TcpConnPool::TcpConnPool(const std::weak_ptr<NetInterface>& callback, const std::string& ip, int port, const TcpPoolConfig& config)
+  : callback_(callback), ip_(ip), port_(port), config_(config), slots_(config.connections), random_(std::random_device()()) {
+  closed_ = false;
+  next_slot_ = 0;
+  connect_attempts_ = 0;
+  connect_failures_ = 0;
+  disconnects_ = 0;
+  sends_ = 0;
+  send_failures_ = 0;
+}
+
+bool TcpConnPool::OnConnecting(int slot, TcpHandle handle) {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  if (closed_ || !ValidSlot(slot)) {
+    return false;
+  }
+  slots_[slot].state = kTcpPoolSlotConnecting;
+  slots_[slot].handle = handle;
+  ++connect_attempts_;
+  return true;
+}
+
+bool TcpConnPool::OnConnected(int slot, TcpHandle handle, const std::shared_ptr<TcpSocket>& socket) {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  if (closed_ || !ValidSlot(slot) || slots_[slot].state != kTcpPoolSlotConnecting || slots_[slot].handle != handle) {
+    return false;
+  }
+  slots_[slot].state = kTcpPoolSlotConnected;
+  slots_[slot].failures = 0;
+  slots_[slot].socket = socket;
+  return true;
+}
+
+// return the reconnect delay of the slot, or -1 if the pool no longer owns it
+int TcpConnPool::OnClosed(int slot, TcpHandle handle) {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  if (closed_ || !ValidSlot(slot) || slots_[slot].handle != handle) {
+    return -1;
+  }
+  auto& closed_slot = slots_[slot];
+  if (closed_slot.state == kTcpPoolSlotConnected) {
+    closed_slot.failures = 0;
+    ++disconnects_;
+  } else {
+    ++closed_slot.failures;
+    ++connect_failures_;
+  }
+  closed_slot.state = kTcpPoolSlotBackoff;
+  closed_slot.handle = kInvalidTcpHandle;
+  closed_slot.socket.reset();
+  return NextBackoff(closed_slot.failures);
+}
+
+bool TcpConnPool::SelectSocket(TcpHandle& handle, std::shared_ptr<TcpSocket>& socket) {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  const Slot* selected = nullptr;
+  auto slot_count = static_cast<int>(slots_.size());
+  for (auto i = 0; i < slot_count; ++i) {
+    const auto& current = slots_[(next_slot_ + i) % slot_count];
+    if (current.state != kTcpPoolSlotConnected) {
+      continue;
+    }
+    if (config_.select_policy == kTcpPoolSelectRoundRobin) {
+      next_slot_ = (next_slot_ + i + 1) % slot_count;
+      selected = &current;
+      break;
+    }
+    if (selected == nullptr || current.socket->pending_sends() < selected->socket->pending_sends()) {
+      selected = &current;
+    }
+  }
+  if (selected == nullptr) {
+    return false;
+  }
+  handle = selected->handle;
+  socket = selected->socket;
+  return true;
+}
+
+bool TcpConnPool::closed() {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  return closed_;
+}
+
+void TcpConnPool::OnSend(bool succeeded) {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  ++sends_;
+  if (!succeeded) {
+    ++send_failures_;
+  }
+}
+
+std::vector<TcpHandle> TcpConnPool::Close() {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  std::vector<TcpHandle> handles;
+  closed_ = true;
+  for (auto& i : slots_) {
+    if (i.handle != kInvalidTcpHandle) {
+      handles.push_back(i.handle);
+    }
+    i.state = kTcpPoolSlotBackoff;
+    i.handle = kInvalidTcpHandle;
+    i.socket.reset();
+  }
+  return handles;
+}
+
+void TcpConnPool::GetStats(TcpPoolStats& stats) {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  stats = TcpPoolStats();
+  stats.connections = static_cast<int>(slots_.size());
+  for (const auto& i : slots_) {
+    switch (i.state) {
+    case kTcpPoolSlotConnecting:
+      ++stats.connecting;
+      break;
+    case kTcpPoolSlotConnected:
+      ++stats.connected;
+      stats.pending_sends += i.socket->pending_sends();
+      break;
+    default:
+      ++stats.backing_off;
+      break;
+    }
+  }
+  stats.connect_attempts = connect_attempts_;
+  stats.connect_failures = connect_failures_;
+  stats.disconnects = disconnects_;
+  stats.sends = sends_;
+  stats.send_failures = send_failures_;
+}
+
+// equal jitter: half of the exponential delay is fixed, the other half is random
+int TcpConnPool::NextBackoff(int failures) {
+  auto backoff = static_cast<long long>(config_.min_backoff_ms) << std::min(failures, kMaxBackoffShift);
+  backoff = std::min(backoff, static_cast<long long>(config_.max_backoff_ms));
+  auto half_backoff = static_cast<int>(backoff / 2);
+  std::uniform_int_distribution<int> jitter(0, half_backoff);
+  return static_cast<int>(backoff) - half_backoff + jitter(random_);
+}
+
+} // namespace net
@@ -0,0 +1,66 @@
+#ifndef NET_TCP_CONN_POOL_H_
+#define NET_TCP_CONN_POOL_H_
+
+#include "net_interface.h"
+#include "tcp_socket.h"
+#include "uncopyable.h"
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace net {
+
+const int kTcpPoolSlotBackoff = 0;
+const int kTcpPoolSlotConnecting = 1;
+const int kTcpPoolSlotConnected = 2;
+
+// member state of an outbound connection pool, sockets themselves stay owned by NetResMgr
+class TcpConnPool : public utility::Uncopyable {
+ public:
+  TcpConnPool(const std::weak_ptr<NetInterface>& callback, const std::string& ip, int port, const TcpPoolConfig& config);
+
+  bool OnConnecting(int slot, TcpHandle handle);
+  bool OnConnected(int slot, TcpHandle handle, const std::shared_ptr<TcpSocket>& socket);
+  int OnClosed(int slot, TcpHandle handle);
+  bool SelectSocket(TcpHandle& handle, std::shared_ptr<TcpSocket>& socket);
+  void OnSend(bool succeeded);
+  std::vector<TcpHandle> Close();
+  void GetStats(TcpPoolStats& stats);
+
+  bool closed();
+  std::shared_ptr<NetInterface> callback() const { return callback_.lock(); }
+  const std::string& ip() const { return ip_; }
+  int port() const { return port_; }
+  int connections() const { return config_.connections; }
+
+ private:
+  int NextBackoff(int failures);
+  bool ValidSlot(int slot) const { return slot >= 0 && slot < static_cast<int>(slots_.size()); }
+
+ private:
+  struct Slot {
+    int state = kTcpPoolSlotBackoff;
+    TcpHandle handle = kInvalidTcpHandle;
+    int failures = 0;
+    std::shared_ptr<TcpSocket> socket;
+  };
+
+  std::weak_ptr<NetInterface> callback_;
+  std::string ip_;
+  int port_;
+  TcpPoolConfig config_;
+  bool closed_;
+  int next_slot_;
+  std::vector<Slot> slots_;
+  std::mt19937 random_;
+  unsigned long long connect_attempts_;
+  unsigned long long connect_failures_;
+  unsigned long long disconnects_;
+  unsigned long long sends_;
+  unsigned long long send_failures_;
+  std::mutex pool_lock_;
+};
+
+} // namespace net
+
+#endif	// NET_TCP_CONN_POOL_H_
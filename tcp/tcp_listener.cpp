@@ -0,0 +1,176 @@
+#include "tcp_listener.h"
+#include "utility.h"
+#include <algorithm>
+#include <cmath>
+#include <WinSock2.h>
+
+namespace net {
+
+const int kDefaultMaxAcceptsFactor = 16;
+const unsigned long long kAcceptRateWindowMs = 100;
+const double kAcceptRefillSeconds = 0.1;
+const double kAcceptRateDecay = 0.125;
+
+TcpListener::TcpListener(const TcpListenConfig& config, int shard_num) : shard_accepts_(shard_num) {
+  requested_backlog_ = config.backlog > 0 ? config.backlog : SOMAXCONN;
+  backlog_ = config.backlog > 0 ? SOMAXCONN_HINT(config.backlog) : SOMAXCONN;
+  recycle_sockets_ = config.recycle_sockets;
+  sharded_ = config.sharded;
+  next_shard_ = 0;
+  shard_mismatches_ = 0;
+  max_connections_ = config.max_connections;
+  max_connections_per_ip_ = config.max_connections_per_ip;
+  connections_ = 0;
+  accept_bucket_.Init(config.accept_rate, config.accept_burst > 0 ? config.accept_burst : config.accept_rate);
+  rejected_max_connections_ = 0;
+  rejected_per_ip_ = 0;
+  rejected_no_addr_ = 0;
+  rejected_rate_ = 0;
+  min_accepts_ = config.min_accepts > 0 ? config.min_accepts : utility::GetProcessorNum() * 2;
+  max_accepts_ = config.max_accepts > 0 ? config.max_accepts : min_accepts_ * kDefaultMaxAcceptsFactor;
+  max_accepts_ = std::max(max_accepts_, min_accepts_);
+  target_accepts_ = min_accepts_;
+  pending_accepts_ = 0;
+  accept_rate_ = 0;
+  window_accepts_ = 0;
+  window_begin_ = GetTickCount64();
+  accepted_ = 0;
+  accept_failures_ = 0;
+  accept_post_failures_ = 0;
+  accept_starvations_ = 0;
+}
+
+// return the number of accepts the caller has to post
+int TcpListener::Start() {
+  std::lock_guard<std::mutex> lock(listener_lock_);
+  pending_accepts_ += target_accepts_;
+  return target_accepts_;
+}
+
+// called before the accepted socket is handed out, so the accept queue is refilled first;
+// return the number of accepts to post, the completed buffer counts as one of them
+int TcpListener::OnAcceptCompleted(bool accepted) {
+  std::lock_guard<std::mutex> lock(listener_lock_);
+  --pending_accepts_;
+  if (accepted) {
+    ++accepted_;
+  } else {
+    ++accept_failures_;
+  }
+  ++window_accepts_;
+  UpdateAcceptRate();
+  if (pending_accepts_ == 0) {// every posted accept was consumed, the kernel queue may be overflowing
+    ++accept_starvations_;
+    target_accepts_ = std::min(target_accepts_ * 2, max_accepts_);
+  }
+  auto post_count = std::max(target_accepts_ - pending_accepts_, 0);
+  pending_accepts_ += post_count;
+  return post_count;
+}
+
+void TcpListener::OnAcceptPostFailed() {
+  std::lock_guard<std::mutex> lock(listener_lock_);
+  --pending_accepts_;
+  ++accept_post_failures_;
+}
+
+int TcpListener::pending_accepts() {
+  std::lock_guard<std::mutex> lock(listener_lock_);
+  return pending_accepts_;
+}
+
+// fallback when the RSS processor of a connection is unknown
+int TcpListener::NextShard() {
+  std::lock_guard<std::mutex> lock(listener_lock_);
+  next_shard_ = (next_shard_ + 1) % shard_accepts_.size();
+  return next_shard_;
+}
+
+void TcpListener::OnShardAccepted(int shard, bool mismatched) {
+  std::lock_guard<std::mutex> lock(listener_lock_);
+  ++shard_accepts_[shard];
+  if (mismatched) {
+    ++shard_mismatches_;
+  }
+}
+
+// checked before the connection gets a handle or a recv buffer
+bool TcpListener::Admit(unsigned long remote_ip) {
+  std::lock_guard<std::mutex> lock(listener_lock_);
+  if (max_connections_ > 0 && connections_ >= max_connections_) {
+    ++rejected_max_connections_;
+    return false;
+  }
+  if (max_connections_per_ip_ > 0) {
+    auto ip_connection = ip_connections_.find(remote_ip);
+    if (ip_connection != ip_connections_.end() && ip_connection->second >= max_connections_per_ip_) {
+      ++rejected_per_ip_;
+      return false;
+    }
+  }
+  if (!accept_bucket_.Consume(1)) {
+    ++rejected_rate_;
+    return false;
+  }
+  ++connections_;
+  if (max_connections_per_ip_ > 0) {
+    ++ip_connections_[remote_ip];
+  }
+  return true;
+}
+
+void TcpListener::OnAdmitFailed() {
+  std::lock_guard<std::mutex> lock(listener_lock_);
+  ++rejected_no_addr_;
+}
+
+void TcpListener::OnConnectionClosed(unsigned long remote_ip) {
+  std::lock_guard<std::mutex> lock(listener_lock_);
+  --connections_;
+  if (max_connections_per_ip_ > 0) {
+    auto ip_connection = ip_connections_.find(remote_ip);
+    if (ip_connection != ip_connections_.end() && --ip_connection->second <= 0) {
+      ip_connections_.erase(ip_connection);
+    }
+  }
+}
+
+void TcpListener::GetStats(TcpListenStats& stats) {
+  std::lock_guard<std::mutex> lock(listener_lock_);
+  stats.backlog = requested_backlog_;
+  stats.pending_accepts = pending_accepts_;
+  stats.target_accepts = target_accepts_;
+  stats.accept_rate = accept_rate_;
+  stats.accepted = accepted_;
+  stats.accept_failures = accept_failures_;
+  stats.accept_post_failures = accept_post_failures_;
+  stats.accept_starvations = accept_starvations_;
+  stats.shard_mismatches = shard_mismatches_;
+  stats.shard_accepts = shard_accepts_;
+  stats.connections = connections_;
+  stats.rejected_max_connections = rejected_max_connections_;
+  stats.rejected_per_ip = rejected_per_ip_;
+  stats.rejected_no_addr = rejected_no_addr_;
+  stats.rejected_rate = rejected_rate_;
+}
+
+// rise immediately with the instant rate, decay slowly when the storm is over
+void TcpListener::UpdateAcceptRate() {
+  auto now = GetTickCount64();
+  auto elapsed = now - window_begin_;
+  if (elapsed < kAcceptRateWindowMs) {
+    return;
+  }
+  auto instant_rate = window_accepts_ * 1000.0 / elapsed;
+  if (instant_rate > accept_rate_) {
+    accept_rate_ = instant_rate;
+  } else {
+    accept_rate_ += (instant_rate - accept_rate_) * kAcceptRateDecay;
+  }
+  window_accepts_ = 0;
+  window_begin_ = now;
+  auto target = static_cast<int>(std::ceil(accept_rate_ * kAcceptRefillSeconds));
+  target_accepts_ = std::min(std::max(target, min_accepts_), max_accepts_);
+}
+
+} // namespace net
@@ -0,0 +1,71 @@
+#ifndef NET_TCP_LISTENER_H_
+#define NET_TCP_LISTENER_H_
+
+#include "net_interface.h"
+#include "token_bucket.h"
+#include "uncopyable.h"
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace net {
+
+// accept state of a listen socket: the number of outstanding AcceptEx follows the
+// observed accept rate, bounded by the min and max of the listen config
+class TcpListener : public utility::Uncopyable {
+ public:
+  TcpListener(const TcpListenConfig& config, int shard_num);
+
+  // value passed to listen, SOMAXCONN_HINT encodes the request as a negative number
+  int backlog() const { return backlog_; }
+  bool recycle_sockets() const { return recycle_sockets_; }
+  bool sharded() const { return sharded_; }
+  int NextShard();
+  void OnShardAccepted(int shard, bool mismatched);
+  // remote_ip is the IPv4 address in network order, tcp sockets are IPv4 only
+  bool Admit(unsigned long remote_ip);
+  void OnAdmitFailed();
+  void OnConnectionClosed(unsigned long remote_ip);
+  int Start();
+  int OnAcceptCompleted(bool accepted);
+  void OnAcceptPostFailed();
+  int pending_accepts();
+  void GetStats(TcpListenStats& stats);
+
+ private:
+  void UpdateAcceptRate();
+
+ private:
+  int backlog_;
+  int requested_backlog_;
+  bool recycle_sockets_;
+  bool sharded_;
+  int next_shard_;
+  std::vector<unsigned long long> shard_accepts_;
+  unsigned long long shard_mismatches_;
+  int max_connections_;
+  int max_connections_per_ip_;
+  int connections_;
+  std::unordered_map<unsigned long, int> ip_connections_;
+  TokenBucket accept_bucket_;
+  unsigned long long rejected_max_connections_;
+  unsigned long long rejected_per_ip_;
+  unsigned long long rejected_no_addr_;
+  unsigned long long rejected_rate_;
+  int min_accepts_;
+  int max_accepts_;
+  int target_accepts_;
+  int pending_accepts_;
+  double accept_rate_;
+  int window_accepts_;
+  unsigned long long window_begin_;
+  unsigned long long accepted_;
+  unsigned long long accept_failures_;
+  unsigned long long accept_post_failures_;
+  unsigned long long accept_starvations_;
+  std::mutex listener_lock_;
+};
+
+} // namespace net
+
+#endif	// NET_TCP_LISTENER_H_
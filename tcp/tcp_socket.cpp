@@ -1,12 +1,40 @@
 #include "tcp_socket.h"
+#include "inproc_stream.h"
 #include "tcp_head.h"
-#include "log.h"
+#include "tcp_listener.h"
+#include "net_log.h"
 #include "utility_net.h"
 #include <MSWSock.h>
+#include <mstcpip.h>
 #pragma comment(lib, "Mswsock.lib")
 
 namespace net {
 
+const int kAcceptAddrSize = sizeof(SOCKADDR_IN) + 16;
+
+namespace {
+
+// extension pointers are the same for every tcp socket, they are asked for once per process
+std::atomic<LPFN_CONNECTEX> connect_ex_fn{nullptr};
+std::atomic<LPFN_DISCONNECTEX> disconnect_ex_fn{nullptr};
+
+template <typename Fn>
+Fn LoadExtension(std::atomic<Fn>& fn, SOCKET socket, GUID guid, const char* name) {
+  auto loaded = fn.load(std::memory_order_acquire);
+  if (loaded != nullptr) {
+    return loaded;
+  }
+  DWORD return_bytes = 0;
+  if (WSAIoctl(socket, SIO_GET_EXTENSION_FUNCTION_POINTER, &guid, sizeof(guid), &loaded, sizeof(loaded), &return_bytes, NULL, NULL) != 0) {
+    NET_LOG(kError, "get %s function pointer failed, error code: %d.", name, WSAGetLastError());
+    return nullptr;
+  }
+  fn.store(loaded, std::memory_order_release);
+  return loaded;
+}
+
+} // namespace
+
 TcpSocket::TcpSocket() {
   ResetMember();
 }
@@ -16,36 +44,118 @@ TcpSocket::~TcpSocket() {
 }
 
 void TcpSocket::ResetMember() {
-  callback_.reset();
   socket_ = INVALID_SOCKET;
+  inproc_.reset();
+  iocp_bound_ = false;
+  shard_ = -1;
+  ResetState();
+}
+
+// everything but the kernel socket, which a recycled socket keeps
+void TcpSocket::ResetState() {
+  callback_.reset();
   bind_ = false;
   listen_ = false;
   connect_ = false;
+  accepted_ = false;
+  recyclable_ = false;
+  io_cancelled_ = false;
   current_head_.clear();
   current_packet_.reset();
   current_packet_offset_ = 0;
   all_packets_.clear();
+  pool_handle_ = 0;
+  pool_slot_ = 0;
+  pending_sends_ = 0;
+  bytes_in_ = 0;
+  bytes_out_ = 0;
+  packets_in_ = 0;
+  packets_out_ = 0;
+  listener_.reset();
+  admitted_by_.reset();
+  admitted_ip_ = 0;
+  context_ = nullptr;
 }
 
 bool TcpSocket::Create(const std::weak_ptr<NetInterface>& callback) {
   if (socket_ != INVALID_SOCKET) {
-    LOG(kError, "create tcp socket failed: already created.");
+    NET_LOG(kError, "create tcp socket failed: already created.");
     return false;
   }
   if (callback.expired()) {
-    LOG(kError, "create tcp socket failed: invalid callback parameter.");
+    NET_LOG(kError, "create tcp socket failed: invalid callback parameter.");
     return false;
   }
   callback_ = callback;
   socket_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
   if (socket_ == INVALID_SOCKET) {
-    LOG(kError, "create tcp socket failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kError, "create tcp socket failed, error code: %d.", WSAGetLastError());
     return false;
   }
   return true;
 }
 
+// an in-process socket has no kernel socket, its traffic goes through the stream
+bool TcpSocket::CreateInproc(const std::weak_ptr<NetInterface>& callback, const std::shared_ptr<InprocStream>& stream) {
+  if (socket_ != INVALID_SOCKET || inproc_ != nullptr) {
+    NET_LOG(kError, "create inproc tcp socket failed: already created.");
+    return false;
+  }
+  if (callback.expired() || stream == nullptr) {
+    NET_LOG(kError, "create inproc tcp socket failed: invalid parameter.");
+    return false;
+  }
+  callback_ = callback;
+  inproc_ = stream;
+  return true;
+}
+
+bool TcpSocket::Reuse(const std::weak_ptr<NetInterface>& callback) {
+  if (socket_ == INVALID_SOCKET) {
+    NET_LOG(kError, "reuse tcp socket failed: not created.");
+    return false;
+  }
+  if (callback.expired()) {
+    NET_LOG(kError, "reuse tcp socket failed: invalid callback parameter.");
+    return false;
+  }
+  callback_ = callback;
+  return true;
+}
+
+// drop the connection state but keep the kernel socket, which is reused after DisconnectEx
+void TcpSocket::Recycle() {
+  ResetState();
+}
+
+// reset instead of a graceful close, used to shed connections cheaply
+void TcpSocket::Abort() {
+  if (inproc_ != nullptr) {
+    Destroy();
+    return;
+  }
+  if (socket_ != INVALID_SOCKET) {
+    linger abort_linger = {1, 0};
+    setsockopt(socket_, SOL_SOCKET, SO_LINGER, (const char*)&abort_linger, sizeof(abort_linger));
+    closesocket(socket_);
+    ResetMember();
+  }
+}
+
+// the aborted sends and receives still complete on the iocp
+void TcpSocket::CancelIo() {
+  io_cancelled_ = true;
+  if (inproc_ == nullptr && socket_ != INVALID_SOCKET) {
+    CancelIoEx(reinterpret_cast<HANDLE>(socket_), nullptr);
+  }
+}
+
 void TcpSocket::Destroy() {
+  if (inproc_ != nullptr) {
+    inproc_->Close();
+    ResetMember();
+    return;
+  }
   if (socket_ != INVALID_SOCKET) {
     shutdown(socket_, SD_SEND);
     closesocket(socket_);
@@ -54,28 +164,33 @@ void TcpSocket::Destroy() {
 }
 
 bool TcpSocket::Bind(const std::string& ip, int port) {
+  if (inproc_ != nullptr && !bind_) {
+    inproc_->SetLocalAddr(ip, port);
+    bind_ = true;
+    return true;
+  }
   if (socket_ == INVALID_SOCKET) {
-    LOG(kError, "bind tcp socket failed: not created.");
+    NET_LOG(kError, "bind tcp socket failed: not created.");
     return false;
   }
   if (bind_) {
-    LOG(kError, "bind tcp socket failed: already bound.");
+    NET_LOG(kError, "bind tcp socket failed: already bound.");
     return false;
   }
   auto no_delay = TRUE;
   if (setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay)) != 0) {
-    LOG(kError, "set tcp socket nodelay option failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kError, "set tcp socket nodelay option failed, error code: %d.", WSAGetLastError());
     return false;
   }
   auto reuse_addr = TRUE;
   if (setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse_addr, sizeof(reuse_addr)) != 0) {
-    LOG(kError, "set tcp socket reuse address option failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kError, "set tcp socket reuse address option failed, error code: %d.", WSAGetLastError());
     return false;
   }
   SOCKADDR_IN bind_addr = {0};
   utility::ToSockAddr(ip, port, bind_addr);
   if (bind(socket_, (SOCKADDR*)&bind_addr, sizeof(bind_addr)) != 0) {
-    LOG(kError, "bind tcp socket failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kError, "bind tcp socket failed, error code: %d.", WSAGetLastError());
     return false;
   }
   bind_ = true;
@@ -83,20 +198,24 @@ bool TcpSocket::Bind(const std::string& ip, int port) {
 }
 
 bool TcpSocket::Listen(int backlog) {
+  if (inproc_ != nullptr && bind_ && !listen_) {
+    listen_ = true;
+    return true;
+  }
   if (socket_ == INVALID_SOCKET) {
-    LOG(kError, "listen tcp socket failed: not created.");
+    NET_LOG(kError, "listen tcp socket failed: not created.");
     return false;
   }
   if (!bind_) {
-    LOG(kError, "listen tcp socket failed: not bound.");
+    NET_LOG(kError, "listen tcp socket failed: not bound.");
     return false;
   }
   if (listen_) {
-    LOG(kError, "listen tcp socket failed: already listened.");
+    NET_LOG(kError, "listen tcp socket failed: already listened.");
     return false;
   }
   if (listen(socket_, backlog) != 0) {
-    LOG(kError, "listen tcp socket failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kError, "listen tcp socket failed, error code: %d.", WSAGetLastError());
     return false;
   }
   listen_ = true;
@@ -105,41 +224,74 @@ bool TcpSocket::Listen(int backlog) {
 
 bool TcpSocket::Connect(const std::string& ip, int port) {
   if (socket_ == INVALID_SOCKET) {
-    LOG(kError, "connect tcp socket failed: not created.");
+    NET_LOG(kError, "connect tcp socket failed: not created.");
     return false;
   }
   if (connect_) {
-    LOG(kError, "connect tcp socket failed: already connected.");
+    NET_LOG(kError, "connect tcp socket failed: already connected.");
     return false;
   }
   SOCKADDR_IN connect_addr = {0};
   utility::ToSockAddr(ip, port, connect_addr);
   if (connect(socket_, (SOCKADDR*)&connect_addr, sizeof(connect_addr)) != 0) {
-    LOG(kError, "connect tcp socket failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kError, "connect tcp socket failed, error code: %d.", WSAGetLastError());
     return false;
   }
   connect_ = true;
   return true;
 }
 
+bool TcpSocket::AsyncConnect(const std::string& ip, int port, LPOVERLAPPED ovlp) {
+  if (socket_ == INVALID_SOCKET) {
+    NET_LOG(kError, "async tcp socket connect failed: not created.");
+    return false;
+  }
+  if (!bind_) {
+    NET_LOG(kError, "async tcp socket connect failed: not bound.");
+    return false;
+  }
+  if (connect_) {
+    NET_LOG(kError, "async tcp socket connect failed: already connected.");
+    return false;
+  }
+  if (ovlp == NULL) {
+    NET_LOG(kError, "async tcp socket connect failed: invalid parameter.");
+    return false;
+  }
+  GUID connect_ex_guid = WSAID_CONNECTEX;
+  auto connect_ex = LoadExtension(connect_ex_fn, socket_, connect_ex_guid, "ConnectEx");
+  if (connect_ex == nullptr) {
+    return false;
+  }
+  SOCKADDR_IN connect_addr = {0};
+  utility::ToSockAddr(ip, port, connect_addr);
+  if (!connect_ex(socket_, (SOCKADDR*)&connect_addr, sizeof(connect_addr), NULL, 0, NULL, ovlp)) {
+    if (WSAGetLastError() != ERROR_IO_PENDING) {
+      NET_LOG(kError, "ConnectEx failed, error code: %d.", WSAGetLastError());
+      return false;
+    }
+  }
+  return true;
+}
+
 bool TcpSocket::AsyncAccept(SOCKET accept_sock, char* buffer, int size, LPOVERLAPPED ovlp) {
   if (socket_ == INVALID_SOCKET) {
-    LOG(kError, "async tcp socket accept buffer failed: not created.");
+    NET_LOG(kError, "async tcp socket accept buffer failed: not created.");
     return false;
   }
   if (!listen_) {
-    LOG(kError, "async tcp socket accept buffer failed: not listening.");
+    NET_LOG(kError, "async tcp socket accept buffer failed: not listening.");
     return false;
   }
-  int addr_size = sizeof(SOCKADDR_IN) + 16;
+  auto addr_size = kAcceptAddrSize;
   if (accept_sock == INVALID_SOCKET || buffer == nullptr || size < addr_size || ovlp == NULL){
-    LOG(kError, "async tcp socket accept buffer failed: invalid parameter.");
+    NET_LOG(kError, "async tcp socket accept buffer failed: invalid parameter.");
     return false;
   }
   DWORD bytes_received = 0;
   if (!AcceptEx(socket_, accept_sock, buffer, 0, addr_size, addr_size, &bytes_received, ovlp)) {
     if (WSAGetLastError() != ERROR_IO_PENDING) {
-      LOG(kError, "AcceptEx failed, error code: %d.", WSAGetLastError());
+      NET_LOG(kError, "AcceptEx failed, error code: %d.", WSAGetLastError());
       return false;
     }
   }
@@ -147,16 +299,19 @@ bool TcpSocket::AsyncAccept(SOCKET accept_sock, char* buffer, int size, LPOVERLA
 }
 
 bool TcpSocket::AsyncSend(const TcpHead* head, const char* buffer, int size, LPOVERLAPPED ovlp) {
+  if (inproc_ != nullptr && connect_) {
+    return inproc_->Send(reinterpret_cast<const char*>(head), kTcpHeadSize, buffer, size, ovlp);
+  }
   if (socket_ == INVALID_SOCKET) {
-    LOG(kError, "async tcp socket send buffer failed: not created.");
+    NET_LOG(kError, "async tcp socket send buffer failed: not created.");
     return false;
   }
   if (!connect_) {
-    LOG(kError, "async tcp socket send buffer failed: not connected.");
+    NET_LOG(kError, "async tcp socket send buffer failed: not connected.");
     return false;
   }
   if (buffer == nullptr || size == 0 || ovlp == NULL) {
-    LOG(kError, "async tcp socket send buffer failed: invalid parameter.");
+    NET_LOG(kError, "async tcp socket send buffer failed: invalid parameter.");
     return false;
   }
   WSABUF buff[2] = {0};
@@ -166,7 +321,7 @@ bool TcpSocket::AsyncSend(const TcpHead* head, const char* buffer, int size, LPO
   buff[1].len = size;
   if (WSASend(socket_, buff, 2, NULL, 0, ovlp, NULL) != 0) {
     if (WSAGetLastError() != ERROR_IO_PENDING) {
-      LOG(kError, "WSASend failed, error code: %d.", WSAGetLastError());
+      NET_LOG(kError, "WSASend failed, error code: %d.", WSAGetLastError());
       return false;
     }
   }
@@ -174,16 +329,19 @@ bool TcpSocket::AsyncSend(const TcpHead* head, const char* buffer, int size, LPO
 }
 
 bool TcpSocket::AsyncRecv(char* buffer, int size, LPOVERLAPPED ovlp) {
+  if (inproc_ != nullptr && connect_) {
+    return inproc_->Recv(buffer, size, ovlp);
+  }
   if (socket_ == INVALID_SOCKET) {
-    LOG(kError, "async tcp socket recv buffer failed: not created.");
+    NET_LOG(kError, "async tcp socket recv buffer failed: not created.");
     return false;
   }
   if (!connect_) {
-    LOG(kError, "async tcp socket recv buffer failed: not connected.");
+    NET_LOG(kError, "async tcp socket recv buffer failed: not connected.");
     return false;
   }
   if (buffer == nullptr || size == 0 || ovlp == NULL) {
-    LOG(kError, "async tcp socket recv buffer failed: invalid parameter.");
+    NET_LOG(kError, "async tcp socket recv buffer failed: invalid parameter.");
     return false;
   }
   WSABUF buff = {0};
@@ -192,7 +350,35 @@ bool TcpSocket::AsyncRecv(char* buffer, int size, LPOVERLAPPED ovlp) {
   DWORD received_flag = 0;
   if (WSARecv(socket_, &buff, 1, NULL, &received_flag, ovlp, NULL) != 0) {
     if (WSAGetLastError() != ERROR_IO_PENDING) {
-      LOG(kError, "WSARecv failed, error code: %d.", WSAGetLastError());
+      NET_LOG(kError, "WSARecv failed, error code: %d.", WSAGetLastError());
+      return false;
+    }
+  }
+  return true;
+}
+
+// TF_REUSE_SOCKET keeps the kernel socket for the next AcceptEx
+bool TcpSocket::AsyncDisconnect(LPOVERLAPPED ovlp) {
+  if (socket_ == INVALID_SOCKET) {
+    NET_LOG(kError, "async tcp socket disconnect failed: not created.");
+    return false;
+  }
+  if (!accepted_) {
+    NET_LOG(kError, "async tcp socket disconnect failed: not accepted.");
+    return false;
+  }
+  if (ovlp == NULL) {
+    NET_LOG(kError, "async tcp socket disconnect failed: invalid parameter.");
+    return false;
+  }
+  GUID disconnect_ex_guid = WSAID_DISCONNECTEX;
+  auto disconnect_ex = LoadExtension(disconnect_ex_fn, socket_, disconnect_ex_guid, "DisconnectEx");
+  if (disconnect_ex == nullptr) {
+    return false;
+  }
+  if (!disconnect_ex(socket_, ovlp, TF_REUSE_SOCKET, 0)) {
+    if (WSAGetLastError() != ERROR_IO_PENDING) {
+      NET_LOG(kError, "DisconnectEx failed, error code: %d.", WSAGetLastError());
       return false;
     }
   }
@@ -200,28 +386,71 @@ bool TcpSocket::AsyncRecv(char* buffer, int size, LPOVERLAPPED ovlp) {
 }
 
 bool TcpSocket::SetAccepted(SOCKET listen_sock) {
+  if (inproc_ != nullptr) {
+    bind_ = true;
+    connect_ = true;
+    accepted_ = true;
+    return true;
+  }
   if (socket_ == INVALID_SOCKET) {
-    LOG(kError, "set tcp socket accept context failed: not created.");
+    NET_LOG(kError, "set tcp socket accept context failed: not created.");
     return false;
   }
   if (listen_sock == INVALID_SOCKET) {
-    LOG(kError, "set tcp socket accept context failed: invalid parameter.");
+    NET_LOG(kError, "set tcp socket accept context failed: invalid parameter.");
     return false;
   }
   if (0 != setsockopt(socket_, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT, (char*)&listen_sock, sizeof(listen_sock))) {
-    LOG(kError, "set tcp socket accept context failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kError, "set tcp socket accept context failed, error code: %d.", WSAGetLastError());
     return false;
   }
   bind_ = true;
   connect_ = true;
+  accepted_ = true;
+  return true;
+}
+
+bool TcpSocket::SetConnected() {
+  if (inproc_ != nullptr) {
+    connect_ = true;
+    return true;
+  }
+  if (socket_ == INVALID_SOCKET) {
+    NET_LOG(kError, "set tcp socket connect context failed: not created.");
+    return false;
+  }
+  if (0 != setsockopt(socket_, SOL_SOCKET, SO_UPDATE_CONNECT_CONTEXT, NULL, 0)) {
+    NET_LOG(kError, "set tcp socket connect context failed, error code: %d.", WSAGetLastError());
+    return false;
+  }
+  connect_ = true;
+  return true;
+}
+
+bool TcpSocket::GetAsyncResult(LPOVERLAPPED ovlp, int& error) {
+  if (inproc_ != nullptr) {
+    error = 0;
+    return true;
+  }
+  DWORD transfer_size = 0;
+  DWORD flags = 0;
+  if (!WSAGetOverlappedResult(socket_, ovlp, &transfer_size, FALSE, &flags)) {
+    error = WSAGetLastError();
+    return false;
+  }
+  error = 0;
   return true;
 }
 
 bool TcpSocket::GetLocalAddr(std::string& ip, int& port) {
+  if (inproc_ != nullptr) {
+    inproc_->GetLocalAddr(ip, port);
+    return true;
+  }
   SOCKADDR_IN addr = {0};
   int size = sizeof(addr);
   if (getsockname(socket_, (SOCKADDR*)&addr, &size) != 0) {
-    LOG(kError, "getsockname failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kError, "getsockname failed, error code: %d.", WSAGetLastError());
     return false;
   }
   utility::FromSockAddr(addr, ip, port);
@@ -229,16 +458,49 @@ bool TcpSocket::GetLocalAddr(std::string& ip, int& port) {
 }
 
 bool TcpSocket::GetRemoteAddr(std::string& ip, int& port) {
+  if (inproc_ != nullptr) {
+    return inproc_->GetRemoteAddr(ip, port);
+  }
   SOCKADDR_IN addr = {0};
   int size = sizeof(addr);
   if (getpeername(socket_, (SOCKADDR*)&addr, &size) != 0) {
-    LOG(kError, "getsockname failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kError, "getsockname failed, error code: %d.", WSAGetLastError());
     return false;
   }
   utility::FromSockAddr(addr, ip, port);
   return true;
 }
 
+// parse the addresses AcceptEx wrote into the accept buffer, no system call involved
+bool TcpSocket::GetAcceptRemoteAddr(char* buffer, int size, SOCKADDR_IN& remote_addr) {
+  if (buffer == nullptr || size < kAcceptAddrSize * 2) {
+    NET_LOG(kError, "get tcp socket accept remote address failed: invalid parameter.");
+    return false;
+  }
+  SOCKADDR* local = nullptr;
+  SOCKADDR* remote = nullptr;
+  auto local_size = 0;
+  auto remote_size = 0;
+  GetAcceptExSockaddrs(buffer, 0, kAcceptAddrSize, kAcceptAddrSize, &local, &local_size, &remote, &remote_size);
+  if (remote == nullptr || remote->sa_family != AF_INET || remote_size < (int)sizeof(remote_addr)) {
+    return false;
+  }
+  memcpy(&remote_addr, remote, sizeof(remote_addr));
+  return true;
+}
+
+// the processor RSS delivers the connection's packets to, -1 if unknown
+bool TcpSocket::GetRssProcessor(int& group, int& number) {
+  SOCKET_PROCESSOR_AFFINITY affinity = {0};
+  DWORD return_bytes = 0;
+  if (WSAIoctl(socket_, SIO_QUERY_RSS_PROCESSOR_INFO, NULL, 0, &affinity, sizeof(affinity), &return_bytes, NULL, NULL) != 0) {
+    return false;
+  }
+  group = affinity.Processor.Group;
+  number = affinity.Processor.Number;
+  return true;
+}
+
 // two steps for looping parse a recv buffer: first head part then packet part
 // if head flag is invalid or packet length too large, parse head part will fail
 bool TcpSocket::OnRecv(const char* data, int size) {
@@ -252,12 +514,16 @@ bool TcpSocket::OnRecv(const char* data, int size) {
       return false;
     }
     total_parsed += current_parsed;
-    if (total_parsed >= size) {
+    // an empty packet is complete with its head, also when the head ends the read
+    auto empty_packet = current_packet_ != nullptr && current_head_.size() == kTcpHeadSize && current_packet_->size_ == 0;
+    if (total_parsed >= size && !empty_packet) {
       break;
     }
     current_parsed = ParseTcpPacket(&data[total_parsed], size - total_parsed);
     total_parsed += current_parsed;
   }
+  bytes_in_.fetch_add(size, std::memory_order_relaxed);
+  packets_in_.fetch_add(all_packets_.size(), std::memory_order_relaxed);
   return true;
 }
 
@@ -314,7 +580,7 @@ int TcpSocket::ParseTcpPacket(const char* data, int size) {
         ResetCurrentHead();
       }
     } else {
-      LOG(kError, "parse tcp packet assert error.");
+      NET_LOG(kError, "parse tcp packet assert error.");
     }
   }
   return parsed_size;
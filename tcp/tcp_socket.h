@@ -1,7 +1,10 @@
 #ifndef NET_TCP_SOCKET_H_
 #define NET_TCP_SOCKET_H_
 
+#include "net_strand.h"
 #include "uncopyable.h"
+#include <atomic>
+#include <cstring>
 #include <functional>
 #include <memory>
 #include <string>
@@ -10,8 +13,10 @@
 
 namespace net {
 
+class InprocStream;
 class NetInterface;
 class TcpHead;
+class TcpListener;
 
 class RecvPacket {
  public:
@@ -20,6 +25,16 @@ class RecvPacket {
 
   const char* packet() const { return packet_; }
   int size() const { return size_; }
+  // a packet that arrived whole in one read points into the recv buffer, this copies it out
+  void Detach() {
+    if (deleter_ != nullptr) {
+      return;
+    }
+    auto owned = new char[size_];
+    memcpy(owned, packet_, size_);
+    packet_ = owned;
+    deleter_ = std::default_delete<char[]>();
+  }
 
  private:
   friend class TcpSocket;
@@ -34,24 +49,65 @@ class TcpSocket : public utility::Uncopyable {
   ~TcpSocket();
 
   bool Create(const std::weak_ptr<NetInterface>& callback);
+  bool CreateInproc(const std::weak_ptr<NetInterface>& callback, const std::shared_ptr<InprocStream>& stream);
+  bool Reuse(const std::weak_ptr<NetInterface>& callback);
+  void Recycle();
   void Destroy();
   bool Bind(const std::string& ip, int port);
   bool Listen(int backlog);
   bool Connect(const std::string& ip, int port);
+  bool AsyncConnect(const std::string& ip, int port, LPOVERLAPPED ovlp);
   bool AsyncAccept(SOCKET accept_sock, char* buffer, int size, LPOVERLAPPED ovlp);
   bool AsyncSend(const TcpHead* head, const char* buffer, int size, LPOVERLAPPED ovlp);
   bool AsyncRecv(char* buffer, int size, LPOVERLAPPED ovlp);
+  bool AsyncDisconnect(LPOVERLAPPED ovlp);
+  void Abort();
+  void CancelIo();
   bool SetAccepted(SOCKET listen_sock);
+  bool SetConnected();
+  bool GetAsyncResult(LPOVERLAPPED ovlp, int& error);
   bool GetLocalAddr(std::string& ip, int& port);
   bool GetRemoteAddr(std::string& ip, int& port);
+  bool GetRssProcessor(int& group, int& number);
+  bool GetAcceptRemoteAddr(char* buffer, int size, SOCKADDR_IN& remote_addr);
 
   SOCKET socket() const { return socket_; }
+  bool inproc() const { return inproc_ != nullptr; }
+  std::shared_ptr<InprocStream> inproc_stream() const { return inproc_; }
+  bool accepted() const { return accepted_; }
+  bool connected() const { return connect_; }
+  bool iocp_bound() const { return iocp_bound_; }
+  int shard() const { return shard_; }
+  void set_iocp_bound(int shard) { iocp_bound_ = true; shard_ = shard; }
+  bool recyclable() const { return recyclable_; }
+  bool io_cancelled() const { return io_cancelled_; }
+  void set_recyclable(bool recyclable) { recyclable_ = recyclable; }
   std::shared_ptr<NetInterface> callback() const { return callback_.lock(); }
+  unsigned long pool_handle() const { return pool_handle_; }
+  int pool_slot() const { return pool_slot_; }
+  std::shared_ptr<TcpListener> listener() const { return listener_; }
+  void set_listener(const std::shared_ptr<TcpListener>& listener) { listener_ = listener; }
+  std::shared_ptr<TcpListener> admitted_by() const { return admitted_by_; }
+  unsigned long admitted_ip() const { return admitted_ip_; }
+  void set_admitted(const std::shared_ptr<TcpListener>& listener, unsigned long ip) { admitted_by_ = listener; admitted_ip_ = ip; }
+  void set_pool_slot(unsigned long pool_handle, int pool_slot) { pool_handle_ = pool_handle; pool_slot_ = pool_slot; }
+  int pending_sends() const { return pending_sends_; }
+  void OnSendPosted() { ++pending_sends_; }
+  void OnSendCompleted() { --pending_sends_; }
   bool OnRecv(const char* data, int size);
+  void OnBytesSent(int size) { bytes_out_.fetch_add(size, std::memory_order_relaxed); packets_out_.fetch_add(1, std::memory_order_relaxed); }
+  unsigned long long bytes_in() const { return bytes_in_; }
+  unsigned long long bytes_out() const { return bytes_out_; }
+  unsigned long long packets_in() const { return packets_in_; }
+  unsigned long long packets_out() const { return packets_out_; }
   std::vector<std::unique_ptr<RecvPacket>> all_packets() { return std::move(all_packets_); }
+  NetStrand& strand() { return strand_; }
+  void* context() const { return context_.load(std::memory_order_acquire); }
+  void set_context(void* context) { context_.store(context, std::memory_order_release); }
 
  private:
   void ResetMember();
+  void ResetState();
   bool ParseTcpHead(const char* data, int size, int& parsed_size);
   int ParseTcpPacket(const char* data, int size);
   bool ResetCurrentPacket();
@@ -60,13 +116,31 @@ class TcpSocket : public utility::Uncopyable {
  private:
   std::weak_ptr<NetInterface> callback_;
   SOCKET socket_;
+  std::shared_ptr<InprocStream> inproc_;
   bool bind_;
   bool listen_;
   bool connect_;
+  bool accepted_;
+  bool iocp_bound_;
+  int shard_;
+  bool recyclable_;
+  std::atomic<bool> io_cancelled_;
   std::vector<char> current_head_;
   std::unique_ptr<RecvPacket> current_packet_;
   int current_packet_offset_;
   std::vector<std::unique_ptr<RecvPacket>> all_packets_;
+  unsigned long pool_handle_;
+  int pool_slot_;
+  std::atomic<int> pending_sends_;
+  std::atomic<unsigned long long> bytes_in_;
+  std::atomic<unsigned long long> bytes_out_;
+  std::atomic<unsigned long long> packets_in_;
+  std::atomic<unsigned long long> packets_out_;
+  std::shared_ptr<TcpListener> listener_;
+  std::shared_ptr<TcpListener> admitted_by_;
+  unsigned long admitted_ip_;
+  NetStrand strand_;
+  std::atomic<void*> context_;
 };
 
 } // namespace net
@@ -0,0 +1,79 @@
+#include "tcp_socket_pool.h"
+
+namespace net {
+
+TcpSocketPool::TcpSocketPool() {
+  opened_ = false;
+  reused_ = 0;
+  created_ = 0;
+  recycled_ = 0;
+  discarded_ = 0;
+}
+
+TcpSocketPool::~TcpSocketPool() {
+  Close();
+}
+
+void TcpSocketPool::Open() {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  opened_ = true;
+}
+
+void TcpSocketPool::Close() {
+  std::vector<std::unique_ptr<TcpSocket>> idle_sockets;
+  pool_lock_.lock();
+  opened_ = false;
+  idle_sockets.swap(idle_sockets_);
+  pool_lock_.unlock();
+}
+
+bool TcpSocketPool::opened() {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  return opened_;
+}
+
+// return nullptr if no idle socket, the caller creates a new one then and reports it
+// with OnCreated once the creation succeeded
+std::unique_ptr<TcpSocket> TcpSocketPool::Get() {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  if (idle_sockets_.empty()) {
+    return nullptr;
+  }
+  auto socket = std::move(idle_sockets_.back());
+  idle_sockets_.pop_back();
+  ++reused_;
+  return socket;
+}
+
+void TcpSocketPool::Put(std::unique_ptr<TcpSocket>&& socket) {
+  pool_lock_.lock();
+  if (!opened_ || idle_sockets_.size() >= kMaxIdleTcpSockets) {
+    ++discarded_;
+    pool_lock_.unlock();
+    return;
+  }
+  idle_sockets_.push_back(std::move(socket));
+  ++recycled_;
+  pool_lock_.unlock();
+}
+
+void TcpSocketPool::OnCreated() {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  ++created_;
+}
+
+void TcpSocketPool::OnDiscarded() {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  ++discarded_;
+}
+
+void TcpSocketPool::GetStats(TcpSocketPoolStats& stats) {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  stats.idle = static_cast<int>(idle_sockets_.size());
+  stats.reused = reused_;
+  stats.created = created_;
+  stats.recycled = recycled_;
+  stats.discarded = discarded_;
+}
+
+} // namespace net
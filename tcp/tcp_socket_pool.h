@@ -0,0 +1,42 @@
+#ifndef NET_TCP_SOCKET_POOL_H_
+#define NET_TCP_SOCKET_POOL_H_
+
+#include "net_interface.h"
+#include "tcp_socket.h"
+#include "uncopyable.h"
+#include <mutex>
+#include <vector>
+
+namespace net {
+
+const int kMaxIdleTcpSockets = 4096;
+
+// idle accept sockets disconnected with TF_REUSE_SOCKET, handed to AcceptEx again
+// together with their TcpSocket object and their iocp association
+class TcpSocketPool : public utility::Uncopyable {
+ public:
+  TcpSocketPool();
+  ~TcpSocketPool();
+
+  void Open();
+  void Close();
+  bool opened();
+  std::unique_ptr<TcpSocket> Get();
+  void Put(std::unique_ptr<TcpSocket>&& socket);
+  void OnCreated();
+  void OnDiscarded();
+  void GetStats(TcpSocketPoolStats& stats);
+
+ private:
+  bool opened_;
+  std::vector<std::unique_ptr<TcpSocket>> idle_sockets_;
+  unsigned long long reused_;
+  unsigned long long created_;
+  unsigned long long recycled_;
+  unsigned long long discarded_;
+  std::mutex pool_lock_;
+};
+
+} // namespace net
+
+#endif	// NET_TCP_SOCKET_POOL_H_
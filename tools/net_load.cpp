@@ -0,0 +1,604 @@
+/************************************************************************/
+/*  Load generator                                                      */
+/*  opens connections at a set rate and sends messages whose size and   */
+/*  interval follow fixed, uniform or pareto distributions, open loop   */
+/*  (every message is due on its schedule, late ones are counted from   */
+/*  when they were due) or closed loop (each connection keeps a number  */
+/*  of messages outstanding and thinks for an interval between them);   */
+/*  the target echoes every message, latency percentiles, throughput    */
+/*  and errors are reported periodically                                */
+/*  USAGE: net_load server <tcp|udp> <ip> <port>                        */
+/*         net_load client [key=value ...], keys and defaults:          */
+/*           proto=tcp host=127.0.0.1 port=27060 mode=open              */
+/*           connections=100 connect_rate=1000 threads=2 seconds=10     */
+/*           size=fixed:256 interval=fixed:10000 (microseconds)         */
+/*           outstanding=1 timeout_ms=1000 report_ms=1000               */
+/*           echo=0 (also run the echo server) inproc=0                 */
+/*         a distribution is fixed:v, uniform:min:max or                */
+/*         pareto:scale:alpha[:cap]                                     */
+/************************************************************************/
+
+#include "bench_util.h"
+#include "latency_histogram.h"
+#include "net_interface.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const int kLoadStampSize = 24;
+const int kLoadDrainMs = 2000;
+const double kParetoDefaultCap = 1000.0;
+
+using bench::EchoServer;
+using bench::NowNs;
+
+// one generator per thread, sampling needs no lock
+std::mt19937_64& ThreadRandom() {
+  thread_local std::mt19937_64 random(std::random_device{}());
+  return random;
+}
+
+// every message starts with its stamp, the echo brings it back unchanged
+struct LoadStamp {
+  unsigned long long due_ns;
+  unsigned long long sent_ns;
+  unsigned int connection;
+  unsigned int sequence;
+};
+static_assert(sizeof(LoadStamp) == kLoadStampSize, "load stamp size");
+
+// pareto samples scale / u^(1/alpha), cut at cap times the scale unless a cap is given
+class Distribution {
+ public:
+  enum Type { kFixed, kUniform, kPareto };
+
+  bool Parse(const std::string& text) {
+    char name[16] = {0};
+    double values[3] = {0, 0, 0};
+    auto count = sscanf(text.c_str(), "%15[a-z]:%lf:%lf:%lf", name, &values[0], &values[1], &values[2]);
+    if (strcmp(name, "fixed") == 0 && count == 2 && values[0] >= 0) {
+      type_ = kFixed;
+      min_ = max_ = values[0];
+    } else if (strcmp(name, "uniform") == 0 && count == 3 && values[0] >= 0 && values[1] >= values[0]) {
+      type_ = kUniform;
+      min_ = values[0];
+      max_ = values[1];
+    } else if (strcmp(name, "pareto") == 0 && count >= 3 && values[0] > 0 && values[1] > 0) {
+      type_ = kPareto;
+      min_ = values[0];
+      alpha_ = values[1];
+      max_ = count == 4 && values[2] >= values[0] ? values[2] : values[0] * kParetoDefaultCap;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  double Sample(std::mt19937_64& random) const {
+    switch (type_) {
+    case kUniform:
+      return std::uniform_real_distribution<double>(min_, max_)(random);
+    case kPareto: {
+      auto u = 1.0 - std::uniform_real_distribution<double>(0.0, 1.0)(random);
+      return std::min(min_ / std::pow(u, 1.0 / alpha_), max_);
+    }
+    default:
+      return min_;
+    }
+  }
+
+ private:
+  Type type_ = kFixed;
+  double min_ = 0;
+  double max_ = 0;
+  double alpha_ = 1;
+};
+
+struct LoadConfig {
+  std::string proto = "tcp";
+  std::string host = "127.0.0.1";
+  int port = 27060;
+  bool closed_loop = false;
+  int connections = 100;
+  int connect_rate = 1000;
+  int threads = 2;
+  int seconds = 10;
+  Distribution size;
+  Distribution interval;
+  int outstanding = 1;
+  int timeout_ms = 1000;
+  int report_ms = 1000;
+  bool echo = false;
+  bool inproc = false;
+};
+
+bool ParseConfig(int argc, char* argv[], LoadConfig& config) {
+  config.size.Parse("fixed:256");
+  config.interval.Parse("fixed:10000");
+  for (auto i = 2; i < argc; ++i) {
+    std::string arg(argv[i]);
+    auto equal = arg.find('=');
+    if (equal == std::string::npos) {
+      printf("invalid argument: %s.\n", argv[i]);
+      return false;
+    }
+    auto key = arg.substr(0, equal);
+    auto value = arg.substr(equal + 1);
+    auto valid = true;
+    if (key == "proto") {
+      config.proto = value;
+      valid = value == "tcp" || value == "udp";
+    } else if (key == "host") {
+      config.host = value;
+    } else if (key == "port") {
+      config.port = atoi(value.c_str());
+    } else if (key == "mode") {
+      config.closed_loop = value == "closed";
+      valid = value == "open" || value == "closed";
+    } else if (key == "connections") {
+      config.connections = atoi(value.c_str());
+    } else if (key == "connect_rate") {
+      config.connect_rate = atoi(value.c_str());
+    } else if (key == "threads") {
+      config.threads = atoi(value.c_str());
+    } else if (key == "seconds") {
+      config.seconds = atoi(value.c_str());
+    } else if (key == "size") {
+      valid = config.size.Parse(value);
+    } else if (key == "interval") {
+      valid = config.interval.Parse(value);
+    } else if (key == "outstanding") {
+      config.outstanding = atoi(value.c_str());
+    } else if (key == "timeout_ms") {
+      config.timeout_ms = atoi(value.c_str());
+    } else if (key == "report_ms") {
+      config.report_ms = atoi(value.c_str());
+    } else if (key == "echo") {
+      config.echo = value == "1";
+    } else if (key == "inproc") {
+      config.inproc = value == "1";
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      printf("invalid argument: %s.\n", argv[i]);
+      return false;
+    }
+  }
+  if (config.port <= 0 || config.connections <= 0 || config.connect_rate <= 0 || config.threads <= 0 ||
+    config.seconds <= 0 || config.outstanding <= 0 || config.timeout_ms <= 0 || config.report_ms <= 0) {
+    printf("invalid arguments.\n");
+    return false;
+  }
+  return true;
+}
+
+// inflight is only used in closed loop, progress_ns is the last send or echo
+struct LoadConnection {
+  unsigned int index = 0;
+  int sender = 0;
+  net::TcpHandle tcp_handle = net::kInvalidTcpHandle;
+  net::UdpHandle udp_handle = net::kInvalidUdpHandle;
+  std::atomic<bool> open{false};
+  std::atomic<int> inflight{0};
+  std::atomic<unsigned long long> progress_ns{0};
+  std::atomic<unsigned int> sequence{0};
+};
+
+struct LoadCounters {
+  std::atomic<unsigned long long> sent{0};
+  std::atomic<unsigned long long> sent_bytes{0};
+  std::atomic<unsigned long long> received{0};
+  std::atomic<unsigned long long> received_bytes{0};
+  std::atomic<unsigned long long> send_failures{0};
+  std::atomic<unsigned long long> errors{0};
+  std::atomic<unsigned long long> disconnects{0};
+  std::atomic<unsigned long long> timeouts{0};
+};
+
+class LoadClient;
+
+// one thread sending for its share of the connections, in due time order
+class LoadSender {
+ public:
+  explicit LoadSender(LoadClient* client) : client_(client), stop_(false) {}
+
+  void Schedule(LoadConnection* connection, unsigned long long due_ns);
+  void Start() { thread_ = std::thread(&LoadSender::Run, this); }
+  void Stop();
+
+ private:
+  struct Event {
+    unsigned long long due_ns;
+    LoadConnection* connection;
+    bool operator>(const Event& other) const { return due_ns > other.due_ns; }
+  };
+
+  void Run();
+
+ private:
+  LoadClient* client_;
+  bool stop_;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+  std::mutex events_lock_;
+  std::condition_variable events_cv_;
+  std::thread thread_;
+};
+
+class LoadClient : public net::NetInterface {
+ public:
+  explicit LoadClient(const LoadConfig& config) : config_(config), target_(config.host, config.port) {
+    for (auto i = 0; i < config.connections; ++i) {
+      connections_.push_back(std::make_unique<LoadConnection>());
+      connections_.back()->index = i;
+      connections_.back()->sender = i % config.threads;
+    }
+    for (auto i = 0; i < config.threads; ++i) {
+      senders_.push_back(std::make_unique<LoadSender>(this));
+    }
+  }
+
+  bool OnTcpDisconnected(net::TcpHandle handle) override { ++counters_.disconnects; return true; }
+  bool OnTcpAccepted(net::TcpHandle handle, net::TcpHandle accept_handle) override { return true; }
+  bool OnTcpReceived(net::TcpHandle handle, const char* packet, int size) override { return OnEcho(packet, size); }
+  bool OnTcpError(net::TcpHandle handle, int error) override { ++counters_.errors; return true; }
+  bool OnUdpReceived(net::UdpHandle handle, const char* packet, int size, std::string ip, int port) override {
+    return OnUdpReceivedFrom(handle, packet, size, net::NetEndpoint(ip, port));
+  }
+  bool OnUdpReceivedFrom(net::UdpHandle handle, const char* packet, int size, const net::NetEndpoint& from) override {
+    return OnEcho(packet, size);
+  }
+  bool OnUdpError(net::UdpHandle handle, int error) override { ++counters_.errors; return true; }
+
+  void Run();
+  void Send(LoadConnection& connection, unsigned long long due_ns);
+
+ private:
+  bool Open(LoadConnection& connection);
+  void Close(LoadConnection& connection);
+  bool OnEcho(const char* packet, int size);
+  void ScheduleNext(LoadConnection& connection, unsigned long long due_ns);
+  void ExpireInflight(unsigned long long now_ns);
+  void Report(const char* label, double seconds, net::LatencyHistogram& latency, net::LatencyHistogram& uncorrected_latency);
+  int SampleSize();
+  unsigned long long SampleIntervalNs();
+
+ private:
+  LoadConfig config_;
+  net::NetEndpoint target_;
+  std::vector<std::unique_ptr<LoadConnection>> connections_;
+  std::vector<std::unique_ptr<LoadSender>> senders_;
+  std::atomic<int> open_connections_{0};
+  LoadCounters counters_;
+  net::LatencyHistogram latency_;
+  net::LatencyHistogram uncorrected_latency_;
+  net::LatencyHistogram period_latency_;
+  net::LatencyHistogram period_uncorrected_latency_;
+  unsigned long long reported_sent_ = 0;
+  unsigned long long reported_received_ = 0;
+  unsigned long long reported_bytes_ = 0;
+};
+
+void LoadSender::Schedule(LoadConnection* connection, unsigned long long due_ns) {
+  std::lock_guard<std::mutex> lock(events_lock_);
+  events_.push({due_ns, connection});
+  events_cv_.notify_one();
+}
+
+void LoadSender::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(events_lock_);
+    stop_ = true;
+    events_cv_.notify_one();
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void LoadSender::Run() {
+  std::unique_lock<std::mutex> lock(events_lock_);
+  while (!stop_) {
+    if (events_.empty()) {
+      events_cv_.wait(lock);
+      continue;
+    }
+    auto event = events_.top();
+    auto now = NowNs();
+    if (event.due_ns > now) {
+      events_cv_.wait_for(lock, std::chrono::nanoseconds(event.due_ns - now));
+      continue;
+    }
+    events_.pop();
+    lock.unlock();
+    client_->Send(*event.connection, event.due_ns);
+    lock.lock();
+  }
+}
+
+int LoadClient::SampleSize() {
+  auto max_size = config_.proto == "udp" ? net::kMaxUdpPacketSize : net::kMaxTcpPacketSize;
+  auto size = static_cast<int>(config_.size.Sample(ThreadRandom()));
+  return std::max(kLoadStampSize, std::min(size, max_size));
+}
+
+unsigned long long LoadClient::SampleIntervalNs() {
+  return static_cast<unsigned long long>(config_.interval.Sample(ThreadRandom()) * 1000.0);
+}
+
+bool LoadClient::Open(LoadConnection& connection) {
+  if (config_.proto == "udp") {
+    if (!UdpCreate("0.0.0.0", 0, connection.udp_handle)) {
+      return false;
+    }
+  } else if (!TcpCreate("0.0.0.0", 0, connection.tcp_handle) || !TcpConnect(connection.tcp_handle, config_.host, config_.port)) {
+    if (connection.tcp_handle != net::kInvalidTcpHandle) {
+      TcpDestroy(connection.tcp_handle);
+      connection.tcp_handle = net::kInvalidTcpHandle;
+    }
+    return false;
+  }
+  connection.progress_ns = NowNs();
+  connection.open = true;
+  ++open_connections_;
+  return true;
+}
+
+void LoadClient::Close(LoadConnection& connection) {
+  if (!connection.open.exchange(false)) {
+    return;
+  }
+  --open_connections_;
+  if (connection.tcp_handle != net::kInvalidTcpHandle) {
+    TcpDestroy(connection.tcp_handle);
+  }
+  if (connection.udp_handle != net::kInvalidUdpHandle) {
+    UdpDestroy(connection.udp_handle);
+  }
+}
+
+void LoadClient::Send(LoadConnection& connection, unsigned long long due_ns) {
+  if (!connection.open) {
+    return;
+  }
+  auto size = SampleSize();
+  std::unique_ptr<char[]> message(new char[size]);
+  memset(message.get(), 0, size);
+  LoadStamp stamp = {due_ns, NowNs(), connection.index, connection.sequence++};
+  memcpy(message.get(), &stamp, sizeof(stamp));
+  auto sent = connection.udp_handle != net::kInvalidUdpHandle ?
+    UdpSendTo(connection.udp_handle, std::move(message), size, target_) : TcpSend(connection.tcp_handle, std::move(message), size);
+  if (sent) {
+    ++counters_.sent;
+    counters_.sent_bytes += size;
+    if (config_.closed_loop) {
+      ++connection.inflight;
+    }
+  } else {
+    ++counters_.send_failures;
+  }
+  connection.progress_ns = stamp.sent_ns;
+  if (!config_.closed_loop) {
+    senders_[connection.sender]->Schedule(&connection, due_ns + SampleIntervalNs());
+  } else if (!sent) {
+    ScheduleNext(connection, stamp.sent_ns);
+  }
+}
+
+// closed loop: an echo, failure or timeout frees the slot for the next message
+void LoadClient::ScheduleNext(LoadConnection& connection, unsigned long long now_ns) {
+  senders_[connection.sender]->Schedule(&connection, now_ns + SampleIntervalNs());
+}
+
+bool LoadClient::OnEcho(const char* packet, int size) {
+  if (size < kLoadStampSize) {
+    ++counters_.errors;
+    return true;
+  }
+  LoadStamp stamp;
+  memcpy(&stamp, packet, sizeof(stamp));
+  if (stamp.connection >= connections_.size()) {
+    ++counters_.errors;
+    return true;
+  }
+  auto now = NowNs();
+  latency_.Record(now - stamp.due_ns);
+  uncorrected_latency_.Record(now - stamp.sent_ns);
+  period_latency_.Record(now - stamp.due_ns);
+  period_uncorrected_latency_.Record(now - stamp.sent_ns);
+  ++counters_.received;
+  counters_.received_bytes += size;
+  auto& connection = *connections_[stamp.connection];
+  connection.progress_ns = now;
+  if (config_.closed_loop && connection.inflight.fetch_sub(1) > 0) {
+    ScheduleNext(connection, now);
+  } else if (config_.closed_loop) {
+    // a late echo of a message already counted as timed out
+    ++connection.inflight;
+  }
+  return true;
+}
+
+// a closed loop connection without progress for timeout_ms counts what it has outstanding as
+// lost and starts over, so udp loss does not stall it for good
+void LoadClient::ExpireInflight(unsigned long long now_ns) {
+  if (!config_.closed_loop) {
+    return;
+  }
+  auto timeout_ns = config_.timeout_ms * 1000000ULL;
+  for (auto& i : connections_) {
+    if (!i->open || now_ns - i->progress_ns < timeout_ns) {
+      continue;
+    }
+    auto lost = i->inflight.exchange(0);
+    if (lost <= 0) {
+      continue;
+    }
+    counters_.timeouts += lost;
+    i->progress_ns = now_ns;
+    for (auto j = 0; j < lost; ++j) {
+      ScheduleNext(*i, now_ns);
+    }
+  }
+}
+
+void LoadClient::Report(const char* label, double seconds, net::LatencyHistogram& latency, net::LatencyHistogram& uncorrected_latency) {
+  net::LatencySummary summary;
+  net::LatencySummary uncorrected_summary;
+  latency.GetSummary(summary);
+  uncorrected_latency.GetSummary(uncorrected_summary);
+  unsigned long long sent = counters_.sent;
+  unsigned long long received = counters_.received;
+  unsigned long long bytes = counters_.received_bytes;
+  printf("%-6s open %d sent/s %.0f recv/s %.0f mib/s %.2f latency us p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f"
+    " (uncorrected p99 %.1f) send_failures %llu errors %llu disconnects %llu timeouts %llu\n",
+    label, open_connections_.load(), (sent - reported_sent_) / seconds, (received - reported_received_) / seconds,
+    (bytes - reported_bytes_) / seconds / net::kOneMebibyte, summary.p50_ns / 1e3, summary.p90_ns / 1e3,
+    summary.p99_ns / 1e3, summary.p999_ns / 1e3, summary.max_ns / 1e3, uncorrected_summary.p99_ns / 1e3,
+    counters_.send_failures.load(), counters_.errors.load(), counters_.disconnects.load(), counters_.timeouts.load());
+  fflush(stdout);
+  reported_sent_ = sent;
+  reported_received_ = received;
+  reported_bytes_ = bytes;
+}
+
+// connections are opened at connect_rate from this thread, which also reports every report_ms;
+// each starts sending as soon as it is open
+void LoadClient::Run() {
+  for (auto& i : senders_) {
+    i->Start();
+  }
+  auto begin_ns = NowNs();
+  auto end_ns = begin_ns + config_.seconds * 1000000000ULL;
+  auto connect_interval_ns = 1000000000ULL / config_.connect_rate;
+  auto report_interval_ns = config_.report_ms * 1000000ULL;
+  auto next_report_ns = begin_ns + report_interval_ns;
+  auto last_report_ns = begin_ns;
+  size_t next_connection = 0;
+  auto next_connect_ns = begin_ns;
+  while (true) {
+    auto now = NowNs();
+    if (now >= end_ns) {
+      break;
+    }
+    while (next_connection < connections_.size() && next_connect_ns <= now) {
+      auto& connection = *connections_[next_connection++];
+      next_connect_ns += connect_interval_ns;
+      if (!Open(connection)) {
+        ++counters_.errors;
+        continue;
+      }
+      auto& sender = *senders_[connection.sender];
+      auto count = config_.closed_loop ? config_.outstanding : 1;
+      for (auto i = 0; i < count; ++i) {
+        sender.Schedule(&connection, now);
+      }
+    }
+    if (now >= next_report_ns) {
+      ExpireInflight(now);
+      Report("period", (now - last_report_ns) / 1e9, period_latency_, period_uncorrected_latency_);
+      period_latency_.Reset();
+      period_uncorrected_latency_.Reset();
+      last_report_ns = now;
+      next_report_ns += report_interval_ns;
+    }
+    auto wake_ns = std::min(end_ns, next_report_ns);
+    if (next_connection < connections_.size()) {
+      wake_ns = std::min(wake_ns, next_connect_ns);
+    }
+    if (wake_ns > now) {
+      std::this_thread::sleep_for(std::chrono::nanoseconds(std::min(wake_ns - now, 10000000ULL)));
+    }
+  }
+  for (auto& i : senders_) {
+    i->Stop();
+  }
+  auto drain_end = Clock::now() + std::chrono::milliseconds(kLoadDrainMs);
+  while (counters_.received < counters_.sent && Clock::now() < drain_end) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  reported_sent_ = 0;
+  reported_received_ = 0;
+  reported_bytes_ = 0;
+  Report("total", (NowNs() - begin_ns) / 1e9, latency_, uncorrected_latency_);
+  for (auto& i : connections_) {
+    Close(*i);
+  }
+}
+
+int RunServer(int argc, char* argv[]) {
+  if (argc < 5) {
+    printf("usage: net_load server <tcp|udp> <ip> <port>\n");
+    return 1;
+  }
+  if (!net::NetInterface::StartupNet()) {
+    printf("startup net failed.\n");
+    return 1;
+  }
+  auto server = std::make_shared<EchoServer>();
+  if (!server->Start(argv[2], argv[3], atoi(argv[4]))) {
+    printf("start echo server failed.\n");
+    net::NetInterface::CleanupNet();
+    return 1;
+  }
+  printf("echo server on %s %s:%s, press enter to stop.\n", argv[2], argv[3], argv[4]);
+  getchar();
+  server->Stop();
+  net::NetInterface::CleanupNet();
+  return 0;
+}
+
+int RunClient(int argc, char* argv[]) {
+  LoadConfig config;
+  if (!ParseConfig(argc, argv, config)) {
+    return 1;
+  }
+  net::NetConfig net_config;
+  net_config.inproc_transport = config.inproc;
+  if (!net::NetInterface::StartupNet(net_config)) {
+    printf("startup net failed.\n");
+    return 1;
+  }
+  auto server = std::make_shared<EchoServer>();
+  if (config.echo && !server->Start(config.proto, config.host, config.port)) {
+    printf("start echo server failed.\n");
+    net::NetInterface::CleanupNet();
+    return 1;
+  }
+  auto client = std::make_shared<LoadClient>(config);
+  client->Run();
+  if (config.echo) {
+    server->Stop();
+  }
+  net::NetInterface::CleanupNet();
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && strcmp(argv[1], "server") == 0) {
+    return RunServer(argc, argv);
+  }
+  if (argc > 1 && strcmp(argv[1], "client") == 0) {
+    return RunClient(argc, argv);
+  }
+  printf("usage: net_load server <tcp|udp> <ip> <port>\n       net_load client [key=value ...]\n");
+  return 1;
+}
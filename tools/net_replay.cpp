@@ -0,0 +1,75 @@
+/************************************************************************/
+/*  Capture replay tool                                                 */
+/*  feeds a capture written by NetInterface::StartCapture back through  */
+/*  a NetInterface, at the captured pace or as fast as possible, and    */
+/*  reports what was delivered and how fast                             */
+/*  USAGE: net_replay <capture file> [fast]                             */
+/************************************************************************/
+
+#include "net_interface.h"
+#include <cstdio>
+#include <cstring>
+#include <unordered_set>
+
+namespace {
+
+// fnv-1a over every delivered payload, two replays of one capture print the same digest
+class ReplayNet : public net::NetInterface {
+ public:
+  bool OnTcpDisconnected(net::TcpHandle handle) override { handles_.insert(handle); return true; }
+  bool OnTcpAccepted(net::TcpHandle handle, net::TcpHandle accept_handle) override { return true; }
+  bool OnTcpReceived(net::TcpHandle handle, const char* packet, int size) override {
+    handles_.insert(handle);
+    Digest(packet, size);
+    return true;
+  }
+  bool OnTcpError(net::TcpHandle handle, int error) override {
+    printf("tcp handle: %lu stream error: %d.\n", handle, error);
+    return true;
+  }
+  bool OnUdpReceived(net::UdpHandle handle, const char* packet, int size, std::string ip, int port) override {
+    return OnUdpReceivedFrom(handle, packet, size, net::NetEndpoint(ip, port));
+  }
+  bool OnUdpReceivedFrom(net::UdpHandle handle, const char* packet, int size, const net::NetEndpoint& from) override {
+    handles_.insert(handle);
+    Digest(packet, size);
+    return true;
+  }
+  bool OnUdpError(net::UdpHandle handle, int error) override { return true; }
+
+  void Digest(const char* packet, int size) {
+    for (auto i = 0; i < size; ++i) {
+      digest_ = (digest_ ^ static_cast<unsigned char>(packet[i])) * 1099511628211ULL;
+    }
+  }
+
+  unsigned long long digest_ = 14695981039346656037ULL;
+  std::unordered_set<unsigned long> handles_;
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    printf("usage: net_replay <capture file> [fast]\n");
+    return 1;
+  }
+  auto original_speed = argc < 3 || strcmp(argv[2], "fast") != 0;
+  auto replay = std::make_shared<ReplayNet>();
+  net::CaptureReplayStats stats;
+  if (!replay->ReplayCapture(argv[1], original_speed, stats)) {
+    printf("replay %s failed.\n", argv[1]);
+    return 1;
+  }
+  auto seconds = stats.elapsed_ms > 0 ? stats.elapsed_ms / 1000.0 : 0.001;
+  printf("replayed %s %s in %llu ms\n", argv[1], original_speed ? "at captured pace" : "as fast as possible", stats.elapsed_ms);
+  printf("  records        %llu (%llu send records skipped)\n", stats.records, stats.skipped);
+  printf("  handles        %zu\n", replay->handles_.size());
+  printf("  tcp            %llu bytes, %llu packets, %llu disconnects, %llu stream errors\n",
+    stats.tcp_bytes, stats.tcp_packets, stats.tcp_disconnects, stats.errors);
+  printf("  udp            %llu datagrams\n", stats.udp_datagrams);
+  printf("  rate           %.0f records/s, %.1f MiB/s of tcp stream\n",
+    stats.records / seconds, stats.tcp_bytes / seconds / net::kOneMebibyte);
+  printf("  digest         %016llx\n", replay->digest_);
+  return 0;
+}
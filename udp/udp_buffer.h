@@ -2,49 +2,106 @@
 #define NET_UDP_BUFFER_H_
 
 #include "base_buffer.h"
+#include "net_endpoint.h"
+#include "send_payload.h"
+#include <WS2tcpip.h>
 #include <memory>
 #include <functional>
 
 namespace net {
 
 const int kUdpBufferSize = 8 * 1024;
+const int kUdpCoalescedBufferSize = 64 * 1024;
 
 class UdpSendBuffer : public BaseBuffer {
  public:
-  UdpSendBuffer() {
+  UdpSendBuffer() : segment_size_(0) {
     set_async_type(kAsyncTypeUdpSend);
   }
   ~UdpSendBuffer() {}
-  void set_buffer(std::unique_ptr<char[]>&& buffer, int size) {
+  void set_buffer(SendPayload&& buffer, int size) {
     buffer_ = std::move(buffer);
     set_buffer_size(size);
   }
+  // drops the payload before the context goes back to its pool
+  void Reset() {
+    ResetBuffer();
+    buffer_.reset();
+    to_.Reset();
+    segment_size_ = 0;
+  }
   const char* buffer() const { return buffer_.get(); }
+  // kept for the capture record written on completion, to is invalid on a connected handle
+  const NetEndpoint& to() const { return to_; }
+  int segment_size() const { return segment_size_; }
+  void set_to(const NetEndpoint& to, int segment_size) { to_ = to; segment_size_ = segment_size; }
 
  private:
-  std::unique_ptr<char[]> buffer_;
+  SendPayload buffer_;
+  NetEndpoint to_;
+  int segment_size_;
 };
 
+// a coalescing buffer receives with WSARecvMsg and may hold several datagrams
+// of coalesced_size bytes each, the last one may be shorter
 class UdpRecvBuffer : public BaseBuffer {
  public:
-  UdpRecvBuffer() : addr_size_(sizeof(from_addr_)) {
+  explicit UdpRecvBuffer(bool coalesced = false)
+    : buffer_(new char[coalesced ? kUdpCoalescedBufferSize : kUdpBufferSize]),
+      addr_size_(sizeof(from_addr_)), batch_(false), coalesced_(coalesced) {
     set_async_type(kAsyncTypeUdpRecv);
-    set_buffer_size(sizeof(buffer_));
+    set_buffer_size(coalesced ? kUdpCoalescedBufferSize : kUdpBufferSize);
     memset(&from_addr_, 0, sizeof(from_addr_));
+    ResetMsg();
   }
   void ResetBuffer() {
     BaseBuffer::ResetBuffer();
     memset(&from_addr_, 0, sizeof(from_addr_));
     addr_size_ = sizeof(from_addr_);
+    ResetMsg();
   }
-  char* buffer() { return buffer_; }
+  char* buffer() { return buffer_.get(); }
   PSOCKADDR_IN from_addr() { return &from_addr_; }
   PINT addr_size() { return &addr_size_; }
+  LPWSAMSG msg() { return &msg_; }
+  void set_batch(bool batch) { batch_ = batch; }
+  bool batch() const { return batch_; }
+  bool coalesced() const { return coalesced_; }
+  int coalesced_size() {
+    if (!coalesced_) {
+      return 0;
+    }
+    for (auto cmsg = WSA_CMSG_FIRSTHDR(&msg_); cmsg != NULL; cmsg = WSA_CMSG_NXTHDR(&msg_, cmsg)) {
+      if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_COALESCED_INFO) {
+        return *(LPDWORD)WSA_CMSG_DATA(cmsg);
+      }
+    }
+    return 0;
+  }
 
  private:
-  char buffer_[kUdpBufferSize];
+  void ResetMsg() {
+    memset(&msg_, 0, sizeof(msg_));
+    memset(control_, 0, sizeof(control_));
+    wsa_buffer_.buf = buffer_.get();
+    wsa_buffer_.len = buffer_size();
+    msg_.name = (LPSOCKADDR)&from_addr_;
+    msg_.namelen = sizeof(from_addr_);
+    msg_.lpBuffers = &wsa_buffer_;
+    msg_.dwBufferCount = 1;
+    msg_.Control.buf = control_;
+    msg_.Control.len = sizeof(control_);
+  }
+
+ private:
+  std::unique_ptr<char[]> buffer_;
   SOCKADDR_IN from_addr_;
   INT addr_size_;
+  WSABUF wsa_buffer_;
+  WSAMSG msg_;
+  char control_[WSA_CMSG_SPACE(sizeof(DWORD))];
+  bool batch_;
+  bool coalesced_;
 };
 
 } // namespace net
@@ -0,0 +1,119 @@
+#include "udp_pacer.h"
+#include <algorithm>
+#include <WinSock2.h>
+
+namespace net {
+
+const int kDefaultPacingQueueLimit = 1024;
+const int kPacingSweepMs = 1000;
+
+UdpPacer::UdpPacer(const UdpConfig& config) {
+  enabled_ = config.pacing_rate > 0;
+  per_destination_ = config.pacing_per_destination;
+  queue_limit_ = config.pacing_queue_limit > 0 ? config.pacing_queue_limit : kDefaultPacingQueueLimit;
+  rate_ = config.pacing_rate;
+  burst_ = config.pacing_burst > 0 ? config.pacing_burst : kMaxUdpPacketSize;
+  timer_scheduled_ = false;
+  queued_ = 0;
+  delayed_ = 0;
+  dropped_ = 0;
+}
+
+// a rate <= 0 stops pacing once the queued datagrams are drained
+void UdpPacer::SetRate(int rate, int burst) {
+  std::lock_guard<std::mutex> lock(pacer_lock_);
+  rate_ = rate > 0 ? rate : 0;
+  burst_ = burst > 0 ? burst : kMaxUdpPacketSize;
+  for (auto& i : flows_) {
+    i.second.bucket.SetRate(rate_, burst_);
+  }
+  if (rate_ > 0) {
+    enabled_ = true;
+  }
+}
+
+// send_now means the caller sends the datagram itself, otherwise it was queued;
+// timer_ms >= 0 asks the caller to schedule a Drain
+bool UdpPacer::Pace(Datagram& datagram, bool& send_now, int& timer_ms) {
+  send_now = false;
+  timer_ms = -1;
+  std::lock_guard<std::mutex> lock(pacer_lock_);
+  auto result = flows_.try_emplace(per_destination_ ? datagram.to : NetEndpoint());
+  auto& flow = result.first->second;
+  if (result.second) {
+    flow.bucket.Init(rate_, burst_);
+  }
+  flow.last_used = GetTickCount64();
+  if (flow.queue.empty() && Consume(flow, datagram.size)) {
+    send_now = true;
+  } else if (queued_ >= queue_limit_) {
+    ++dropped_;
+    return false;
+  } else {
+    flow.queue.push_back(std::move(datagram));
+    ++queued_;
+    ++delayed_;
+  }
+  if (!timer_scheduled_) {
+    timer_scheduled_ = true;
+    timer_ms = send_now ? kPacingSweepMs : FlowDelayMs(flow);
+  }
+  return true;
+}
+
+// move every datagram whose flow has tokens to ready, drop flows idle for a sweep period;
+// return the delay of the next Drain, -1 when there is nothing left to pace
+int UdpPacer::Drain(std::vector<Datagram>& ready) {
+  std::lock_guard<std::mutex> lock(pacer_lock_);
+  auto now = GetTickCount64();
+  auto timer_ms = -1;
+  for (auto i = flows_.begin(); i != flows_.end();) {
+    auto& flow = i->second;
+    while (!flow.queue.empty() && Consume(flow, flow.queue.front().size)) {
+      ready.push_back(std::move(flow.queue.front()));
+      flow.queue.pop_front();
+      --queued_;
+    }
+    auto flow_ms = 0;
+    if (!flow.queue.empty()) {
+      flow_ms = FlowDelayMs(flow);
+    } else if (now - flow.last_used >= kPacingSweepMs) {
+      i = flows_.erase(i);
+      continue;
+    } else {
+      flow_ms = static_cast<int>(kPacingSweepMs - (now - flow.last_used));
+    }
+    timer_ms = timer_ms < 0 ? flow_ms : std::min(timer_ms, flow_ms);
+    ++i;
+  }
+  if (rate_ <= 0 && queued_ == 0) {
+    enabled_ = false;
+  }
+  timer_scheduled_ = timer_ms >= 0;
+  return timer_ms;
+}
+
+void UdpPacer::GetStats(UdpPacingStats& stats) {
+  std::lock_guard<std::mutex> lock(pacer_lock_);
+  stats.rate = static_cast<int>(rate_);
+  stats.burst = static_cast<int>(burst_);
+  stats.flows = static_cast<int>(flows_.size());
+  stats.queued = queued_;
+  stats.delayed = delayed_;
+  stats.dropped = dropped_;
+}
+
+// a datagram larger than the burst waits for a full bucket and leaves it in debt
+bool UdpPacer::Consume(Flow& flow, int size) {
+  if (flow.bucket.DelayMs(std::min<double>(size, burst_)) > 0) {
+    return false;
+  }
+  flow.bucket.ForceConsume(size);
+  return true;
+}
+
+int UdpPacer::FlowDelayMs(Flow& flow) {
+  return std::max(flow.bucket.DelayMs(std::min<double>(flow.queue.front().size, burst_)), 1);
+}
+
+} // namespace net
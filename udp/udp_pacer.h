@@ -0,0 +1,62 @@
+#ifndef NET_UDP_PACER_H_
+#define NET_UDP_PACER_H_
+
+#include "net_interface.h"
+#include "send_payload.h"
+#include "token_bucket.h"
+#include "uncopyable.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace net {
+
+// token bucket pacing of the sends of a udp socket, one bucket for the handle or one per
+// destination; datagrams over the rate wait in their flow queue until a timer drains them
+class UdpPacer : public utility::Uncopyable {
+ public:
+  // an invalid to means the connected peer, a segment_size means one segmented send
+  struct Datagram {
+    SendPayload packet;
+    int size = 0;
+    int segment_size = 0;
+    NetEndpoint to;
+  };
+
+  UdpPacer(const UdpConfig& config);
+
+  bool enabled() const { return enabled_; }
+  void SetRate(int rate, int burst);
+  bool Pace(Datagram& datagram, bool& send_now, int& timer_ms);
+  int Drain(std::vector<Datagram>& ready);
+  void GetStats(UdpPacingStats& stats);
+
+ private:
+  struct Flow {
+    TokenBucket bucket;
+    std::deque<Datagram> queue;
+    unsigned long long last_used = 0;
+  };
+
+  bool Consume(Flow& flow, int size);
+  int FlowDelayMs(Flow& flow);
+
+ private:
+  std::atomic<bool> enabled_;
+  bool per_destination_;
+  int queue_limit_;
+  double rate_;
+  double burst_;
+  bool timer_scheduled_;
+  std::unordered_map<NetEndpoint, Flow, NetEndpointHash> flows_;
+  int queued_;
+  unsigned long long delayed_;
+  unsigned long long dropped_;
+  std::mutex pacer_lock_;
+};
+
+} // namespace net
+
+#endif	// NET_UDP_PACER_H_
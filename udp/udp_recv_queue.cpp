@@ -0,0 +1,74 @@
+#include "udp_recv_queue.h"
+#include "utility.h"
+#include <algorithm>
+#include <WinSock2.h>
+
+namespace net {
+
+const int kDefaultMinRecvs = 2;
+const int kDefaultMaxRecvsFactor = 4;
+const unsigned long long kRecvBurstWindowMs = 1000;
+
+UdpRecvQueue::UdpRecvQueue(const UdpConfig& config) {
+  min_recvs_ = config.min_recvs > 0 ? config.min_recvs : (config.recv_batch > 0 ? config.recv_batch : kDefaultMinRecvs);
+  max_recvs_ = config.max_recvs > 0 ? config.max_recvs : utility::GetProcessorNum() * kDefaultMaxRecvsFactor;
+  max_recvs_ = std::max(max_recvs_, min_recvs_);
+  target_recvs_ = min_recvs_;
+  pending_recvs_ = 0;
+  window_burst_ = 0;
+  window_begin_ = GetTickCount64();
+  received_ = 0;
+  recv_starvations_ = 0;
+}
+
+// return the number of receives the caller has to post
+int UdpRecvQueue::Start() {
+  std::lock_guard<std::mutex> lock(queue_lock_);
+  pending_recvs_ += target_recvs_;
+  return target_recvs_;
+}
+
+// called once per dequeued batch, returns the number of receives to post
+int UdpRecvQueue::OnRecvCompleted(int completed) {
+  std::lock_guard<std::mutex> lock(queue_lock_);
+  pending_recvs_ -= completed;
+  received_ += completed;
+  window_burst_ = std::max(window_burst_, target_recvs_ - pending_recvs_);
+  if (pending_recvs_ == 0) {// every posted receive was consumed, the kernel buffer is taking the burst
+    ++recv_starvations_;
+    target_recvs_ = std::min(target_recvs_ * 2, max_recvs_);
+  }
+  UpdateTarget();
+  auto post_count = std::max(target_recvs_ - pending_recvs_, 0);
+  pending_recvs_ += post_count;
+  return post_count;
+}
+
+void UdpRecvQueue::OnRecvPostFailed() {
+  std::lock_guard<std::mutex> lock(queue_lock_);
+  --pending_recvs_;
+}
+
+void UdpRecvQueue::GetStats(UdpRecvStats& stats) {
+  std::lock_guard<std::mutex> lock(queue_lock_);
+  stats.min_recvs = min_recvs_;
+  stats.max_recvs = max_recvs_;
+  stats.pending_recvs = pending_recvs_;
+  stats.target_recvs = target_recvs_;
+  stats.received = received_;
+  stats.recv_starvations = recv_starvations_;
+}
+
+// keep twice the last window's largest burst, shrink by at most half
+void UdpRecvQueue::UpdateTarget() {
+  auto now = GetTickCount64();
+  if (now - window_begin_ < kRecvBurstWindowMs) {
+    return;
+  }
+  auto target = std::max(window_burst_ * 2, target_recvs_ / 2);
+  target_recvs_ = std::min(std::max(target, min_recvs_), max_recvs_);
+  window_burst_ = 0;
+  window_begin_ = now;
+}
+
+} // namespace net
@@ -0,0 +1,38 @@
+#ifndef NET_UDP_RECV_QUEUE_H_
+#define NET_UDP_RECV_QUEUE_H_
+
+#include "net_interface.h"
+#include "uncopyable.h"
+#include <mutex>
+
+namespace net {
+
+// receive state of a udp socket: the number of outstanding receives follows the largest
+// burst observed, bounded by the min and max of the udp config
+class UdpRecvQueue : public utility::Uncopyable {
+ public:
+  UdpRecvQueue(const UdpConfig& config);
+
+  int Start();
+  int OnRecvCompleted(int completed);
+  void OnRecvPostFailed();
+  void GetStats(UdpRecvStats& stats);
+
+ private:
+  void UpdateTarget();
+
+ private:
+  int min_recvs_;
+  int max_recvs_;
+  int target_recvs_;
+  int pending_recvs_;
+  int window_burst_;
+  unsigned long long window_begin_;
+  unsigned long long received_;
+  unsigned long long recv_starvations_;
+  std::mutex queue_lock_;
+};
+
+} // namespace net
+
+#endif	// NET_UDP_RECV_QUEUE_H_
@@ -1,12 +1,14 @@
 #include "udp_socket.h"
-#include "log.h"
+#include "net_log.h"
+#include "udp_pacer.h"
+#include "udp_recv_queue.h"
 #include "utility_net.h"
-#include <MSWSock.h>
+#include <WS2tcpip.h>
 #pragma comment(lib, "Mswsock.lib")
 
 namespace net {
 
-UdpSocket::UdpSocket() {
+UdpSocket::UdpSocket() : fan_out_(false) {
   ResetMember();
 }
 
@@ -18,32 +20,220 @@ void UdpSocket::ResetMember() {
   callback_.reset();
   socket_ = INVALID_SOCKET;
   bind_ = false;
+  connected_ = false;
+  send_segmentation_ = false;
+  recv_msg_ = nullptr;
+  recv_queue_.reset();
+  pacer_.reset();
+  context_ = nullptr;
 }
 
 bool UdpSocket::Create(const std::weak_ptr<NetInterface>& callback) {
   if (socket_ != INVALID_SOCKET) {
-    LOG(kError, "create udp socket failed: already created.");
+    NET_LOG(kError, "create udp socket failed: already created.");
     return false;
   }
   if (callback.expired()) {
-    LOG(kError, "create udp socket failed: invalid callback parameter.");
+    NET_LOG(kError, "create udp socket failed: invalid callback parameter.");
     return false;
   }
   socket_ = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
   if (socket_ == INVALID_SOCKET) {
-    LOG(kError, "create udp socket failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kError, "create udp socket failed, error code: %d.", WSAGetLastError());
     return false;
   }
   callback_ = callback;
   auto broadcast_opt = TRUE;
   if (setsockopt(socket_, SOL_SOCKET, SO_BROADCAST, (char*)&broadcast_opt, sizeof(broadcast_opt)) != 0) {
-    LOG(kError, "set udp socket broadcast option failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kError, "set udp socket broadcast option failed, error code: %d.", WSAGetLastError());
     Destroy();
     return false;
   }
+  ProbeSendSegmentation();
   return true;
 }
 
+// udp send offload is available when the stack knows the option
+void UdpSocket::ProbeSendSegmentation() {
+  DWORD segment_size = 0;
+  auto option_size = (int)sizeof(segment_size);
+  send_segmentation_ = getsockopt(socket_, IPPROTO_UDP, UDP_SEND_MSG_SIZE, (char*)&segment_size, &option_size) == 0;
+}
+
+bool UdpSocket::EnableRecvCoalescing(int max_size) {
+  if (socket_ == INVALID_SOCKET) {
+    NET_LOG(kError, "enable udp socket recv coalescing failed: not created.");
+    return false;
+  }
+  LPFN_WSARECVMSG recv_msg = nullptr;
+  GUID recv_msg_guid = WSAID_WSARECVMSG;
+  DWORD return_bytes = 0;
+  if (WSAIoctl(socket_, SIO_GET_EXTENSION_FUNCTION_POINTER, &recv_msg_guid, sizeof(recv_msg_guid),
+    &recv_msg, sizeof(recv_msg), &return_bytes, NULL, NULL) != 0) {
+    NET_LOG(kError, "get WSARecvMsg function pointer failed, error code: %d.", WSAGetLastError());
+    return false;
+  }
+  DWORD coalesced_size = max_size;
+  if (setsockopt(socket_, IPPROTO_UDP, UDP_RECV_MAX_COALESCED_SIZE, (char*)&coalesced_size, sizeof(coalesced_size)) != 0) {
+    return false;
+  }
+  recv_msg_ = recv_msg;
+  return true;
+}
+
+// lets several handles or processes bind the same port, needed to share a multicast feed
+bool UdpSocket::ReuseAddress() {
+  if (socket_ == INVALID_SOCKET) {
+    NET_LOG(kError, "set udp socket reuse address failed: not created.");
+    return false;
+  }
+  if (bind_) {
+    NET_LOG(kError, "set udp socket reuse address failed: already bound.");
+    return false;
+  }
+  auto reuse_opt = TRUE;
+  if (setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, (char*)&reuse_opt, sizeof(reuse_opt)) != 0) {
+    NET_LOG(kError, "set udp socket reuse address failed, error code: %d.", WSAGetLastError());
+    return false;
+  }
+  return true;
+}
+
+// sizes <= 0 keep the stack default
+bool UdpSocket::SetBufferSizes(int recv_size, int send_size) {
+  if (socket_ == INVALID_SOCKET) {
+    NET_LOG(kError, "set udp socket buffer sizes failed: not created.");
+    return false;
+  }
+  if (recv_size > 0 && setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, (char*)&recv_size, sizeof(recv_size)) != 0) {
+    NET_LOG(kError, "set udp socket recv buffer size failed, error code: %d.", WSAGetLastError());
+    return false;
+  }
+  if (send_size > 0 && setsockopt(socket_, SOL_SOCKET, SO_SNDBUF, (char*)&send_size, sizeof(send_size)) != 0) {
+    NET_LOG(kError, "set udp socket send buffer size failed, error code: %d.", WSAGetLastError());
+    return false;
+  }
+  return true;
+}
+
+bool UdpSocket::GetBufferSizes(int& recv_size, int& send_size) {
+  if (socket_ == INVALID_SOCKET) {
+    NET_LOG(kError, "get udp socket buffer sizes failed: not created.");
+    return false;
+  }
+  auto option_size = (int)sizeof(recv_size);
+  if (getsockopt(socket_, SOL_SOCKET, SO_RCVBUF, (char*)&recv_size, &option_size) != 0) {
+    NET_LOG(kError, "get udp socket recv buffer size failed, error code: %d.", WSAGetLastError());
+    return false;
+  }
+  option_size = (int)sizeof(send_size);
+  if (getsockopt(socket_, SOL_SOCKET, SO_SNDBUF, (char*)&send_size, &option_size) != 0) {
+    NET_LOG(kError, "get udp socket send buffer size failed, error code: %d.", WSAGetLastError());
+    return false;
+  }
+  return true;
+}
+
+bool UdpSocket::JoinGroup(const std::string& group, const std::string& interface_ip, const std::string& source) {
+  return ChangeMembership(true, group, interface_ip, source);
+}
+
+bool UdpSocket::LeaveGroup(const std::string& group, const std::string& interface_ip, const std::string& source) {
+  return ChangeMembership(false, group, interface_ip, source);
+}
+
+// an empty interface lets the stack choose one, a non empty source joins source specific
+bool UdpSocket::ChangeMembership(bool join, const std::string& group, const std::string& interface_ip, const std::string& source) {
+  if (socket_ == INVALID_SOCKET) {
+    NET_LOG(kError, "change udp socket group membership failed: not created.");
+    return false;
+  }
+  IN_ADDR group_addr = {0};
+  IN_ADDR interface_addr = {0};
+  IN_ADDR source_addr = {0};
+  interface_addr.s_addr = htonl(INADDR_ANY);
+  if (inet_pton(AF_INET, group.c_str(), &group_addr) != 1 || (ntohl(group_addr.s_addr) & 0xf0000000) != 0xe0000000 ||
+    (!interface_ip.empty() && inet_pton(AF_INET, interface_ip.c_str(), &interface_addr) != 1) ||
+    (!source.empty() && inet_pton(AF_INET, source.c_str(), &source_addr) != 1)) {
+    NET_LOG(kError, "change udp socket group membership failed: invalid parameter.");
+    return false;
+  }
+  auto result = 0;
+  if (source.empty()) {
+    ip_mreq mreq = {0};
+    mreq.imr_multiaddr = group_addr;
+    mreq.imr_interface = interface_addr;
+    result = setsockopt(socket_, IPPROTO_IP, join ? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP, (char*)&mreq, sizeof(mreq));
+  } else {
+    ip_mreq_source mreq = {0};
+    mreq.imr_multiaddr = group_addr;
+    mreq.imr_sourceaddr = source_addr;
+    mreq.imr_interface = interface_addr;
+    result = setsockopt(socket_, IPPROTO_IP, join ? IP_ADD_SOURCE_MEMBERSHIP : IP_DROP_SOURCE_MEMBERSHIP, (char*)&mreq, sizeof(mreq));
+  }
+  if (result != 0) {
+    NET_LOG(kError, "%s udp socket group: %s failed, error code: %d.", join ? "join" : "leave", group.c_str(), WSAGetLastError());
+    return false;
+  }
+  return true;
+}
+
+// subscribers are copied on write, the receive path takes a reference
+bool UdpSocket::Subscribe(const std::weak_ptr<NetInterface>& subscriber) {
+  auto consumer = subscriber.lock();
+  if (consumer == nullptr) {
+    NET_LOG(kError, "subscribe udp socket failed: invalid parameter.");
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(subscribers_lock_);
+  auto new_subscribers = std::make_shared<Subscribers>();
+  if (subscribers_ != nullptr) {
+    for (auto& i : *subscribers_) {
+      auto existing = i.lock();
+      if (existing == consumer) {
+        NET_LOG(kError, "subscribe udp socket failed: already subscribed.");
+        return false;
+      }
+      if (existing != nullptr) {
+        new_subscribers->push_back(i);
+      }
+    }
+  }
+  new_subscribers->push_back(subscriber);
+  subscribers_ = new_subscribers;
+  fan_out_ = true;
+  return true;
+}
+
+bool UdpSocket::Unsubscribe(const std::shared_ptr<NetInterface>& subscriber) {
+  std::lock_guard<std::mutex> lock(subscribers_lock_);
+  if (subscribers_ == nullptr) {
+    return false;
+  }
+  auto new_subscribers = std::make_shared<Subscribers>();
+  auto found = false;
+  for (auto& i : *subscribers_) {
+    auto existing = i.lock();
+    if (existing == subscriber) {
+      found = true;
+    } else if (existing != nullptr) {
+      new_subscribers->push_back(i);
+    }
+  }
+  if (new_subscribers->empty()) {
+    subscribers_.reset();
+    fan_out_ = false;
+  } else {
+    subscribers_ = new_subscribers;
+  }
+  return found;
+}
+
+std::shared_ptr<const UdpSocket::Subscribers> UdpSocket::subscribers() {
+  std::lock_guard<std::mutex> lock(subscribers_lock_);
+  return subscribers_;
+}
+
 void UdpSocket::Destroy() {
   if (socket_ != INVALID_SOCKET) {
     closesocket(socket_);
@@ -53,46 +243,86 @@ void UdpSocket::Destroy() {
 
 bool UdpSocket::Bind(const std::string& ip, int port) {
   if (socket_ == INVALID_SOCKET) {
-    LOG(kError, "bind udp socket failed: not created.");
+    NET_LOG(kError, "bind udp socket failed: not created.");
     return false;
   }
   if (bind_) {
-    LOG(kError, "bind udp socket failed: already bound.");
+    NET_LOG(kError, "bind udp socket failed: already bound.");
     return false;
   }
   SOCKADDR_IN bind_addr = {0};
   utility::ToSockAddr(ip, port, bind_addr);
   if (bind(socket_, (SOCKADDR*)&bind_addr, sizeof(bind_addr)) != 0) {
-    LOG(kError, "bind udp socket failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kError, "bind udp socket failed, error code: %d.", WSAGetLastError());
     return false;
   }
   auto reset_ctl = FALSE;
   DWORD return_bytes = 0;
   if (WSAIoctl(socket_, SIO_UDP_CONNRESET, &reset_ctl, sizeof(reset_ctl), NULL, 0, &return_bytes, NULL, NULL) != 0) {
-    LOG(kError, "set udp socket reset control failed, error code: %d.", WSAGetLastError());
+    NET_LOG(kError, "set udp socket reset control failed, error code: %d.", WSAGetLastError());
     return false;
   }
   bind_ = true;
   return true;
 }
 
-bool UdpSocket::AsyncSendTo(const char* buffer, int size, const std::string& ip, int port, LPOVERLAPPED ovlp) {
+bool UdpSocket::Connect(const NetEndpoint& peer) {
+  if (socket_ == INVALID_SOCKET) {
+    NET_LOG(kError, "connect udp socket failed: not created.");
+    return false;
+  }
+  if (!peer.valid()) {
+    NET_LOG(kError, "connect udp socket failed: invalid parameter.");
+    return false;
+  }
+  if (connect(socket_, (const SOCKADDR*)peer.addr(), peer.addr_size()) != 0) {
+    NET_LOG(kError, "connect udp socket failed, error code: %d.", WSAGetLastError());
+    return false;
+  }
+  connected_ = true;
+  return true;
+}
+
+bool UdpSocket::AsyncSendTo(const char* buffer, int size, const NetEndpoint& to, LPOVERLAPPED ovlp) {
+  if (socket_ == INVALID_SOCKET) {
+    NET_LOG(kError, "async udp socket send buffer failed: not created.");
+    return false;
+  }
+  if (buffer == nullptr || size == 0 || !to.valid() || ovlp == NULL) {
+    NET_LOG(kError, "async udp socket send buffer failed: invalid parameter.");
+    return false;
+  }
+  WSABUF buff = {0};
+  buff.buf = const_cast<char*>(buffer);
+  buff.len = size;
+  if (WSASendTo(socket_, &buff, 1, NULL, 0, (const SOCKADDR*)to.addr(), to.addr_size(), ovlp, NULL) != 0) {
+    if (WSAGetLastError() != ERROR_IO_PENDING) {
+      NET_LOG(kError, "WSASendTo failed, error code: %d.", WSAGetLastError());
+      return false;
+    }
+  }
+  return true;
+}
+
+bool UdpSocket::AsyncSend(const char* buffer, int size, LPOVERLAPPED ovlp) {
   if (socket_ == INVALID_SOCKET) {
-    LOG(kError, "async udp socket send buffer failed: not created.");
+    NET_LOG(kError, "async udp socket send buffer failed: not created.");
+    return false;
+  }
+  if (!connected_) {
+    NET_LOG(kError, "async udp socket send buffer failed: not connected.");
     return false;
   }
   if (buffer == nullptr || size == 0 || ovlp == NULL) {
-    LOG(kError, "async udp socket send buffer failed: invalid parameter.");
+    NET_LOG(kError, "async udp socket send buffer failed: invalid parameter.");
     return false;
   }
   WSABUF buff = {0};
   buff.buf = const_cast<char*>(buffer);
   buff.len = size;
-  SOCKADDR_IN send_to_addr = {0};
-  utility::ToSockAddr(ip, port, send_to_addr);
-  if (WSASendTo(socket_, &buff, 1, NULL, 0, (PSOCKADDR)&send_to_addr, sizeof(send_to_addr), ovlp, NULL) != 0) {
+  if (WSASend(socket_, &buff, 1, NULL, 0, ovlp, NULL) != 0) {
     if (WSAGetLastError() != ERROR_IO_PENDING) {
-      LOG(kError, "WSASendTo failed, error code: %d.", WSAGetLastError());
+      NET_LOG(kError, "WSASend failed, error code: %d.", WSAGetLastError());
       return false;
     }
   }
@@ -101,11 +331,11 @@ bool UdpSocket::AsyncSendTo(const char* buffer, int size, const std::string& ip,
 
 bool UdpSocket::AsyncRecvFrom(char* buffer, int size, PSOCKADDR_IN addr, PINT addr_size, LPOVERLAPPED ovlp) {
   if (socket_ == INVALID_SOCKET) {
-    LOG(kError, "async udp socket recv buffer failed: not created.");
+    NET_LOG(kError, "async udp socket recv buffer failed: not created.");
     return false;
   }
   if (buffer == nullptr || size == 0 || addr == nullptr || addr_size == nullptr || ovlp == NULL) {
-    LOG(kError, "async ud socket recv buffer failed: invalid parameter.");
+    NET_LOG(kError, "async ud socket recv buffer failed: invalid parameter.");
     return false;
   }
   WSABUF buff = {0};
@@ -114,7 +344,67 @@ bool UdpSocket::AsyncRecvFrom(char* buffer, int size, PSOCKADDR_IN addr, PINT ad
   DWORD received_flag = 0;
   if (WSARecvFrom(socket_, &buff, 1, NULL, &received_flag, (PSOCKADDR)addr, addr_size, ovlp, NULL) != 0) {
     if (WSAGetLastError() != ERROR_IO_PENDING) {
-      LOG(kError, "WSARecvFrom failed, error code: %d.", WSAGetLastError());
+      NET_LOG(kError, "WSARecvFrom failed, error code: %d.", WSAGetLastError());
+      return false;
+    }
+  }
+  return true;
+}
+
+bool UdpSocket::AsyncSendSegments(const char* buffer, int size, int segment_size, const NetEndpoint& to, LPOVERLAPPED ovlp) {
+  if (socket_ == INVALID_SOCKET) {
+    NET_LOG(kError, "async udp socket send segments failed: not created.");
+    return false;
+  }
+  if (!send_segmentation_) {
+    NET_LOG(kError, "async udp socket send segments failed: not supported.");
+    return false;
+  }
+  if (buffer == nullptr || size == 0 || segment_size <= 0 || !to.valid() || ovlp == NULL) {
+    NET_LOG(kError, "async udp socket send segments failed: invalid parameter.");
+    return false;
+  }
+  WSABUF buff = {0};
+  buff.buf = const_cast<char*>(buffer);
+  buff.len = size;
+  char control[WSA_CMSG_SPACE(sizeof(DWORD))] = {0};
+  WSAMSG msg = {0};
+  msg.name = (LPSOCKADDR)to.addr();
+  msg.namelen = to.addr_size();
+  msg.lpBuffers = &buff;
+  msg.dwBufferCount = 1;
+  msg.Control.buf = control;
+  msg.Control.len = sizeof(control);
+  auto cmsg = WSA_CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = IPPROTO_UDP;
+  cmsg->cmsg_type = UDP_SEND_MSG_SIZE;
+  cmsg->cmsg_len = WSA_CMSG_LEN(sizeof(DWORD));
+  *(PDWORD)WSA_CMSG_DATA(cmsg) = segment_size;
+  if (WSASendMsg(socket_, &msg, 0, NULL, ovlp, NULL) != 0) {
+    if (WSAGetLastError() != ERROR_IO_PENDING) {
+      NET_LOG(kError, "WSASendMsg failed, error code: %d.", WSAGetLastError());
+      return false;
+    }
+  }
+  return true;
+}
+
+bool UdpSocket::AsyncRecvMsg(LPWSAMSG msg, LPOVERLAPPED ovlp) {
+  if (socket_ == INVALID_SOCKET) {
+    NET_LOG(kError, "async udp socket recv msg failed: not created.");
+    return false;
+  }
+  if (recv_msg_ == nullptr) {
+    NET_LOG(kError, "async udp socket recv msg failed: coalescing not enabled.");
+    return false;
+  }
+  if (msg == NULL || ovlp == NULL) {
+    NET_LOG(kError, "async udp socket recv msg failed: invalid parameter.");
+    return false;
+  }
+  if (recv_msg_(socket_, msg, NULL, ovlp, NULL) != 0) {
+    if (WSAGetLastError() != ERROR_IO_PENDING) {
+      NET_LOG(kError, "WSARecvMsg failed, error code: %d.", WSAGetLastError());
       return false;
     }
   }
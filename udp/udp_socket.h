@@ -1,36 +1,82 @@
 #ifndef NET_UDP_SOCKET_H_
 #define NET_UDP_SOCKET_H_
 
+#include "net_endpoint.h"
+#include "rudp_mux.h"
 #include "uncopyable.h"
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 #include <WinSock2.h>
+#include <MSWSock.h>
 
 namespace net {
 
 class NetInterface;
+class UdpPacer;
+class UdpRecvQueue;
 
 class UdpSocket : public utility::Uncopyable {
  public:
+  typedef std::vector<std::weak_ptr<NetInterface>> Subscribers;
+
   UdpSocket();
   ~UdpSocket();
 
   bool Create(const std::weak_ptr<NetInterface>& callback);
   bool Bind(const std::string& ip, int port);
   void Destroy();
-  bool AsyncSendTo(const char* buffer, int size, const std::string& ip, int port, LPOVERLAPPED ovlp);
+  bool Connect(const NetEndpoint& peer);
+  bool AsyncSendTo(const char* buffer, int size, const NetEndpoint& to, LPOVERLAPPED ovlp);
+  bool AsyncSend(const char* buffer, int size, LPOVERLAPPED ovlp);
   bool AsyncRecvFrom(char* buffer, int size, PSOCKADDR_IN addr, PINT addr_size, LPOVERLAPPED ovlp);
+  bool AsyncSendSegments(const char* buffer, int size, int segment_size, const NetEndpoint& to, LPOVERLAPPED ovlp);
+  bool AsyncRecvMsg(LPWSAMSG msg, LPOVERLAPPED ovlp);
+  bool EnableRecvCoalescing(int max_size);
+  bool ReuseAddress();
+  bool SetBufferSizes(int recv_size, int send_size);
+  bool GetBufferSizes(int& recv_size, int& send_size);
+  bool JoinGroup(const std::string& group, const std::string& interface_ip, const std::string& source);
+  bool LeaveGroup(const std::string& group, const std::string& interface_ip, const std::string& source);
+  bool Subscribe(const std::weak_ptr<NetInterface>& subscriber);
+  bool Unsubscribe(const std::shared_ptr<NetInterface>& subscriber);
+  std::shared_ptr<const Subscribers> subscribers();
 
   SOCKET socket() const { return socket_; }
+  bool connected() const { return connected_; }
+  bool send_segmentation() const { return send_segmentation_; }
+  bool recv_coalescing() const { return recv_msg_ != nullptr; }
+  RudpMux& rudp_mux() { return rudp_mux_; }
+  bool fan_out() const { return fan_out_; }
+  std::shared_ptr<UdpRecvQueue> recv_queue() const { return recv_queue_; }
+  void set_recv_queue(const std::shared_ptr<UdpRecvQueue>& recv_queue) { recv_queue_ = recv_queue; }
+  std::shared_ptr<UdpPacer> pacer() const { return pacer_; }
+  void set_pacer(const std::shared_ptr<UdpPacer>& pacer) { pacer_ = pacer; }
   std::shared_ptr<NetInterface> callback() const { return callback_.lock(); }
+  void* context() const { return context_.load(std::memory_order_acquire); }
+  void set_context(void* context) { context_.store(context, std::memory_order_release); }
 
  private:
   void ResetMember();
+  void ProbeSendSegmentation();
+  bool ChangeMembership(bool join, const std::string& group, const std::string& interface_ip, const std::string& source);
 
  private:
   std::weak_ptr<NetInterface> callback_;
   SOCKET socket_;
   bool bind_;
+  bool connected_;
+  bool send_segmentation_;
+  LPFN_WSARECVMSG recv_msg_;
+  std::shared_ptr<UdpRecvQueue> recv_queue_;
+  std::shared_ptr<UdpPacer> pacer_;
+  RudpMux rudp_mux_;
+  std::atomic<bool> fan_out_;
+  std::shared_ptr<const Subscribers> subscribers_;
+  std::mutex subscribers_lock_;
+  std::atomic<void*> context_;
 };
 
 } // namespace net